@@ -13,6 +13,19 @@
 #include "Grid.h"
 //#include "Concepts.h"
 
+/**
+ * Copies the row (iy, iz) of a block into the lab.
+ * Blocks that do not store their elements contiguously specialize it.
+ */
+template<typename BlockType, typename ElementType>
+struct BlockLabRowCopy
+{
+	static inline void copy(BlockType& block, const int iy, const int iz, ElementType * const dst)
+	{
+		memcpy(dst, &block(0, iy, iz), sizeof(ElementType)*BlockType::sizeX);
+	}
+};
+
 /**
  * Working copy of Block + Ghosts.
  * Data of original block is copied (!) here. So when changing something in
@@ -186,8 +199,6 @@ public:
 			
 			BlockType& block = *(BlockType *)info.ptrBlock;
 			
-			ElementTypeBlock * ptrSource = &block(0);
-			
 			for(int iz=0; iz<nZ; iz++)
 				for(int iy=0; iy<nY; iy++)
 				{					
@@ -195,9 +206,7 @@ public:
 					
 					//for(int ix=0; ix<nX; ix++, ptrSource++, ptrDestination++)
 					//	*ptrDestination = (ElementType)*ptrSource;
-					memcpy(ptrDestination, ptrSource, sizeof(ElementType)*nX);
-					
-					ptrSource+= nX;
+					BlockLabRowCopy<BlockType, ElementType>::copy(block, iy, iz, ptrDestination);
 				}
 		}
 		
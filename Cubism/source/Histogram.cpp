@@ -23,61 +23,46 @@ void Histogram::notify(string sKernel, float dt)
     if (!bInitialized) 
         _setup();
     
-    mk2t[sKernel].push_back(dt);
+    mk2s[sKernel].add(dt);
 }
 
-void Histogram::consolidate()
+//all the ranks must have notified the same kernels
+void Histogram::consolidate(const bool verbose)
 {
     assert(bInitialized);
     
-    int rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank); 
-    
-    for(map<string,vector<float> >::iterator it=mk2t.begin(); it!=mk2t.end(); ++it)
+    for(map<string,QuantileSketch>::iterator it=mk2s.begin(); it!=mk2s.end(); ++it)
     {
-        vector<float> vSpentTime(mk2t[it->first].begin(),mk2t[it->first].end());
-        
-        vector<float> vSpentTime_all;
-        if (isroot) vSpentTime_all.resize(vSpentTime.size()*MPI::COMM_WORLD.Get_size());
-        
-        MPI::COMM_WORLD.Gather(&vSpentTime.front(), vSpentTime.size(), MPI_FLOAT, &vSpentTime_all.front(), vSpentTime.size(), MPI_FLOAT, 0);
+        it->second.reduce(MPI::COMM_WORLD, 0);
         
         if (isroot)
         {
-            _print_statistcis(it->first, vSpentTime_all);
-            _print2file(it->first, vSpentTime_all);
+            if (verbose)
+                _print_statistcis(it->first, it->second);
+            
+            _print2file(it->first, it->second);
         }
+        
+        it->second.clear();
     }
     
-    for( map<string,vector<float> >::iterator it=mk2t.begin(); it!=mk2t.end(); ++it)
-        it->second.clear();    
+    ++reportID;
 }
 
-void Histogram::_print2file(string sKernel, vector<float> & buf)
+//one line per report: report id, samples, p50, p90, p99, max
+void Histogram::_print2file(string sKernel, const QuantileSketch& sketch)
 {      
     char f_name_ascii[512];
     sprintf(f_name_ascii, "hist_%s", sKernel.c_str());
     
     FILE * pFile_ascii = fopen(f_name_ascii, "a");
-    for(int i=0; i<buf.size(); ++i)
-        fprintf(pFile_ascii, "%e\n", buf[i]);
+    fprintf(pFile_ascii, "%d %.0f %e %e %e %e\n", reportID, sketch.count(),
+            sketch.quantile(0.5), sketch.quantile(0.9), sketch.quantile(0.99), sketch.max_value());
     fclose (pFile_ascii);
 }
 
-void Histogram::_print_statistcis(string sKernel, vector<float> & buf)
+void Histogram::_print_statistcis(string sKernel, const QuantileSketch& sketch)
 {
-    float sum = 0, avg = 0, std_dev = 0;
-    int size = buf.size();
-    
-    for(int i=0; i<size; ++i)
-        sum += buf[i];
-    
-    avg = sum/(float)size;    
-    
-    for(int i=0; i<size; ++i)
-        std_dev += pow(buf[i]-avg,2);
-    
-    std_dev = sqrt(std_dev/((float)size-1));
-    
-    cout << sKernel << ": (Average, STD_DEV) ("<< avg << ", " << std_dev << ")" << endl;
+    cout << sKernel << ": (p50, p90, p99, max) (" << sketch.quantile(0.5) << ", " << sketch.quantile(0.9) << ", " 
+         << sketch.quantile(0.99) << ", " << sketch.max_value() << ") over " << sketch.count() << " samples" << endl;
 }
@@ -14,20 +14,24 @@
 #include <string>
 using namespace std;
 
+#include "QuantileSketch.h"
+
+//per-kernel timings: every rank keeps a quantile sketch per kernel,
+//consolidate merges them at rank 0 with a reduction and starts new sketches
 class Histogram
 {
-    map<string,vector<float> > mk2t;
+    map<string,QuantileSketch> mk2s;
     bool isroot;
     bool bInitialized;
     int reportID;
     
-    void _print2file(string sKernel, vector<float> & buf);
-    void _print_statistcis(string sKernel, vector<float> & buf);
+    void _print2file(string sKernel, const QuantileSketch& sketch);
+    void _print_statistcis(string sKernel, const QuantileSketch& sketch);
     void _setup();
     
 public:
-    Histogram(int a=0): mk2t() {}
+    Histogram(int a=0): mk2s(), isroot(false), bInitialized(false), reportID(0) {}
     
     void notify(string sKernel, float dt);
-    void consolidate();
+    void consolidate(const bool verbose = true);
 };
@@ -10,6 +10,24 @@
 #include <vector>
 #include <cassert>
 
+//a point of a block and the distance between its components: the blocks are AoS,
+//or have one array per component with _SOA_BLOCK_ (the labs are AoS in both cases)
+#ifdef _SOA_BLOCK_
+static const int PUP_COMPONENTSTRIDE = _BLOCKSIZEX_ * _BLOCKSIZEY_ * _BLOCKSIZEZ_;
+
+inline const Real * pup_point(const Real * const base, const unsigned int gptfloats, const int ix, const int iy, const int iz)
+{
+	return base + ix + _BLOCKSIZEX_*(iy + _BLOCKSIZEY_*iz);
+}
+#else
+static const int PUP_COMPONENTSTRIDE = 1;
+
+inline const Real * pup_point(const Real * const base, const unsigned int gptfloats, const int ix, const int iy, const int iz)
+{
+	return base + gptfloats*(ix + _BLOCKSIZEX_*(iy + _BLOCKSIZEY_*iz));
+}
+#endif
+
 void pack(const Real * const srcbase, Real * const dst, 
 			   const unsigned int gptfloats,
 			   int * selected_components, const int ncomponents,
@@ -20,10 +38,10 @@ void pack(const Real * const srcbase, Real * const dst,
 		for(int iy=ystart; iy<yend; ++iy)
 			for(int ix=xstart; ix<xend; ++ix)
 			{
-				const Real * src = srcbase + gptfloats*(ix + _BLOCKSIZEX_*(iy + _BLOCKSIZEY_*iz));
+				const Real * src = pup_point(srcbase, gptfloats, ix, iy, iz);
 				
 				for(int ic=0; ic<ncomponents; ic++, idst++)
-					dst[idst] = src[selected_components[ic]];
+					dst[idst] = src[PUP_COMPONENTSTRIDE*selected_components[ic]];
 			}
 }
 
@@ -37,10 +55,10 @@ void pack_stripes(const Real * const srcbase, Real * const dst,
 		for(int iy=ystart; iy<yend; ++iy)
 			for(int ix=xstart; ix<xend; ++ix)
 			{
-				const Real * src = srcbase + gptfloats*(ix + _BLOCKSIZEX_*(iy + _BLOCKSIZEY_*iz));
+				const Real * src = pup_point(srcbase, gptfloats, ix, iy, iz);
 				
 				for(int ic=selstart; ic<selend; ic++, idst++)
-					dst[idst] = src[ic];
+					dst[idst] = src[PUP_COMPONENTSTRIDE*ic];
 			}
 }
 
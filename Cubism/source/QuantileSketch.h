@@ -0,0 +1,120 @@
+/*
+ *  QuantileSketch.h
+ *  Cubism
+ *
+ *  Quantiles of a stream of positive samples in constant memory, as in DDSketch:
+ *  the buckets are logarithmic, so every quantile has a relative error below alpha.
+ *  All the sketches share the same buckets, merging them is a sum of the counts:
+ *  the sketches of all the ranks merge with one (tree) reduction.
+ *
+ */
+#pragma once
+
+#include <mpi.h>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+using namespace std;
+
+class QuantileSketch
+{
+public:
+
+	//with alpha = 1% the buckets cover 1e-9 ... 1e8
+	enum { NBUCKETS = 2048 };
+
+private:
+
+	double gamma, loggamma, smallest;
+
+	//counts[0] takes everything below smallest, the last bucket everything above the range
+	vector<double> counts;
+	double total, minval, maxval;
+
+	int _bucket(const double x) const
+	{
+		if (x <= smallest) return 0;
+
+		const int b = (int)ceil(log(x / smallest) / loggamma);
+
+		return max(1, min(b, NBUCKETS - 1));
+	}
+
+	//bucket b > 0 holds (smallest gamma^(b-1), smallest gamma^b]
+	double _value(const int b) const
+	{
+		if (b == 0) return smallest;
+
+		return smallest * 2 * pow(gamma, b) / (gamma + 1);
+	}
+
+public:
+
+	QuantileSketch(const double alpha = 0.01, const double smallest = 1e-9):
+	gamma((1 + alpha) / (1 - alpha)), loggamma(log(gamma)), smallest(smallest), counts(NBUCKETS)
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+
+		total = 0;
+		minval = numeric_limits<double>::max();
+		maxval = -numeric_limits<double>::max();
+	}
+
+	void add(const double x)
+	{
+		counts[_bucket(x)] += 1;
+		total += 1;
+		minval = min(minval, x);
+		maxval = max(maxval, x);
+	}
+
+	void merge(const QuantileSketch& other)
+	{
+		for(int b = 0; b < NBUCKETS; ++b)
+			counts[b] += other.counts[b];
+
+		total += other.total;
+		minval = min(minval, other.minval);
+		maxval = max(maxval, other.maxval);
+	}
+
+	//the merge of the sketches of all the ranks of comm ends up at root
+	void reduce(const MPI::Intracomm& comm, const int root = 0)
+	{
+		const bool isroot = comm.Get_rank() == root;
+
+		comm.Reduce(isroot ? MPI::IN_PLACE : &counts.front(), &counts.front(), NBUCKETS, MPI::DOUBLE, MPI::SUM, root);
+		comm.Reduce(isroot ? MPI::IN_PLACE : &total, &total, 1, MPI::DOUBLE, MPI::SUM, root);
+		comm.Reduce(isroot ? MPI::IN_PLACE : &minval, &minval, 1, MPI::DOUBLE, MPI::MIN, root);
+		comm.Reduce(isroot ? MPI::IN_PLACE : &maxval, &maxval, 1, MPI::DOUBLE, MPI::MAX, root);
+	}
+
+	double count() const { return total; }
+	double min_value() const { return total > 0 ? minval : 0; }
+	double max_value() const { return total > 0 ? maxval : 0; }
+
+	double quantile(const double q) const
+	{
+		if (total == 0) return 0;
+
+		const double rank = q * (total - 1);
+
+		double sum = 0;
+		int b = 0;
+
+		for(; b < NBUCKETS - 1; ++b)
+		{
+			sum += counts[b];
+
+			if (sum > rank) break;
+		}
+
+		return max(minval, min(maxval, _value(b)));
+	}
+};
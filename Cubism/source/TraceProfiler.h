@@ -0,0 +1,223 @@
+/*
+ *  TraceProfiler.h
+ *  Cubism
+ *
+ *  Timelines of nested regions, one per thread, on CLOCK_MONOTONIC_RAW,
+ *  exported as Chrome trace events (chrome://tracing, ui.perfetto.dev).
+ *  Regions are recorded only while the profiler is enabled:
+ *  otherwise a TraceRegion costs a branch.
+ *
+ */
+#pragma once
+
+#include <time.h>
+#include <pthread.h>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+class TraceProfiler
+{
+public:
+
+	typedef long long TraceTime; //nanoseconds
+
+	static TraceTime now()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+		return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	}
+
+	static TraceProfiler& instance()
+	{
+		static TraceProfiler profiler;
+
+		return profiler;
+	}
+
+private:
+
+	//names must outlive the profiler: string literals
+	struct TraceEvent
+	{
+		const char * name;
+		TraceTime begin, end;
+		int arg;
+	};
+
+	struct TraceAgent
+	{
+		int tid;
+		vector<TraceEvent> events;
+		vector<int> open; //indices of the regions not yet closed
+
+		TraceAgent(const int tid): tid(tid) { }
+	};
+
+	volatile bool enabled;
+	TraceTime origin;
+
+	pthread_mutex_t mutex;
+	vector<TraceAgent *> agents;
+
+	//each thread registers its agent once, then works on it without locking
+	TraceAgent& _agent()
+	{
+		static __thread TraceAgent * myagent = NULL;
+
+		if (myagent == NULL)
+		{
+			pthread_mutex_lock(&mutex);
+			myagent = new TraceAgent(agents.size());
+			agents.push_back(myagent);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		return *myagent;
+	}
+
+	TraceProfiler(): enabled(false), origin(now())
+	{
+		pthread_mutex_init(&mutex, NULL);
+	}
+
+	~TraceProfiler()
+	{
+		for(int i = 0; i < agents.size(); ++i)
+			delete agents[i];
+
+		pthread_mutex_destroy(&mutex);
+	}
+
+public:
+
+	bool is_enabled() const { return enabled; }
+
+	//timestamps are relative to the last enable
+	void enable()
+	{
+		origin = now();
+		enabled = true;
+	}
+
+	void disable() { enabled = false; }
+
+	void clear()
+	{
+		pthread_mutex_lock(&mutex);
+
+		for(int i = 0; i < agents.size(); ++i)
+		{
+			agents[i]->events.clear();
+			agents[i]->open.clear();
+		}
+
+		pthread_mutex_unlock(&mutex);
+	}
+
+	void begin(const char * const name, const int arg = -1)
+	{
+		TraceAgent& agent = _agent();
+
+		const TraceEvent event = { name, now(), -1, arg };
+
+		agent.open.push_back(agent.events.size());
+		agent.events.push_back(event);
+	}
+
+	void end()
+	{
+		TraceAgent& agent = _agent();
+
+		assert(agent.open.size() > 0);
+
+		agent.events[agent.open.back()].end = now();
+		agent.open.pop_back();
+	}
+
+	size_t nevents() const
+	{
+		size_t s = 0;
+
+		for(int i = 0; i < agents.size(); ++i)
+			s += agents[i]->events.size();
+
+		return s;
+	}
+
+	//complete events ("ph":"X") of all the threads, each one followed by a comma;
+	//pid tells the process (the rank), the thread is the order of registration
+	string json(const int pid) const
+	{
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(3);
+
+		ss << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"rank " << pid << "\"}},\n";
+
+		for(int a = 0; a < agents.size(); ++a)
+		{
+			const TraceAgent& agent = *agents[a];
+
+			ss << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << agent.tid
+			   << ",\"args\":{\"name\":\"thread " << agent.tid << "\"}},\n";
+
+			for(int i = 0; i < agent.events.size(); ++i)
+			{
+				const TraceEvent& e = agent.events[i];
+
+				if (e.end < 0) continue;
+
+				ss << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << agent.tid
+				   << ",\"ts\":" << (e.begin - origin) * 1e-3 << ",\"dur\":" << (e.end - e.begin) * 1e-3;
+
+				if (e.arg >= 0)
+					ss << ",\"args\":{\"block\":" << e.arg << "}";
+
+				ss << "},\n";
+			}
+		}
+
+		return ss.str();
+	}
+
+	//a single process: the whole trace in one file
+	void write(const string filename, const int pid = 0) const
+	{
+		string events = json(pid);
+		events.erase(events.size() - 2); //last comma
+
+		FILE * f = fopen(filename.c_str(), "w");
+		assert(f);
+
+		fprintf(f, "{\"traceEvents\":[\n%s\n],\"displayTimeUnit\":\"ns\"}\n", events.c_str());
+
+		fclose(f);
+	}
+};
+
+//scoped region, does nothing if the profiler was disabled when it started
+class TraceRegion
+{
+	const bool active;
+
+public:
+
+	TraceRegion(const char * const name, const int arg = -1): active(TraceProfiler::instance().is_enabled())
+	{
+		if (active)
+			TraceProfiler::instance().begin(name, arg);
+	}
+
+	~TraceRegion()
+	{
+		if (active)
+			TraceProfiler::instance().end();
+	}
+};
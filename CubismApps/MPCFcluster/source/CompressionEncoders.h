@@ -9,48 +9,261 @@
 
 #pragma once
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <string>
+
 #include <zlib.h>
 #if defined(_USE_LZ4_)
 #include <lz4.h>
 #endif
+#if defined(_USE_ZSTD_)
+#include <zstd.h>
+#endif
+
+//the entropy encoders applied to the wavelet streams, selected at runtime.
+//zlib is always there, lz4 and zstd only if the build links them (lz4=1, zstd=1)
+enum EncoderType { ENCODER_NONE = 0, ENCODER_ZLIB, ENCODER_LZ4, ENCODER_ZSTD, ENCODER_TYPES };
+
+#if defined(_USE_LZ4_) && !defined(_USE_ZLIB_)
+static const int ENCODER_DEFAULT = ENCODER_LZ4;
+#else
+static const int ENCODER_DEFAULT = ENCODER_ZLIB;
+#endif
+
 inline int deflate_inplace(z_stream *strm, unsigned char *buf, unsigned len, unsigned *max);
 inline size_t zdecompress(unsigned char * inputbuf, size_t ninputbytes, unsigned char * outputbuf, const size_t maxsize);
 
+inline const char * encoder_name(const int type)
+{
+	switch(type)
+	{
+		case ENCODER_NONE: return "none";
+		case ENCODER_ZLIB: return "zlib";
+		case ENCODER_LZ4: return "lz4";
+		case ENCODER_ZSTD: return "zstd";
+	}
+	
+	abort();
+	return "unknown";
+}
 
-inline size_t zdecompress(unsigned char * inputbuf, size_t ninputbytes, unsigned char * outputbuf, const size_t maxsize)
+//returns -1 if the name is not an encoder
+inline int encoder_type(const std::string name)
 {
-	int decompressedbytes = 0;
-#if defined(_USE_ZLIB_)
-	z_stream datastream = {0};
-	datastream.total_in = datastream.avail_in = ninputbytes;
-	datastream.total_out = datastream.avail_out = maxsize;
-	datastream.next_in = inputbuf;
-	datastream.next_out = outputbuf;
+	for(int type = 0; type < ENCODER_TYPES; ++type)
+		if (name == encoder_name(type))
+			return type;
 	
-	const int retval = inflateInit(&datastream);
+	return -1;
+}
+
+inline bool encoder_available(const int type)
+{
+	switch(type)
+	{
+		case ENCODER_NONE: return true;
+		case ENCODER_ZLIB: return true;
+#if defined(_USE_LZ4_)
+		case ENCODER_LZ4: return true;
+#endif
+#if defined(_USE_ZSTD_)
+		case ENCODER_ZSTD: return true;
+#endif
+	}
 	
-	if (retval == Z_OK && inflate(&datastream, Z_FINISH))
+	return false;
+}
+
+inline int encoder_default_level(const int type)
+{
+	switch(type)
 	{
-		decompressedbytes = datastream.total_out;
+		case ENCODER_ZLIB: return Z_DEFAULT_COMPRESSION;
+		case ENCODER_ZSTD: return 3;
 	}
-	else
+	
+	return 0;
+}
+
+//size of the scratch buffer needed by encode(), zero if the encoder works in-place
+inline size_t encoder_scratchsize(const int type, const size_t ninputbytes)
+{
+	switch(type)
 	{
-		printf("ZLIB DECOMPRESSION FAILURE!!\n");
-		abort();
+#if defined(_USE_LZ4_)
+		case ENCODER_LZ4: return LZ4_compressBound(ninputbytes);
+#endif
+#if defined(_USE_ZSTD_)
+		case ENCODER_ZSTD: return ZSTD_compressBound(ninputbytes);
+#endif
 	}
 	
-	inflateEnd(&datastream);
-#else	/* _USE_LZ4_ */
-	decompressedbytes = LZ4_uncompress_unknownOutputSize((char *)inputbuf, (char*) outputbuf, ninputbytes, maxsize);
-	if (decompressedbytes < 0)
+	return 0;
+}
+
+//encodes inputbuf[0..ninputbytes-1] (maxsize is the capacity of inputbuf).
+//the encoded stream is either left in inputbuf (none, zlib) or written into scratch,
+//the function returns where it lives and sets nencodedbytes accordingly
+inline unsigned char * encode(const int type, const int level, unsigned char * inputbuf, const size_t ninputbytes, const size_t maxsize,
+							  unsigned char * scratch, size_t& nencodedbytes)
+{
+	switch(type)
 	{
-		printf("LZ4 DECOMPRESSION FAILURE!!\n");
-		abort();
+		case ENCODER_NONE:
+		{
+			nencodedbytes = ninputbytes;
+			
+			return inputbuf;
+		}
+		case ENCODER_ZLIB:
+		{
+			z_stream myzstream = {0};
+			deflateInit(&myzstream, level);
+			
+			unsigned mah = maxsize;	
+			const int err = deflate_inplace(&myzstream, inputbuf, ninputbytes, &mah);
+			
+			if (err != Z_OK)
+			{
+				printf("ZLIB COMPRESSION FAILURE!!\n");
+				abort();
+			}
+			
+			nencodedbytes = myzstream.total_out;
+			deflateEnd(&myzstream);
+			
+			return inputbuf;
+		}
+#if defined(_USE_LZ4_)
+		case ENCODER_LZ4:
+		{
+			assert(scratch != NULL);
+			
+			const int compressedbytes = LZ4_compress((char *)inputbuf, (char *)scratch, ninputbytes);
+			
+			if (compressedbytes < 0)
+			{
+				printf("LZ4 COMPRESSION FAILURE!!\n");
+				abort();
+			}
+			
+			nencodedbytes = compressedbytes;
+			
+			return scratch;
+		}
+#endif
+#if defined(_USE_ZSTD_)
+		case ENCODER_ZSTD:
+		{
+			assert(scratch != NULL);
+			
+			const size_t compressedbytes = ZSTD_compress(scratch, ZSTD_compressBound(ninputbytes), inputbuf, ninputbytes, level);
+			
+			if (ZSTD_isError(compressedbytes))
+			{
+				printf("ZSTD COMPRESSION FAILURE: %s!!\n", ZSTD_getErrorName(compressedbytes));
+				abort();
+			}
+			
+			nencodedbytes = compressedbytes;
+			
+			return scratch;
+		}
+#endif
 	}
+	
+	printf("ENCODER <%s> IS NOT AVAILABLE IN THIS BUILD!!\n", encoder_name(type));
+	abort();
+	
+	return NULL;
+}
+
+inline size_t decode(const int type, unsigned char * inputbuf, size_t ninputbytes, unsigned char * outputbuf, const size_t maxsize)
+{
+	size_t decompressedbytes = 0;
+	
+	switch(type)
+	{
+		case ENCODER_NONE:
+		{
+			assert(ninputbytes <= maxsize);
+			memcpy(outputbuf, inputbuf, ninputbytes);
+			decompressedbytes = ninputbytes;
+			
+			break;
+		}
+		case ENCODER_ZLIB:
+		{
+			z_stream datastream = {0};
+			datastream.total_in = datastream.avail_in = ninputbytes;
+			datastream.total_out = datastream.avail_out = maxsize;
+			datastream.next_in = inputbuf;
+			datastream.next_out = outputbuf;
+			
+			const int retval = inflateInit(&datastream);
+			
+			if (retval == Z_OK && inflate(&datastream, Z_FINISH))
+			{
+				decompressedbytes = datastream.total_out;
+			}
+			else
+			{
+				printf("ZLIB DECOMPRESSION FAILURE!!\n");
+				abort();
+			}
+			
+			inflateEnd(&datastream);
+			
+			break;
+		}
+#if defined(_USE_LZ4_)
+		case ENCODER_LZ4:
+		{
+			const int nbytes = LZ4_uncompress_unknownOutputSize((char *)inputbuf, (char*) outputbuf, ninputbytes, maxsize);
+			
+			if (nbytes < 0)
+			{
+				printf("LZ4 DECOMPRESSION FAILURE!!\n");
+				abort();
+			}
+			
+			decompressedbytes = nbytes;
+			
+			break;
+		}
+#endif
+#if defined(_USE_ZSTD_)
+		case ENCODER_ZSTD:
+		{
+			decompressedbytes = ZSTD_decompress(outputbuf, maxsize, inputbuf, ninputbytes);
+			
+			if (ZSTD_isError(decompressedbytes))
+			{
+				printf("ZSTD DECOMPRESSION FAILURE: %s!!\n", ZSTD_getErrorName(decompressedbytes));
+				abort();
+			}
+			
+			break;
+		}
 #endif
+		default:
+		{
+			printf("ENCODER <%s> IS NOT AVAILABLE IN THIS BUILD!!\n", encoder_name(type));
+			abort();
+		}
+	}
+	
 	return decompressedbytes;
 }
 
+inline size_t zdecompress(unsigned char * inputbuf, size_t ninputbytes, unsigned char * outputbuf, const size_t maxsize)
+{
+	return decode(ENCODER_DEFAULT, inputbuf, ninputbytes, outputbuf, maxsize);
+}
+
 /* THIS CODE SERVES US TO COMPRESS IN-PLACE. TAKEN FROM THE WEB
  * http://stackoverflow.com/questions/12398377/is-it-possible-to-have-zlib-read-from-and-write-to-the-same-memory-buffer
  * 
@@ -76,7 +289,6 @@ inline size_t zdecompress(unsigned char * inputbuf, size_t ninputbytes, unsigned
 inline int deflate_inplace(z_stream *strm, unsigned char *buf, unsigned len,
 						   unsigned *max)
 {
-#if defined(_USE_ZLIB_)
     int ret;                    /* return code from deflate functions */
     unsigned have;              /* number of bytes in temp[] */
     unsigned char *hold;        /* allocated buffer to hold input data */
@@ -150,26 +362,4 @@ inline int deflate_inplace(z_stream *strm, unsigned char *buf, unsigned len,
     strm->zfree(strm->opaque, hold);
     *max = strm->next_out - buf;
     return ret == Z_OK ? Z_BUF_ERROR : (ret == Z_STREAM_END ? Z_OK : ret);
-#else	/* _USE_LZ4_ */
-	#define ZBUFSIZE (4*1024*1024)	/* fix this */
-	static char bufzlib[ZBUFSIZE];	/* and this per thread (threadprivate or better an small cyclic array of buffers ) */
-
-	if (ZBUFSIZE < *max) {
-		printf("small ZBUFSIZE\n");
-		abort();
-	}
-
-	int ninputbytes = len;          
-	int compressedbytes;
-
-#pragma omp critical
-	{
-	compressedbytes = LZ4_compress((char*) buf, (char *)bufzlib, ninputbytes);
-	memcpy(buf, bufzlib, compressedbytes);	
-	}
-
-	strm->total_out = compressedbytes;
-	*max = compressedbytes;
-        return (compressedbytes >= 0) ? Z_OK : Z_BUF_ERROR;
-#endif
 }
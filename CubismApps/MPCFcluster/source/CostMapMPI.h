@@ -0,0 +1,204 @@
+/*
+ *  CostMapMPI.h
+ *  MPCFcluster
+ *
+ *  Lab load and kernel time of every block, accumulated by _process over a number of steps.
+ *  The map goes out as a block-constant field, through the VP serializer and the HDF5 dumper,
+ *  and as a table of the block indices with their costs, which a repartitioner can read.
+ *
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <mpi.h>
+
+using namespace std;
+
+#include <BlockInfo.h>
+#include <HDF5Dumper_MPI.h>
+
+#include "SerializerIO_WaveletCompression_MPI_Simple.h"
+
+class CostMapMPI
+{
+	//local index of the blocks, looked up concurrently by the threads
+	map<long long, int> slots;
+	vector<int> indices; //ix, iy, iz of every slot
+	vector<double> lab, kernel;
+	int steps;
+
+	string _filename(const string prefix, const int step_id) const
+	{
+		std::stringstream name;
+		name << prefix << setfill('0') << setw(5) << step_id;
+
+		return name.str();
+	}
+
+	//the cost per step of every local block, in the dummy field until the next dump
+	template<typename TGrid>
+	void _fill(TGrid& grid) const
+	{
+		typedef typename TGrid::BlockType B;
+
+		vector<BlockInfo> vInfo = grid.getBlocksInfo();
+
+#pragma omp parallel for
+		for(int i = 0; i < vInfo.size(); ++i)
+		{
+			const int slot = slots.find(vInfo[i].blockID)->second;
+			const Real cost = (lab[slot] + kernel[slot]) / steps;
+
+			B& b = *(B*)vInfo[i].ptrBlock;
+
+			for(int iz = 0; iz < B::sizeZ; ++iz)
+				for(int iy = 0; iy < B::sizeY; ++iy)
+					for(int ix = 0; ix < B::sizeX; ++ix)
+						b(ix, iy, iz).dummy = cost;
+		}
+	}
+
+	//rows of ix, iy, iz, rank, lab, kernel gathered on the root
+	void _table(MPI::Intracomm comm, const string filename) const
+	{
+		enum { NCOLUMNS = 6 };
+
+		const int rank = comm.Get_rank();
+		const int nranks = comm.Get_size();
+		const int nslots = lab.size();
+
+		vector<double> rows(nslots * NCOLUMNS);
+
+		for(int s = 0; s < nslots; ++s)
+		{
+			double * const row = &rows[s * NCOLUMNS];
+
+			row[0] = indices[3 * s + 0];
+			row[1] = indices[3 * s + 1];
+			row[2] = indices[3 * s + 2];
+			row[3] = rank;
+			row[4] = lab[s] / steps;
+			row[5] = kernel[s] / steps;
+		}
+
+		int mycount = rows.size();
+		vector<int> counts(nranks), displs(nranks);
+
+		comm.Gather(&mycount, 1, MPI::INT, &counts.front(), 1, MPI::INT, 0);
+
+		for(int r = 1; r < nranks; ++r)
+			displs[r] = displs[r - 1] + counts[r - 1];
+
+		vector<double> all(rank == 0 ? displs.back() + counts.back() : 1);
+
+		comm.Gatherv(rows.size() ? &rows.front() : NULL, mycount, MPI::DOUBLE, &all.front(), &counts.front(), &displs.front(), MPI::DOUBLE, 0);
+
+		if (rank != 0) return;
+
+		FILE * f = fopen(filename.c_str(), "w");
+
+		if (f == NULL)
+		{
+			printf("CostMapMPI: cannot write <%s>\n", filename.c_str());
+			return;
+		}
+
+		fprintf(f, "# cost per step averaged over %d steps\n", steps);
+		fprintf(f, "# ix iy iz rank lab[s] kernel[s]\n");
+
+		vector<double> rankcost(nranks, 0);
+		double minblock = HUGE_VAL, maxblock = 0, total = 0;
+
+		for(int i = 0; i < all.size() / NCOLUMNS; ++i)
+		{
+			const double * const row = &all[i * NCOLUMNS];
+			const double cost = row[4] + row[5];
+
+			fprintf(f, "%d %d %d %d %e %e\n", (int)row[0], (int)row[1], (int)row[2], (int)row[3], row[4], row[5]);
+
+			rankcost[(int)row[3]] += cost;
+			minblock = min(minblock, cost);
+			maxblock = max(maxblock, cost);
+			total += cost;
+		}
+
+		fclose(f);
+
+		const int nblocks = all.size() / NCOLUMNS;
+		const double avgrank = total / nranks;
+		const double maxrank = *max_element(rankcost.begin(), rankcost.end());
+
+		printf("Cost map over %d steps: block %.3e/%.3e/%.3e s, rank %.3e/%.3e/%.3e s (min/avg/max), imbalance %.2f\n", steps,
+			   minblock, total / max(1, nblocks), maxblock,
+			   *min_element(rankcost.begin(), rankcost.end()), avgrank, maxrank, avgrank > 0 ? maxrank / avgrank : 1);
+	}
+
+public:
+
+	CostMapMPI(): steps(0) { }
+
+	template<typename TGrid>
+	void prepare(TGrid& grid)
+	{
+		if (slots.size()) return;
+
+		vector<BlockInfo> vInfo = grid.getBlocksInfo();
+
+		for(int i = 0; i < vInfo.size(); ++i)
+		{
+			slots[vInfo[i].blockID] = i;
+
+			for(int d = 0; d < 3; ++d)
+				indices.push_back(vInfo[i].index[d]);
+		}
+
+		lab.resize(vInfo.size(), 0);
+		kernel.resize(vInfo.size(), 0);
+	}
+
+	//called by the threads of _process, a block goes to one thread per pass
+	void add(const BlockInfo& info, const double tlab, const double tkernel)
+	{
+		map<long long, int>::const_iterator it = slots.find(info.blockID);
+		assert(it != slots.end());
+
+		lab[it->second] += tlab;
+		kernel[it->second] += tkernel;
+	}
+
+	void step() { ++steps; }
+
+	int nsteps() const { return steps; }
+
+	void reset()
+	{
+		std::fill(lab.begin(), lab.end(), 0.);
+		std::fill(kernel.begin(), kernel.end(), 0.);
+		steps = 0;
+	}
+
+	//datacost*: VP channel and HDF5 of the cost per step of the blocks, costmap*.txt: the table
+	template<typename TGrid>
+	void write(TGrid& grid, const string path, const int step_id)
+	{
+		assert(steps > 0);
+
+		_fill(grid);
+
+		SerializerIO_WaveletCompression_MPI_SimpleBlocking<TGrid, StreamerCostIterative> dumper;
+		dumper.template Write<0>(grid, path + "/" + _filename("datacost", step_id));
+
+		DumpHDF5_MPI<TGrid, StreamerCost_HDF5>(grid, step_id, _filename("datacost", step_id), path);
+
+		_table(grid.getCartComm(), path + "/" + _filename("costmap", step_id) + ".txt");
+	}
+};
@@ -0,0 +1,380 @@
+/*
+ *  DeltaCheckpointMPI.h
+ *  MPCFcluster
+ *
+ *  Checkpoints as XOR residuals against the previous checkpoint.
+ *  A full checkpoint is a residual against zero, every fullperiod-th
+ *  checkpoint is full so that the restore chain stays bounded.
+ *  A delta that is not smaller than the last full checkpoint also
+ *  starts a new chain: when every cell changes between checkpoints
+ *  the residuals compress no better than the solution itself.
+ *
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <omp.h>
+#include <mpi.h>
+
+using namespace std;
+
+#include "CompressionEncoders.h"
+
+//residuals are taken on words as wide as Real
+template<int bytes> struct DeltaCheckpointWord { };
+template<> struct DeltaCheckpointWord<4> { typedef unsigned int Type; };
+template<> struct DeltaCheckpointWord<8> { typedef unsigned long long Type; };
+
+template<typename TGrid>
+class DeltaCheckpointMPI
+{
+	typedef typename TGrid::BlockType B;
+	typedef typename DeltaCheckpointWord<sizeof(Real)>::Type Word;
+
+	//only the solution is saved, tmp is scratch of the time stepper
+	enum {
+		BLOCKBYTES = sizeof(typename B::ElementType) * B::sizeX * B::sizeY * B::sizeZ,
+		BLOCKWORDS = BLOCKBYTES / sizeof(Word)
+	};
+
+	int encoder, fullperiod;
+
+	//the grid as it was at the last checkpoint, and the files to replay to get it back
+	vector<Word> reference;
+	vector<string> chain;
+
+	//the step on disk (written or restored), the bytes of the last full file
+	int last_step;
+	size_t fullbytes;
+	bool fullnext;
+
+	static string _status_path(const string path) { return path + "/checkpoint.status"; }
+
+	static unsigned char * _block_data(const BlockInfo& info)
+	{
+		//the grid points are the first member of the block, in either layout
+		return (unsigned char *)info.ptrBlock;
+	}
+
+	string _header(const bool full, const int step_id, const int nranks, const int nblocks) const
+	{
+		std::stringstream ss;
+
+		ss << "\n==============START-ASCI-HEADER==============\n";
+		ss << "Kind: " << (full ? "full" : "delta") << "\n";
+		ss << "Step: " << step_id << "\n";
+		ss << "Encoder: " << encoder_name(encoder) << "\n";
+		ss << "Ranks: " << nranks << "\n";
+		ss << "Blocksperrank: " << nblocks << "\n";
+		ss << "Bytesperblock: " << BLOCKBYTES << "\n";
+		ss << "==============START-BINARY-DATA==============\n";
+
+		return ss.str();
+	}
+
+	//xor against the reference, then byte planes: the bytes that did not change become long runs of zeros
+	static void _residual(const Word * const current, const Word * const ref, unsigned char * const out)
+	{
+		for(int i = 0; i < BLOCKWORDS; ++i)
+		{
+			const Word r = current[i] ^ ref[i];
+
+			for(int b = 0; b < sizeof(Word); ++b)
+				out[b * BLOCKWORDS + i] = (r >> (8 * b)) & 0xff;
+		}
+	}
+
+	static void _apply_residual(const unsigned char * const in, Word * const current)
+	{
+		for(int i = 0; i < BLOCKWORDS; ++i)
+		{
+			Word r = 0;
+
+			for(int b = 0; b < sizeof(Word); ++b)
+				r |= (Word)in[b * BLOCKWORDS + i] << (8 * b);
+
+			current[i] ^= r;
+		}
+	}
+
+public:
+
+	DeltaCheckpointMPI(const int fullperiod = 10, const int encoder = ENCODER_DEFAULT):
+	encoder(encoder), fullperiod(max(1, fullperiod)), last_step(-1), fullbytes(0), fullnext(false) { }
+
+	void set_full_period(const int period) { fullperiod = max(1, period); }
+	
+	void set_encoder(const string name)
+	{
+		const int type = encoder_type(name);
+
+		if (type < 0 || !encoder_available(type))
+		{
+			printf("ENCODER <%s> IS NOT AVAILABLE IN THIS BUILD!! ABORTING NOW.\n", name.c_str());
+			abort();
+		}
+
+		encoder = type;
+	}
+
+	void Write(TGrid& grid, const string path, const int step_id, const double t)
+	{
+		const MPI::Intracomm& mycomm = grid.getCartComm();
+		const int myrank = mycomm.Get_rank();
+		const int nranks = mycomm.Get_size();
+
+		vector<BlockInfo> vInfo = grid.getResidentBlocksInfo();
+		const int nblocks = vInfo.size();
+
+		//this state is the last file of the chain already, e.g. the first save after Read
+		if (step_id == last_step)
+		{
+			if (myrank == 0)
+				printf("Checkpoint: step %d is already on disk, skipped\n", step_id);
+
+			return;
+		}
+
+		const bool full = fullnext || chain.size() == 0 || chain.size() >= fullperiod;
+
+		if (full)
+		{
+			chain.clear();
+			reference.clear();
+		}
+
+		reference.resize((size_t)nblocks * BLOCKWORDS, 0);
+
+		const double t0 = MPI::Wtime();
+
+		//residuals, one encoded stream per block
+		vector< vector<unsigned char> > streams(nblocks);
+
+#pragma omp parallel
+		{
+			vector<unsigned char> buffer(2 * BLOCKBYTES + 1024);
+			vector<unsigned char> scratch(encoder_scratchsize(encoder, BLOCKBYTES));
+
+#pragma omp for schedule(dynamic, 1)
+			for(int i = 0; i < nblocks; ++i)
+			{
+				Word * const current = (Word *)_block_data(vInfo[i]);
+				Word * const ref = &reference[(size_t)i * BLOCKWORDS];
+
+				_residual(current, ref, &buffer.front());
+
+				size_t nbytes = 0;
+				const unsigned char * const stream = encode(encoder, encoder_default_level(encoder), &buffer.front(), BLOCKBYTES, buffer.size(),
+															scratch.size() ? &scratch.front() : NULL, nbytes);
+
+				streams[i].resize(sizeof(int) + nbytes);
+				*(int *)&streams[i].front() = nbytes;
+				memcpy(&streams[i][sizeof(int)], stream, nbytes);
+
+				memcpy(ref, current, BLOCKBYTES);
+			}
+		}
+
+		const double t1 = MPI::Wtime();
+
+		//file layout: header, a table with (offset, bytes) per rank, the streams of every rank
+		std::stringstream ss;
+		ss << path << "/checkpoint" << setfill('0') << setw(5) << step_id << (full ? ".full" : ".delta");
+		const string filename = ss.str();
+
+		const string header = _header(full, step_id, nranks, nblocks);
+		const size_t table_start = header.size();
+		const size_t data_start = table_start + sizeof(size_t) * 2 * nranks;
+
+		size_t mybytes = 0;
+		for(int i = 0; i < nblocks; ++i)
+			mybytes += streams[i].size();
+
+		size_t myoffset = 0;
+		mycomm.Exscan(&mybytes, &myoffset, 1, MPI_UINT64_T, MPI::SUM);
+		if (myrank == 0) myoffset = 0;
+		myoffset += data_start;
+
+		vector<unsigned char> mydata;
+		mydata.reserve(mybytes);
+		for(int i = 0; i < nblocks; ++i)
+			mydata.insert(mydata.end(), streams[i].begin(), streams[i].end());
+
+		MPI::File myfile = MPI::File::Open(mycomm, filename.c_str(), MPI::MODE_CREATE | MPI::MODE_WRONLY, MPI::INFO_NULL);
+		myfile.Set_size(0);
+
+		if (myrank == 0)
+			myfile.Write_at(0, header.c_str(), header.size(), MPI::CHAR);
+
+		const size_t myentry[2] = { myoffset, mybytes };
+		myfile.Write_at_all(table_start + sizeof(myentry) * myrank, myentry, sizeof(myentry), MPI::CHAR);
+		myfile.Write_at_all(myoffset, mydata.size() ? &mydata.front() : NULL, mydata.size(), MPI::CHAR);
+
+		myfile.Close();
+
+		chain.push_back(filename);
+
+		//the status tells how to get the grid back
+		if (myrank == 0)
+		{
+			ofstream status(_status_path(path).c_str());
+
+			status << setprecision(numeric_limits<double>::digits10 + 2) << t << " " << step_id << "\n";
+
+			for(int i = 0; i < chain.size(); ++i)
+				status << chain[i] << "\n";
+		}
+
+		const double t2 = MPI::Wtime();
+
+		size_t totalbytes = 0;
+		mycomm.Allreduce(&mybytes, &totalbytes, 1, MPI_UINT64_T, MPI::SUM);
+
+		const size_t filebytes = data_start + totalbytes;
+
+		if (full) fullbytes = filebytes;
+
+		fullnext = !full && filebytes >= fullbytes;
+		last_step = step_id;
+
+		if (myrank == 0)
+			printf("Checkpoint (%s, chain %d): %.2f kB, CR: %.1fX, residuals %.3f s, writing %.3f s\n",
+				   full ? "full" : "delta", (int)chain.size(), totalbytes / 1024.,
+				   BLOCKBYTES * (double)nblocks * nranks / totalbytes, t1 - t0, t2 - t1);
+	}
+
+	//replays the chain of the last checkpoint, the decomposition must not change
+	void Read(TGrid& grid, const string path, int& step_id, double& t)
+	{
+		const MPI::Intracomm& mycomm = grid.getCartComm();
+		const int myrank = mycomm.Get_rank();
+		const int nranks = mycomm.Get_size();
+
+		vector<BlockInfo> vInfo = grid.getResidentBlocksInfo();
+		const int nblocks = vInfo.size();
+
+		chain.clear();
+
+		{
+			ifstream status(_status_path(path).c_str());
+			assert(status.good());
+
+			status >> t >> step_id;
+
+			string filename;
+			while (status >> filename)
+				chain.push_back(filename);
+
+			assert(chain.size() > 0);
+		}
+
+		reference.clear();
+		reference.resize((size_t)nblocks * BLOCKWORDS, 0);
+
+		size_t lastbytes = 0;
+
+		for(int c = 0; c < chain.size(); ++c)
+		{
+			MPI::File myfile = MPI::File::Open(mycomm, chain[c].c_str(), MPI::MODE_RDONLY, MPI::INFO_NULL);
+
+			lastbytes = myfile.Get_size();
+			if (c == 0) fullbytes = lastbytes;
+
+			//check the header, read our entry of the table
+			int fileencoder = -1;
+			size_t table_start = 0;
+
+			{
+				vector<char> buf(4096, 0);
+				myfile.Read_at_all(0, &buf.front(), buf.size() - 1, MPI::CHAR);
+
+				const string text(&buf.front());
+				const string marker = "==============START-BINARY-DATA==============\n";
+				const size_t markerpos = text.find(marker);
+
+				if (markerpos == string::npos)
+				{
+					printf("ATTENZIONE: %s is not a checkpoint file. ABORTING NOW.\n", chain[c].c_str());
+					abort();
+				}
+
+				table_start = markerpos + marker.size();
+
+				std::stringstream lines(text.substr(0, markerpos));
+				string line;
+
+				int fileranks = -1, fileblocks = -1, filebytes = -1;
+
+				while (getline(lines, line))
+				{
+					if (line.find("Encoder: ") == 0) fileencoder = encoder_type(line.substr(9));
+					sscanf(line.c_str(), "Ranks: %d", &fileranks);
+					sscanf(line.c_str(), "Blocksperrank: %d", &fileblocks);
+					sscanf(line.c_str(), "Bytesperblock: %d", &filebytes);
+				}
+
+				if (fileranks != nranks || fileblocks != nblocks || filebytes != BLOCKBYTES || fileencoder < 0)
+				{
+					printf("ATTENZIONE: %s has %d ranks x %d blocks x %d bytes and I have %d x %d x %d. ABORTING NOW.\n",
+						   chain[c].c_str(), fileranks, fileblocks, filebytes, nranks, nblocks, (int)BLOCKBYTES);
+					abort();
+				}
+			}
+
+			size_t myentry[2];
+			myfile.Read_at_all(table_start + sizeof(myentry) * myrank, myentry, sizeof(myentry), MPI::CHAR);
+
+			vector<unsigned char> mydata(myentry[1]);
+			myfile.Read_at_all(myentry[0], mydata.size() ? &mydata.front() : NULL, mydata.size(), MPI::CHAR);
+
+			myfile.Close();
+
+			//offsets of the block streams
+			vector<size_t> offsets(nblocks);
+
+			for(size_t i = 0, s = 0; i < nblocks; ++i)
+			{
+				offsets[i] = s;
+				s += sizeof(int) + *(int *)&mydata[s];
+
+				assert(s <= mydata.size());
+			}
+
+#pragma omp parallel
+			{
+				vector<unsigned char> buffer(2 * BLOCKBYTES + 1024);
+
+#pragma omp for schedule(dynamic, 1)
+				for(int i = 0; i < nblocks; ++i)
+				{
+					unsigned char * const stream = &mydata[offsets[i]];
+					const int nbytes = *(int *)stream;
+
+					const size_t decodedbytes = decode(fileencoder, stream + sizeof(int), nbytes, &buffer.front(), buffer.size());
+					assert(decodedbytes == BLOCKBYTES);
+
+					_apply_residual(&buffer.front(), &reference[(size_t)i * BLOCKWORDS]);
+				}
+			}
+		}
+
+#pragma omp parallel for
+		for(int i = 0; i < nblocks; ++i)
+			memcpy(_block_data(vInfo[i]), &reference[(size_t)i * BLOCKWORDS], BLOCKBYTES);
+
+		//the next checkpoint is what it would have been without the restart
+		last_step = step_id;
+		fullnext = chain.size() > 1 && lastbytes >= fullbytes;
+
+		if (myrank == 0)
+			printf("Restored step %d from a chain of %d checkpoints\n", step_id, (int)chain.size());
+	}
+};
@@ -24,14 +24,16 @@
 
 #ifdef _USE_HPM_
 #include <mpi.h>
-extern "C" void HPM_Start(char *);
-extern "C" void HPM_Stop(char *);
+extern "C" void HPM_Start(const char *);
+extern "C" void HPM_Stop(const char *);
 #else
 #define HPM_Start(x)
 #define HPM_Stop(x)
 #endif
 
 #include <ParIO.h>// peh
+#include "TraceProfilerMPI.h"
+#include "CostMapMPI.h"
 
 typedef BlockLabMPI<Lab> LabMPI;
 
@@ -43,32 +45,43 @@ namespace LSRK3MPIdata
     int counter = 0, GSYNCH = 0, nsynch = 0;
 	
 #ifndef _SEQUOIA_
+	//-histraw 1: every sample of every rank in the hist_*.bin files
+	bool hist_raw = false;
     MPI_ParIO_Group hist_group;     // peh+
     MPI_ParIO hist_update, hist_rhs, hist_stepid, hist_nsync;// peh
 #endif
-    //Histogram histogram;
+	//quantiles of the timings over all ranks, one line per report in hist_FLOWSTEP, hist_UPDATE
+    Histogram histogram;
+	
+	//-costmap N: timings of every block, NULL if not recorded
+	CostMapMPI * costmap = NULL;
     
     template<typename Kflow, typename Kupdate>
     void notify(double avg_time_rhs, double avg_time_update, const size_t NBLOCKS, const size_t NTIMES)
     {
 #ifndef _SEQUOIA_
-		if(LSRK3data::step_id % LSRK3data::ReportFreq == 0 && LSRK3data::step_id > 0)
+		if (hist_raw)
 		{
-		    hist_update.Consolidate(LSRK3data::step_id);// peh
-			hist_stepid.Consolidate(LSRK3data::step_id); // peh
-			hist_rhs.Consolidate(LSRK3data::step_id); // peh
-			hist_nsync.Consolidate(LSRK3data::step_id);//peh
+			if(LSRK3data::step_id % LSRK3data::ReportFreq == 0 && LSRK3data::step_id > 0)
+			{
+				hist_update.Consolidate(LSRK3data::step_id);// peh
+				hist_stepid.Consolidate(LSRK3data::step_id); // peh
+				hist_rhs.Consolidate(LSRK3data::step_id); // peh
+				hist_nsync.Consolidate(LSRK3data::step_id);//peh
+			}
+			
+			hist_update.Notify((float)avg_time_update);// peh
+			hist_rhs.Notify((float)avg_time_rhs); //peh
+			hist_stepid.Notify((float)LSRK3data::step_id);// peh
+			hist_nsync.Notify((float)nsynch/NTIMES);//peh
 		}
-		
-		hist_update.Notify((float)avg_time_update);// peh
-		hist_rhs.Notify((float)avg_time_rhs); //peh
-		hist_stepid.Notify((float)LSRK3data::step_id);// peh
-		hist_nsync.Notify((float)nsynch/NTIMES);//peh
 #endif
-		//histogram.notify("FLOWSTEP", (float)avg_time_rhs);
-		//histogram.notify("UPDATE", (float)avg_time_update);
-		//histogram.notify("STEPID", (float)LSRK3data::step_id);
-		//histogram.notify("NSYNCH", (float)nsynch/NTIMES);
+		if(LSRK3data::step_id % LSRK3data::ReportFreq == 0 && LSRK3data::step_id > 0)
+			histogram.consolidate(LSRK3data::verbosity >= 1);
+		
+		histogram.notify("FLOWSTEP", (float)avg_time_rhs);
+		histogram.notify("UPDATE", (float)avg_time_update);
+		histogram.notify("NSYNCH", (float)nsynch/NTIMES);
 		nsynch = 0;
 		
 		if(LSRK3data::step_id % LSRK3data::ReportFreq == 0 && LSRK3data::step_id > 0)
@@ -136,12 +149,31 @@ void _process(vector<BlockInfo>& vInfo, Operator rhs, TGrid& grid, const Real t,
         const int N = vInfo.size();
         mylab.prepare(grid, synch);
         
+		CostMapMPI * const costmap = LSRK3MPIdata::costmap;
+		
 #pragma omp for schedule(runtime)
         for(int i=0; i<N; i++)
         {
-            mylab.load(ary[i], t);
+			Timer timer;
+			double t_lab = 0;
+			
+			if (costmap) timer.start();
+			{
+				TraceRegion region("LAB", ary[i].blockID);
+				mylab.load(ary[i], t);
+			}
 			
-            myrhs(mylab, ary[i], *(FluidBlock*)ary[i].ptrBlock);
+			if (costmap)
+			{
+				t_lab = timer.stop();
+				timer.start();
+			}
+			{
+				TraceRegion region("KERNEL", ary[i].blockID);
+				myrhs(mylab, ary[i], *(FluidBlock*)ary[i].ptrBlock);
+			}
+			
+			if (costmap) costmap->add(ary[i], t_lab, timer.stop());
         }		
     }
 
@@ -187,6 +219,7 @@ template<typename TGrid>
 class FlowStep_LSRK3MPI : public FlowStep_LSRK3
 {
     TGrid & grid;
+	CostMapMPI * costmap;
     //Histogram histogram_sos;
 	
 	Real _computeSOS()
@@ -210,6 +243,8 @@ class FlowStep_LSRK3MPI : public FlowStep_LSRK3
 		{
 			vector<BlockInfo> vInfo = grid.getBlocksInfo();
 			
+			TraceRegion region("STEP", LSRK3data::step_id);
+			
             vector< pair<double, double> > timings;
             
 			timings.push_back(step(grid, vInfo, 0      , 1./4, dtinvh, current_time));
@@ -228,12 +263,19 @@ class FlowStep_LSRK3MPI : public FlowStep_LSRK3
 			Timer timer;	
             LSRK3data::FlowStep<Kflow, Lab> rhs(a, dtinvh);   
 			
+			TraceRegion stageregion("STAGE");
+			
             timer.start();            
 			
 #ifdef _USE_HPM_
 			if (LSRK3data::step_id>0) HPM_Start("RHS sync method");
 #endif
-            SynchronizerMPI& synch = ((TGrid&)grid).sync(rhs);
+			SynchronizerMPI * psynch = NULL;
+			{
+				TraceRegion region("SYNC");
+				psynch = &((TGrid&)grid).sync(rhs);
+			}
+            SynchronizerMPI& synch = *psynch;
 #ifdef _USE_HPM_
             if (LSRK3data::step_id>0) HPM_Stop("RHS sync method");
 #endif
@@ -252,17 +294,24 @@ class FlowStep_LSRK3MPI : public FlowStep_LSRK3
 					timer2.start();
 					vector<BlockInfo> avail;
 					
-					if (ipass == 0)  
-						avail = synch.avail_inner();
-					else
-						avail = synch.avail_halo(); 
+					{
+						TraceRegion region(ipass == 0 ? "AVAIL INNER" : "AVAIL HALO");
+						
+						if (ipass == 0)  
+							avail = synch.avail_inner();
+						else
+							avail = synch.avail_halo(); 
+					}
 					
 					LSRK3MPIdata::t_synch_fs += timer2.stop();                           
 					
 					const bool record = LSRK3data::step_id%10==0;
 					
 					timer2.start();
-					_process< LabMPI >(avail, rhs, (TGrid&)grid, current_time, record);
+					{
+						TraceRegion region(ipass == 0 ? "RHS INNER" : "RHS HALO");
+						_process< LabMPI >(avail, rhs, (TGrid&)grid, current_time, record);
+					}
 					LSRK3MPIdata::t_bp_fs += timer2.stop();
 					
 					LSRK3MPIdata::counter++;
@@ -274,13 +323,20 @@ class FlowStep_LSRK3MPI : public FlowStep_LSRK3
 					Timer timer2;
 					
 					timer2.start();
-					vector<BlockInfo> avail = synch.avail(LSRK3MPIdata::GSYNCH);
+					vector<BlockInfo> avail;
+					{
+						TraceRegion region("AVAIL");
+						avail = synch.avail(LSRK3MPIdata::GSYNCH);
+					}
 					LSRK3MPIdata::t_synch_fs += timer2.stop();                           
 					
 					const bool record = LSRK3data::step_id%10==0;
 					
 					timer2.start();
-					_process< LabMPI >(avail, rhs, (TGrid&)grid, current_time, record);
+					{
+						TraceRegion region("RHS");
+						_process< LabMPI >(avail, rhs, (TGrid&)grid, current_time, record);
+					}
 					LSRK3MPIdata::t_bp_fs += timer2.stop();
 					
 					
@@ -298,7 +354,10 @@ class FlowStep_LSRK3MPI : public FlowStep_LSRK3
 #endif
 			LSRK3data::Update<Kupdate> update(b, &vInfo.front());
 			timer.start();
-			update.omp(vInfo.size());
+			{
+				TraceRegion region("UPDATE");
+				update.omp(vInfo.size());
+			}
 #ifdef _USE_HPM_
 			if (LSRK3data::step_id>0) 			HPM_Stop("Update");
 #endif
@@ -316,28 +375,39 @@ public:
 	
 	~FlowStep_LSRK3MPI()
 	{
+		if (LSRK3MPIdata::costmap == costmap) LSRK3MPIdata::costmap = NULL;
+		delete costmap;
+		
 #ifndef _SEQUOIA_
-		LSRK3MPIdata::hist_update.Finalize();
-		LSRK3MPIdata::hist_rhs.Finalize();
-		LSRK3MPIdata::hist_stepid.Finalize();
-		LSRK3MPIdata::hist_nsync.Finalize();
+		if (LSRK3MPIdata::hist_raw)
+		{
+			LSRK3MPIdata::hist_update.Finalize();
+			LSRK3MPIdata::hist_rhs.Finalize();
+			LSRK3MPIdata::hist_stepid.Finalize();
+			LSRK3MPIdata::hist_nsync.Finalize();
+		}
 #endif
 	}
 	
 	FlowStep_LSRK3MPI(TGrid & grid, const Real CFL, const Real gamma1, const Real gamma2, ArgumentParser& parser, const int verbosity, Profiler* profiler=NULL, const Real pc1=0, const Real pc2=0):
 	
-    FlowStep_LSRK3(grid, CFL, gamma1, gamma2, parser, verbosity, profiler, pc1, pc2), grid(grid)
+    FlowStep_LSRK3(grid, CFL, gamma1, gamma2, parser, verbosity, profiler, pc1, pc2), grid(grid), costmap(NULL)
     {
 		if (verbosity) cout << "GSYNCH " << parser("-gsync").asInt(omp_get_max_threads()) << endl;
 		
 #ifndef _SEQUOIA_	
-		static const int pehflag = 0; 
-		LSRK3MPIdata::hist_group.Init(8, parser("-report").asInt(1), pehflag); // peh
+		LSRK3MPIdata::hist_raw = parser("-histraw").asBool(false);
 		
-		LSRK3MPIdata::hist_update.Init("hist_UPDATE.bin", &LSRK3MPIdata::hist_group); // peh
-		LSRK3MPIdata::hist_rhs.Init("hist_FLOWSTEP.bin", &LSRK3MPIdata::hist_group); //peh
-		LSRK3MPIdata::hist_stepid.Init("hist_STEPID.bin", &LSRK3MPIdata::hist_group); // peh
-		LSRK3MPIdata::hist_nsync.Init("hist_NSYNCH.bin", &LSRK3MPIdata::hist_group); // peh
+		if (LSRK3MPIdata::hist_raw)
+		{
+			static const int pehflag = 0; 
+			LSRK3MPIdata::hist_group.Init(8, parser("-report").asInt(1), pehflag); // peh
+			
+			LSRK3MPIdata::hist_update.Init("hist_UPDATE.bin", &LSRK3MPIdata::hist_group); // peh
+			LSRK3MPIdata::hist_rhs.Init("hist_FLOWSTEP.bin", &LSRK3MPIdata::hist_group); //peh
+			LSRK3MPIdata::hist_stepid.Init("hist_STEPID.bin", &LSRK3MPIdata::hist_group); // peh
+			LSRK3MPIdata::hist_nsync.Init("hist_NSYNCH.bin", &LSRK3MPIdata::hist_group); // peh
+		}
 #endif
     }
 	
@@ -351,12 +421,48 @@ public:
         
 		LSRK3MPIdata::GSYNCH = parser("-gsync").asInt(omp_get_max_threads());
         
+		//-trace N: Chrome trace of the N steps from -tracestart on
+		{
+			const int tracestart = parser("-tracestart").asInt(1);
+			const int tracesteps = parser("-trace").asInt(0);
+			
+			if (tracesteps > 0 && LSRK3data::step_id == tracestart)
+				TraceProfilerMPI::enable(grid.getCartComm(), parser("-tracefile").asString("trace.json"));
+			
+			//a run that ends earlier writes the trace in dispose()
+			if (tracesteps > 0 && LSRK3data::step_id == tracestart + tracesteps)
+				TraceProfilerMPI::flush();
+		}
+		
+		//-costmap N: block costs of the RHS accumulated over N steps from step 1 on, see CostMapMPI.h
+		{
+			const int coststeps = parser("-costmap").asInt(0);
+			
+			if (coststeps > 0 && costmap == NULL)
+			{
+				costmap = new CostMapMPI;
+				costmap->prepare(grid);
+			}
+			
+			if (costmap != NULL && costmap->nsteps() == coststeps)
+			{
+				costmap->write(grid, parser("-fpath").asString("."), LSRK3data::step_id);
+				costmap->reset();
+			}
+			
+			LSRK3MPIdata::costmap = LSRK3data::step_id > 0 ? costmap : NULL;
+		}
+		
 		Timer timer;
 		timer.start();
 #ifdef _USE_HPM_
 		if (LSRK3data::step_id>0) 	HPM_Start("dt");
 #endif
-		const Real maxSOS = _computeSOS();
+		Real maxSOS = 0;
+		{
+			TraceRegion region("SOS");
+			maxSOS = _computeSOS();
+		}
 #ifdef _USE_HPM_
 		if (LSRK3data::step_id>0) 		HPM_Stop("dt");
 #endif
@@ -406,6 +512,8 @@ public:
 			MPI::COMM_WORLD.Abort(1);
 	    }
 		
+		if (LSRK3MPIdata::costmap) LSRK3MPIdata::costmap->step();
+		
 		LSRK3data::step_id++; current_time+=dt;
 		
 		return dt;
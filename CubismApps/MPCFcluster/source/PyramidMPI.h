@@ -0,0 +1,68 @@
+/*
+ *  PyramidMPI.h
+ *  MPCFcluster
+ *
+ *  The pyramid levels of all the ranks in one file per level,
+ *  written with collective MPI-IO: every rank owns a brick of each level.
+ *
+ */
+
+#pragma once
+
+#include <mpi.h>
+
+#include <Pyramid.h>
+
+template<typename TGrid, typename TStreamer>
+class PyramidMPI: public Pyramid<TGrid, TStreamer>
+{
+	typedef Pyramid<TGrid, TStreamer> TBase;
+
+public:
+
+	PyramidMPI(const int levels, const vector<int> channels): TBase(levels, channels) { }
+
+	void write(TGrid& grid, const string prefix) const
+	{
+		const MPI::Intracomm& mycomm = grid.getCartComm();
+
+		for(int l = 1; l <= this->levels; ++l)
+		{
+			const string header = this->_header(l);
+			const int n = this->_side(l);
+
+			MPI::File myfile = MPI::File::Open(mycomm, this->_filename(prefix, l).c_str(), MPI::MODE_CREATE | MPI::MODE_WRONLY, MPI::INFO_NULL);
+			myfile.Set_size(0);
+
+			if (mycomm.Get_rank() == 0)
+				myfile.Write_at(0, header.c_str(), header.size(), MPI::CHAR);
+
+			//C order, z slowest
+			int sizes[3], subsizes[3], starts[3];
+
+			for(int d = 0; d < 3; ++d)
+			{
+				sizes[2 - d] = this->totalbpd[d] * n;
+				subsizes[2 - d] = this->brickbpd[d] * n;
+				starts[2 - d] = this->brickstart[d] * n;
+			}
+
+			MPI::Datatype filetype = MPI::FLOAT.Create_subarray(3, sizes, subsizes, starts, MPI::ORDER_C);
+			filetype.Commit();
+
+			const size_t brickvalues = this->_brickvalues(l);
+			const size_t globalvalues = this->_globalvalues(l);
+
+			for(int c = 0; c < this->channels.size(); ++c)
+			{
+				const MPI::Offset displacement = header.size() + sizeof(float) * c * globalvalues;
+
+				myfile.Set_view(displacement, MPI::FLOAT, filetype, "native", MPI::INFO_NULL);
+				myfile.Write_all(&this->data[l - 1][c * brickvalues], brickvalues, MPI::FLOAT);
+			}
+
+			filetype.Free();
+			myfile.Close();
+		}
+	}
+};
@@ -0,0 +1,100 @@
+/*
+ *  ReadWaveletCompression_MPI.h
+ *  MPCFcluster
+ *
+ *  Fills the grid from the channel files of SerializerIO_WaveletCompression_MPI_SimpleBlocking.
+ *  Every rank decodes only the chunks of its own blocks, the decomposition may differ from the one of the writer.
+ *
+ */
+
+#pragma once
+
+#include <sstream>
+#include <vector>
+#include <limits>
+
+#include "../../tools/reader/Reader_WaveletCompression.h"
+
+template<typename TGrid, typename TStreamer>
+void ReadWaveletCompression_MPI(TGrid& grid, const string fileprefix)
+{
+	typedef typename TGrid::BlockType B;
+
+	enum { BS = _BLOCKSIZE_, NPOINTS = BS * BS * BS, NCHANNELS = TStreamer::channels };
+
+	MPI::Cartcomm mycomm = grid.getCartComm();
+	const bool isroot = mycomm.Get_rank() == 0;
+
+	vector<BlockInfo> vInfo = grid.getBlocksInfo();
+	const int nblocks = vInfo.size();
+
+	//my blocks form a brick
+	int start[3], end[3];
+
+	for(int d = 0; d < 3; ++d)
+	{
+		start[d] = numeric_limits<int>::max();
+		end[d] = -1;
+
+		for(int i = 0; i < nblocks; ++i)
+		{
+			start[d] = min(start[d], vInfo[i].index[d]);
+			end[d] = max(end[d], vInfo[i].index[d] + 1);
+		}
+	}
+
+	const int xsize = (end[0] - start[0]) * BS;
+	const int ysize = (end[1] - start[1]) * BS;
+
+	TStreamer streamer;
+	vector< vector<Real> > channels(NCHANNELS);
+	bool lossy = false;
+
+	for(int c = 0; c < NCHANNELS; ++c)
+	{
+		std::stringstream ss;
+		ss << fileprefix << "." << streamer.name() << ".channel" << c;
+
+		Reader_WaveletCompressionMPI reader(mycomm, ss.str());
+		reader.load_file();
+
+		MYASSERT(reader.xblocks() == grid.getBlocksPerDimension(0) &&
+				 reader.yblocks() == grid.getBlocksPerDimension(1) &&
+				 reader.zblocks() == grid.getBlocksPerDimension(2),
+				 "\nATTENZIONE:\n" << ss.str() << " has " << reader.xblocks() << " x " << reader.yblocks() << " x " << reader.zblocks() << " blocks\n");
+
+		lossy = lossy || reader.is_halffloat() || reader.wavelet_threshold() != 0;
+
+		channels[c].resize((size_t)nblocks * NPOINTS);
+		reader.load_region(start, end, &channels[c].front());
+	}
+
+	if (lossy && isroot)
+		printf("ATTENZIONE: restarting from lossy wavelet files (threshold > 0 or half floats)\n");
+
+#pragma omp parallel for
+	for(int i = 0; i < nblocks; ++i)
+	{
+		BlockInfo info = vInfo[i];
+		B& b = *(B*)info.ptrBlock;
+
+		const int bx = info.index[0] - start[0];
+		const int by = info.index[1] - start[1];
+		const int bz = info.index[2] - start[2];
+
+		for(int iz = 0; iz < BS; ++iz)
+			for(int iy = 0; iy < BS; ++iy)
+				for(int ix = 0; ix < BS; ++ix)
+				{
+					const size_t idx = bx * BS + ix + xsize * ((size_t)by * BS + iy + ysize * ((size_t)bz * BS + iz));
+
+					Real input[NCHANNELS];
+
+					for(int c = 0; c < NCHANNELS; ++c)
+						input[c] = channels[c][idx];
+
+					typename B::ElementRef e = b(ix, iy, iz);
+					streamer.inverse(input, e);
+				}
+	}
+}
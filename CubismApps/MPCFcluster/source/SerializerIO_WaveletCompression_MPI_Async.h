@@ -0,0 +1,401 @@
+/*
+ *  SerializerIO_WaveletCompression_MPI_Async.h
+ *  MPCFcluster
+ *
+ *  Wavelet dumps overlapped with the time stepping. Write() copies the channels
+ *  into a snapshot and returns: a helper thread compresses the snapshot with a few
+ *  OpenMP threads while the solver runs with the others, then the files are written
+ *  with nonblocking collective MPI-IO. The helper never calls MPI, progress()
+ *  does it: all the ranks must call it once per step.
+ *  With aggregation (set_aggregation) the files are written by the blocking
+ *  aggregated path of the base class, only the compression is overlapped.
+ *
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <mpi.h>
+
+#include "SerializerIO_WaveletCompression_MPI_Simple.h"
+
+template<typename GridType, typename IterativeStreamer>
+class SerializerIO_WaveletCompression_MPI_Async : public SerializerIO_WaveletCompression_MPI_SimpleBlocking<GridType, IterativeStreamer>
+{
+	typedef SerializerIO_WaveletCompression_MPI_SimpleBlocking<GridType, IterativeStreamer> TBase;
+	typedef typename TBase::ChannelStream ChannelStream;
+
+	enum { NCHANNELS = TBase::NCHANNELS, NPTS = TBase::NPTS };
+
+	enum { IDLE, COMPRESSING, WRITING } state;
+
+	int asyncthreads, solverthreads;
+
+	//the dump in flight
+	MPI::Intracomm mycomm;
+	vector<BlockInfo> infos;
+	vector<int> channels;
+	vector<Real> thresholds;
+	vector<string> fileNames;
+	vector<Real> snapshot;
+
+	pthread_t helper;
+	volatile bool compressed;
+
+	//they stay alive until the writes complete
+	vector<MPI_File> files;
+	vector<MPI_Request> requests;
+	vector<size_t> displacements;
+
+	//tblocked: time spent by the caller in Write, progress and wait for this dump
+	double tstart, tsnapshot, tcompression, twritestart, tblocked;
+	int nsteps;
+
+	static void * _helper_main(void * ptr)
+	{
+		SerializerIO_WaveletCompression_MPI_Async& self = *(SerializerIO_WaveletCompression_MPI_Async *)ptr;
+
+		const double t0 = omp_get_wtime();
+
+		//only this thread is affected
+		omp_set_num_threads(self.asyncthreads);
+
+		self._compress_all(self.infos, self.infos.size(), self.channels, self.thresholds, &self.snapshot.front());
+
+		for(int k = 0; k < self.channels.size(); ++k)
+			self._finalize_stream(self.streams[k]);
+
+		self.tcompression = omp_get_wtime() - t0;
+
+		__sync_synchronize();
+		self.compressed = true;
+
+		return NULL;
+	}
+
+	//the requested channels of all the blocks, with all the threads
+	void _snapshot()
+	{
+		const int NBLOCKS = infos.size();
+		const int NSTREAMS = channels.size();
+
+		snapshot.resize((size_t)NBLOCKS * NSTREAMS * NPTS);
+
+#pragma omp parallel for
+		for(int i = 0; i < NBLOCKS; ++i)
+		{
+			Real * soa[NCHANNELS];
+			for(int c = 0; c < NCHANNELS; ++c)
+				soa[c] = NULL;
+
+			for(int k = 0; k < NSTREAMS; ++k)
+				soa[channels[k]] = &snapshot[NPTS * ((size_t)NSTREAMS * i + k)];
+
+			FluidBlock& b = *(FluidBlock*)infos[i].ptrBlock;
+
+			for(int iz=0; iz<FluidBlock::sizeZ; iz++)
+				for(int iy=0; iy<FluidBlock::sizeY; iy++)
+					for(int ix=0; ix<FluidBlock::sizeX; ix++)
+						WaveletChannelGather<IterativeStreamer, NCHANNELS - 1>::gather(b(ix, iy, iz), soa, ix + _BLOCKSIZE_ * (iy + _BLOCKSIZE_ * iz));
+		}
+	}
+
+	void _join()
+	{
+		pthread_join(helper, NULL);
+
+		omp_set_num_threads(solverthreads);
+	}
+
+	//same layout as TBase::_to_file, every write is nonblocking
+	void _issue_writes()
+	{
+		const int mygid = mycomm.Get_rank();
+		const int nranks = mycomm.Get_size();
+		const int NSTREAMS = channels.size();
+
+		files.clear();
+		displacements.assign(NSTREAMS, 0);
+		requests.clear();
+
+		twritestart = MPI::Wtime();
+
+		//-vpgroupsize, -vpsubfiles: blocking, there are no requests to wait for
+		if (this->aggregation_groupsize > 1 || this->aggregation_subfiles)
+		{
+			for(int k = 0; k < NSTREAMS; ++k)
+				this->_to_file_aggregated(mycomm, fileNames[k], this->streams[k]);
+
+			return;
+		}
+
+		files.resize(NSTREAMS);
+
+		for(int k = 0; k < NSTREAMS; ++k)
+		{
+			ChannelStream& stream = this->streams[k];
+			MPI_Request req;
+
+			MPI_File_open(mycomm, (char *)fileNames[k].c_str(), MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &files[k]);
+
+			//the mini-header
+			size_t current_displacement = sizeof(size_t) + this->binaryocean_title.size();
+
+			//the binary ocean
+			{
+				size_t myfileoffset = 0;
+				mycomm.Exscan(&stream.written_bytes, &myfileoffset, 1, MPI_UINT64_T, MPI::SUM);
+
+				if (mygid == 0)
+					myfileoffset = 0;
+
+				MPI_File_iwrite_at_all(files[k], current_displacement + myfileoffset, &stream.allmydata.front(), stream.written_bytes, MPI_CHAR, &req);
+				requests.push_back(req);
+
+				size_t total_written_bytes = myfileoffset + stream.written_bytes;
+				mycomm.Bcast(&total_written_bytes, 1, MPI_UINT64_T, nranks - 1);
+
+				current_displacement += total_written_bytes;
+			}
+
+			displacements[k] = current_displacement;
+
+			//the mini-header and the header
+			if (mygid == 0)
+			{
+				MPI_File_iwrite_at(files[k], 0, &displacements[k], sizeof(size_t), MPI_CHAR, &req);
+				requests.push_back(req);
+
+				MPI_File_iwrite_at(files[k], sizeof(size_t), (char *)this->binaryocean_title.c_str(), this->binaryocean_title.size(), MPI_CHAR, &req);
+				requests.push_back(req);
+
+				MPI_File_iwrite_at(files[k], current_displacement, (char *)stream.header.c_str(), stream.header.size(), MPI_CHAR, &req);
+				requests.push_back(req);
+			}
+
+			current_displacement += stream.header.size();
+
+			//block metadata
+			{
+				const int metadata_bytes = stream.myblockindices.size() * sizeof(BlockMetadata);
+
+				MPI_File_iwrite_at_all(files[k], current_displacement + mygid * metadata_bytes, &stream.myblockindices.front(), metadata_bytes, MPI_CHAR, &req);
+				requests.push_back(req);
+
+				current_displacement += metadata_bytes * nranks;
+			}
+
+			//the lut title and the local lut entries
+			{
+				const int title_bytes = this->binarylut_title.size();
+
+				if (mygid == 0)
+				{
+					MPI_File_iwrite_at(files[k], current_displacement, (char *)this->binarylut_title.c_str(), title_bytes, MPI_CHAR, &req);
+					requests.push_back(req);
+				}
+
+				current_displacement += title_bytes;
+
+				assert(stream.lut_compression.size() == 0);
+
+				const int lutheader_bytes = sizeof(stream.lutheader);
+
+				MPI_File_iwrite_at_all(files[k], current_displacement + mygid * lutheader_bytes, &stream.lutheader, lutheader_bytes, MPI_CHAR, &req);
+				requests.push_back(req);
+			}
+		}
+	}
+
+	size_t _held_bytes() const
+	{
+		size_t s = snapshot.capacity() * sizeof(Real);
+
+		for(int k = 0; k < channels.size(); ++k)
+			s += this->streams[k].allmydata.capacity() + this->streams[k].myblockindices.capacity() * sizeof(BlockMetadata);
+
+		return s;
+	}
+
+	void _complete()
+	{
+		for(int k = 0; k < files.size(); ++k)
+			MPI_File_close(&files[k]);
+
+		files.clear();
+		requests.clear();
+
+		const double tnow = MPI::Wtime();
+
+		if (this->verbosity)
+		{
+			for(int k = 0; k < channels.size(); ++k)
+				this->_report_stream(channels[k], thresholds[k], this->streams[k], infos.size(), mycomm);
+
+			vector<float> workload_file(1, tnow - twritestart);
+			this->_report_timings(workload_file, mycomm);
+
+			//overlap: the fraction of the lifetime of the dump during which the caller was free
+			double tmax[3] = { tblocked, tsnapshot, tcompression };
+			size_t heldbytes = _held_bytes();
+
+			mycomm.Reduce(mycomm.Get_rank() ? tmax : MPI::IN_PLACE, tmax, 3, MPI::DOUBLE, MPI::MAX, 0);
+			mycomm.Reduce(mycomm.Get_rank() ? &heldbytes : MPI::IN_PLACE, &heldbytes, 1, MPI_UINT64_T, MPI::MAX, 0);
+
+			if (mycomm.Get_rank() == 0)
+			{
+				const double tinflight = tnow - tstart;
+
+				printf("Async dump: in flight %.3f s over %d steps, blocked %.3f s (snapshot %.3f s), overlap %.0f%%\n",
+					   tinflight, nsteps, tmax[0], tmax[1], (1 - tmax[0] / tinflight) * 100);
+				printf("Async dump: compression %.3f s on %d threads, solver on %d threads, held %.2f MB per rank\n",
+					   tmax[2], asyncthreads, max(1, solverthreads - asyncthreads), heldbytes / 1024. / 1024.);
+			}
+		}
+
+		state = IDLE;
+	}
+
+public:
+
+	SerializerIO_WaveletCompression_MPI_Async(): TBase(),
+	state(IDLE), asyncthreads(max(1, omp_get_max_threads() / 4)), solverthreads(omp_get_max_threads()), compressed(false),
+	tstart(0), tsnapshot(0), tcompression(0), twritestart(0), tblocked(0), nsteps(0)
+	{
+	}
+
+	//the cores taken from the solver while a dump is compressed
+	void set_threads(const int nthreads) { asyncthreads = max(1, nthreads); }
+
+	bool busy() const { return state != IDLE; }
+
+	//starts the dump of the given channels and returns, the previous dump is completed first
+	void Write(GridType & inputGrid, string fileName, const vector<int>& channels, const vector<Real>& thresholds, IterativeStreamer streamer = IterativeStreamer())
+	{
+		wait();
+
+		const double t0 = MPI::Wtime();
+
+		const int NSTREAMS = channels.size();
+
+		assert(thresholds.size() == channels.size());
+
+		for(int k = 0; k < NSTREAMS; ++k)
+			assert(channels[k] >= 0 && channels[k] < NCHANNELS);
+
+		this->mycomm = inputGrid.getCartComm();
+		this->infos = inputGrid.getBlocksInfo();
+		this->channels = channels;
+		this->thresholds = thresholds;
+
+		fileNames.resize(NSTREAMS);
+
+		for(int k = 0; k < NSTREAMS; ++k)
+		{
+			std::stringstream ss;
+			ss << fileName << "." << streamer.name() << ".channel"  << channels[k];
+
+			fileNames[k] = ss.str();
+		}
+
+		if (this->streams.size() < NSTREAMS)
+			this->streams.resize(NSTREAMS);
+
+		for(int k = 0; k < NSTREAMS; ++k)
+		{
+			this->streams[k].header = this->_prepare_header(inputGrid, thresholds[k]);
+			this->_reset_stream(this->streams[k], infos.size());
+		}
+
+		this->_prepare_encoder();
+
+		_snapshot();
+
+		//from now on the grid can change
+		solverthreads = omp_get_max_threads();
+		asyncthreads = min(asyncthreads, solverthreads);
+
+		compressed = false;
+		state = COMPRESSING;
+		nsteps = 0;
+
+		const int retval = pthread_create(&helper, NULL, _helper_main, this);
+		assert(retval == 0);
+
+		omp_set_num_threads(max(1, solverthreads - asyncthreads));
+
+		tstart = t0;
+		tsnapshot = tblocked = MPI::Wtime() - t0;
+	}
+
+	//collective, once per step: starts the writes when every rank is done
+	//compressing, closes the files when every write is complete
+	void progress()
+	{
+		if (state == IDLE) return;
+
+		const double t0 = MPI::Wtime();
+
+		++nsteps;
+
+		int done = 0;
+
+		if (state == COMPRESSING)
+		{
+			done = compressed;
+			mycomm.Allreduce(MPI::IN_PLACE, &done, 1, MPI::INT, MPI::LAND);
+
+			if (done)
+			{
+				_join();
+				_issue_writes();
+				state = WRITING;
+			}
+
+			tblocked += MPI::Wtime() - t0;
+		}
+		else
+		{
+			done = requests.empty();
+
+			if (!done)
+				MPI_Testall(requests.size(), &requests.front(), &done, MPI_STATUSES_IGNORE);
+
+			mycomm.Allreduce(MPI::IN_PLACE, &done, 1, MPI::INT, MPI::LAND);
+
+			tblocked += MPI::Wtime() - t0;
+
+			if (done)
+				_complete();
+		}
+	}
+
+	//collective: blocks until the dump in flight, if any, is on disk
+	void wait()
+	{
+		if (state == IDLE) return;
+
+		const double t0 = MPI::Wtime();
+
+		if (state == COMPRESSING)
+		{
+			_join();
+			_issue_writes();
+			state = WRITING;
+		}
+
+		if (!requests.empty())
+			MPI_Waitall(requests.size(), &requests.front(), MPI_STATUSES_IGNORE);
+
+		tblocked += MPI::Wtime() - t0;
+
+		_complete();
+	}
+
+	~SerializerIO_WaveletCompression_MPI_Async()
+	{
+		//no MPI here, wait() must have been called before
+		if (state == COMPRESSING)
+			_join();
+	}
+};
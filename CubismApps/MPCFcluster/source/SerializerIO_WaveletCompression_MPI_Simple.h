@@ -12,6 +12,8 @@
 #include <typeinfo>
 #include <sstream>
 #include <numeric>
+#include <limits>
+#include <iomanip>
 #include <omp.h>
 
 using namespace std;
@@ -22,6 +24,26 @@ using namespace std;
 
 #include "CompressionEncoders.h"
 
+//gathers the requested channels of one grid point in a single pass,
+//soa[c] is NULL for the channels that are not requested
+template<typename IterativeStreamer, int channel>
+struct WaveletChannelGather
+{
+	static inline void gather(const FluidElement& e, Real * const soa[], const int idx)
+	{
+		WaveletChannelGather<IterativeStreamer, channel - 1>::gather(e, soa, idx);
+		
+		if (soa[channel])
+			soa[channel][idx] = IterativeStreamer::template operate<channel>(e);
+	}
+};
+
+template<typename IterativeStreamer>
+struct WaveletChannelGather<IterativeStreamer, -1>
+{
+	static inline void gather(const FluidElement& e, Real * const soa[], const int idx) { }
+};
+
 template<typename GridType, typename IterativeStreamer>
 class SerializerIO_WaveletCompression_MPI_SimpleBlocking
 {
@@ -47,28 +69,85 @@ protected:
 	{
 	  BlockMetadata hotblocks[ENTRIES];
 	  unsigned char compressedbuffer[BUFFERSIZE];
+	  WaveletsOnInterval::FwtAp original[NPTS]; //input of compress_bounded
 	};
 
 	struct TimingInfo { float total, fwt, encoding; };
 	
-	string binaryocean_title, binarylut_title, header;
+	//per-thread accumulators of the error-bounded mode, errors are relative to the block range.
+	//missed: blocks over the bound even at full precision
+	struct ErrorInfo { float maxerror; double sumerror, sumthreshold; int missed; };
 	
-	vector< BlockMetadata > myblockindices; //tells in which compressed chunk is any block, nblocks
-	HeaderLUT lutheader;
-	vector< size_t > lut_compression; //tells the number of compressed chunk, and where do they start, nchunks + 2
-	vector< unsigned char > allmydata; //buffer with the compressed data
-	size_t written_bytes, pending_writes, completed_writes;
+	//everything that ends up in one output file (one per channel)
+	struct ChannelStream
+	{
+		string header;
+		
+		vector< BlockMetadata > myblockindices; //tells in which compressed chunk is any block, nblocks
+		HeaderLUT lutheader;
+		vector< size_t > lut_compression; //tells the number of compressed chunk, and where do they start, nchunks + 2
+		vector< unsigned char > allmydata; //buffer with the compressed data
+		size_t written_bytes, pending_writes, completed_writes;
+		
+		vector<CompressionBuffer> workbuffer; //per-thread compression buffer
+		vector<ErrorInfo> errorinfo; //per-thread error statistics
+		
+		ChannelStream(): written_bytes(0), pending_writes(0), completed_writes(0) { }
+	};
+	
+	string binaryocean_title, binarylut_title, binarysubfiles_title;
+	
+	vector< ChannelStream > streams; //streams[0] serves the single-channel path
 	
 	Real threshold;
 	bool halffloat, verbosity;
+	int encoder, encoder_level;
+	
+	//ERRORBOUND_NONE: the thresholds are absolute, 
+	//otherwise they are tolerances relative to the block range of the channel
+	enum { ERRORBOUND_NONE, ERRORBOUND_LINF, ERRORBOUND_L2 };
+	int errorbound;
+	
+	//aggregation: groups of consecutive ranks send their streams to the first rank of the group,
+	//only these ranks write. with subfiles each group writes its own file, see _to_file_aggregated.
+	//the communicators of the groups and of the aggregators are created by set_aggregation
+	int aggregation_groupsize;
+	bool aggregation_subfiles;
+	MPI_Comm aggregation_parent;
+	MPI::Intracomm aggregation_groupcomm, aggregation_aggrcomm;
+	
+	//MPI counts are int: larger buffers go in pieces of at most this many bytes
+	enum { AGGREGATION_MAXMSG = 1 << 30 };
+	
+	//collective write of any size: all the ranks of the file make the same number of calls
+	static void _write_at_all_chunked(const MPI::Intracomm& comm, MPI::File& file, const size_t offset, const unsigned char * const buf, const size_t bytes)
+	{
+		const size_t mypieces = (bytes + AGGREGATION_MAXMSG - 1) / AGGREGATION_MAXMSG;
+		size_t npieces = 0;
+		comm.Allreduce(&mypieces, &npieces, 1, MPI_UINT64_T, MPI::MAX);
+		
+		for(size_t p = 0; p < npieces; ++p)
+		{
+			const size_t start = min(bytes, p * AGGREGATION_MAXMSG);
+			const int count = min(bytes - start, (size_t)AGGREGATION_MAXMSG);
+			
+			file.Write_at_all(offset + start, buf + start, count, MPI_CHAR);
+		}
+	}
+	
+	static void _write_at_chunked(MPI::File& file, const size_t offset, const unsigned char * const buf, const size_t bytes)
+	{
+		for(size_t start = 0; start < bytes; start += AGGREGATION_MAXMSG)
+			file.Write_at(offset + start, buf + start, min(bytes - start, (size_t)AGGREGATION_MAXMSG), MPI_CHAR);
+	}
 	
 	vector< float > workload_total, workload_fwt, workload_encode; //per-thread cpu time for imbalance insight for fwt and encoding
-	vector<CompressionBuffer> workbuffer; //per-thread compression buffer
+	vector< vector<unsigned char> > encoding_scratch; //per-thread output of the encoders that do not work in-place
 	
-	float _encode_and_flush(unsigned char inputbuffer[], int& bufsize, const int maxsize, BlockMetadata metablocks[], int& nblocks)
+	float _encode_and_flush(ChannelStream& stream, unsigned char inputbuffer[], int& bufsize, const int maxsize, BlockMetadata metablocks[], int& nblocks)
 	{
 		//0. setup
-		//1. compress the data with zlib, obtain zptr, zbytes
+		//1. compress the data with the chosen encoder, obtain zptr, zbytes
 		//2. obtain an offset from allmydata -> dstoffset
 		//3. obtain a new entry in lut_compression -> idcompression
 		//4. copy the [zptr,zptr+zbytes] into in allmydata, starting from dstoffset
@@ -76,63 +155,57 @@ protected:
 		//6. set nblocks to zero	
 		
 		Timer timer; timer.start();
-		const unsigned char * const zptr = inputbuffer;
+		const unsigned char * zptr = inputbuffer;
 		size_t zbytes = bufsize;
 		int dstoffset = -1;
 		int idcompression = -1;
 		
 		//1.
 		{
-			z_stream myzstream = {0};
-			deflateInit(&myzstream, Z_DEFAULT_COMPRESSION);
+			vector<unsigned char>& myscratch = encoding_scratch[omp_get_thread_num()];
 			
-			unsigned mah = maxsize;	
-			int err = deflate_inplace(&myzstream, inputbuffer, bufsize, &mah);
-			
-			assert(err == Z_OK);
-			
-			zbytes = myzstream.total_out;
+			zptr = encode(encoder, encoder_level, inputbuffer, bufsize, maxsize, myscratch.size() ? &myscratch.front() : NULL, zbytes);
 		}
 		
 		//2-3.
 #pragma omp critical
 		{
-			dstoffset = written_bytes;
-			written_bytes += zbytes;
+			dstoffset = stream.written_bytes;
+			stream.written_bytes += zbytes;
 			
 			//exception: we have to resize allmydata
-			if (written_bytes > allmydata.size())
+			if (stream.written_bytes > stream.allmydata.size())
 			{
 				//spin-wait until writes complete
 #pragma omp taskyield
-				while (pending_writes != completed_writes);
+				while (stream.pending_writes != stream.completed_writes);
 				
 				//safely resize
-				allmydata.resize(written_bytes);
+				stream.allmydata.resize(stream.written_bytes);
 			}
 			
-			idcompression = lut_compression.size();
-			lut_compression.push_back(dstoffset);
+			idcompression = stream.lut_compression.size();
+			stream.lut_compression.push_back(dstoffset);
 			
-			++pending_writes;
+			++stream.pending_writes;
 		}
 		
 		//4.
-		assert(allmydata.size() >= written_bytes);
-		memcpy(&allmydata.front() + dstoffset, zptr, zbytes);
+		assert(stream.allmydata.size() >= stream.written_bytes);
+		memcpy(&stream.allmydata.front() + dstoffset, zptr, zbytes);
 		
 #pragma omp atomic
-		++completed_writes;
+		++stream.completed_writes;
 		
 		//5.
 		for(int i = 0; i < nblocks; ++i)
 		{
 			const int entry = metablocks[i].idcompression;
-			assert(entry >= 0 && entry < myblockindices.size());
+			assert(entry >= 0 && entry < stream.myblockindices.size());
 			
-			myblockindices[entry] = metablocks[i];
-			myblockindices[entry].idcompression = idcompression;
-			myblockindices[entry].subid = i;
+			stream.myblockindices[entry] = metablocks[i];
+			stream.myblockindices[entry].idcompression = idcompression;
+			stream.myblockindices[entry].subid = i;
 		}
 		
 		//6.
@@ -142,14 +215,32 @@ protected:
 		return timer.stop();
 	}
 	
+	//wavelet digestion of one block
+	int _digest(WaveletCompressor& compressor, const Real mythreshold, const Real range, CompressionBuffer& mybuf, ErrorInfo& info)
+	{
+		if (errorbound == ERRORBOUND_NONE)
+			return compressor.compress(mythreshold, this->halffloat);
+		
+		float eps = 0, error = 0;
+		const int nbytes = compressor.compress_bounded(mythreshold * range, errorbound == ERRORBOUND_L2, this->halffloat, mybuf.original, eps, error);
+		
+		const float relerror = range > 0 ? error / range : 0;
+		info.maxerror = max(info.maxerror, relerror);
+		info.sumerror += relerror;
+		info.sumthreshold += eps;
+		info.missed += error > mythreshold * range;
+		
+		return nbytes;
+	}
+	
 	template<int channel>
-	void _compress(const vector<BlockInfo>& vInfo, const int NBLOCKS, IterativeStreamer streamer)
+	void _compress(const vector<BlockInfo>& vInfo, const int NBLOCKS, IterativeStreamer streamer, ChannelStream& stream)
 	{
 #pragma omp parallel  
 		{			
 		  const int tid = omp_get_thread_num();
 
-		  CompressionBuffer & mybuf = workbuffer[tid];
+		  CompressionBuffer & mybuf = stream.workbuffer[tid];
 
 			int mybytes = 0, myhotblocks = 0;
 			
@@ -175,8 +266,16 @@ protected:
 							for(int ix=0; ix<FluidBlock::sizeX; ix++)
 								mysoabuffer[ix + _BLOCKSIZE_ * (iy + _BLOCKSIZE_ * iz)] = streamer.template operate<channel>(b(ix, iy, iz));
 					
+					Real minval[NCHANNELS], maxval[NCHANNELS];
+					if (errorbound != ERRORBOUND_NONE)
+					{
+						assert(channel < NCHANNELS);
+						b.minmax(minval, maxval, streamer);
+					}
+					
 					//wavelet digestion
-					const int nbytes = (int)compressor.compress(this->threshold, this->halffloat);
+					const int nbytes = _digest(compressor, this->threshold, 
+											   errorbound != ERRORBOUND_NONE ? maxval[channel] - minval[channel] : 0, mybuf, stream.errorinfo[tid]);
 					memcpy(mybuf.compressedbuffer + mybytes, &nbytes, sizeof(nbytes));
 					mybytes += sizeof(nbytes);
 					
@@ -194,20 +293,301 @@ protected:
 				}
 				
 				if (mybytes >= ALERT || myhotblocks >= ENTRIES)
-					tencode = _encode_and_flush(mybuf.compressedbuffer, mybytes, BUFFERSIZE, mybuf.hotblocks, myhotblocks);
+					tencode = _encode_and_flush(stream, mybuf.compressedbuffer, mybytes, BUFFERSIZE, mybuf.hotblocks, myhotblocks);
 			}
 			
 			if (mybytes > 0)
-				tencode = _encode_and_flush(mybuf.compressedbuffer, mybytes, BUFFERSIZE, mybuf. hotblocks, myhotblocks);
+				tencode = _encode_and_flush(stream, mybuf.compressedbuffer, mybytes, BUFFERSIZE, mybuf. hotblocks, myhotblocks);
 			
 			workload_total[tid] = timer.stop();
 			workload_fwt[tid] = tfwt;
 			workload_encode[tid] = tencode;
 		}
 	}
+
+	//single sweep over the blocks: each block is read once and
+	//all the requested channels are wavelet-compressed from it,
+	//streams[k] collects the output of channels[k].
+	//with a snapshot the blocks are not touched: channel k of block i
+	//is read from snapshot[NPTS * (NSTREAMS * i + k)]
+	void _compress_all(const vector<BlockInfo>& vInfo, const int NBLOCKS, const vector<int>& channels, const vector<Real>& thresholds,
+					   const Real * const snapshot = NULL)
+	{
+		const int NSTREAMS = channels.size();
+
+#pragma omp parallel
+		{
+			const int tid = omp_get_thread_num();
+
+			vector<WaveletCompressor> compressors(NSTREAMS);
+			vector<int> mybytes(NSTREAMS, 0), myhotblocks(NSTREAMS, 0);
+
+			Real * soa[NCHANNELS];
+			for(int c = 0; c < NCHANNELS; ++c)
+				soa[c] = NULL;
+
+			for(int k = 0; k < NSTREAMS; ++k)
+				soa[channels[k]] = &compressors[k].uncompressed_data()[0][0][0];
+
+			float tfwt = 0, tencode = 0;
+			Timer timer;
+			timer.start();
+
+			Real minval[NCHANNELS], maxval[NCHANNELS];
+			for(int c = 0; c < NCHANNELS; ++c)
+				minval[c] = maxval[c] = 0;
+
+#pragma omp for
+			for(int i = 0; i < NBLOCKS; ++i)
+			{
+				Timer tw; tw.start();
+
+				//one pass over the block for all the channels
+				if (snapshot)
+				{
+					for(int k = 0; k < NSTREAMS; ++k)
+					{
+						const Real * const src = snapshot + NPTS * ((size_t)NSTREAMS * i + k);
+						
+						memcpy(soa[channels[k]], src, sizeof(Real) * NPTS);
+					}
+				}
+				else
+				{
+					FluidBlock& b = *(FluidBlock*)vInfo[i].ptrBlock;
+
+					for(int iz=0; iz<FluidBlock::sizeZ; iz++)
+						for(int iy=0; iy<FluidBlock::sizeY; iy++)
+							for(int ix=0; ix<FluidBlock::sizeX; ix++)
+								WaveletChannelGather<IterativeStreamer, NCHANNELS - 1>::gather(b(ix, iy, iz), soa, ix + _BLOCKSIZE_ * (iy + _BLOCKSIZE_ * iz));
+				}
+
+				//the range of the gathered channels only
+				if (errorbound != ERRORBOUND_NONE)
+					for(int k = 0; k < NSTREAMS; ++k)
+					{
+						const Real * const src = soa[channels[k]];
+
+						minval[channels[k]] = *std::min_element(src, src + NPTS);
+						maxval[channels[k]] = *std::max_element(src, src + NPTS);
+					}
+
+				//wavelet digestion, timed with the gather
+				for(int k = 0; k < NSTREAMS; ++k)
+				{
+					CompressionBuffer & mybuf = streams[k].workbuffer[tid];
+
+					const int nbytes = _digest(compressors[k], thresholds[k], maxval[channels[k]] - minval[channels[k]], mybuf, streams[k].errorinfo[tid]);
+					memcpy(mybuf.compressedbuffer + mybytes[k], &nbytes, sizeof(nbytes));
+					mybytes[k] += sizeof(nbytes);
+
+					memcpy(mybuf.compressedbuffer + mybytes[k], compressors[k].compressed_data(), sizeof(unsigned char) * nbytes);
+					mybytes[k] += nbytes;
+				}
+
+				tfwt += tw.stop();
+
+				for(int k = 0; k < NSTREAMS; ++k)
+				{
+					CompressionBuffer & mybuf = streams[k].workbuffer[tid];
+
+					//building the meta data
+					{
+						BlockMetadata curr = { i, myhotblocks[k], vInfo[i].index[0], vInfo[i].index[1], vInfo[i].index[2]};
+						mybuf.hotblocks[myhotblocks[k]] = curr;
+						myhotblocks[k]++;
+					}
+
+					if (mybytes[k] >= ALERT || myhotblocks[k] >= ENTRIES)
+						tencode += _encode_and_flush(streams[k], mybuf.compressedbuffer, mybytes[k], BUFFERSIZE, mybuf.hotblocks, myhotblocks[k]);
+				}
+			}
+
+			for(int k = 0; k < NSTREAMS; ++k)
+				if (mybytes[k] > 0)
+				{
+					CompressionBuffer & mybuf = streams[k].workbuffer[tid];
+
+					tencode += _encode_and_flush(streams[k], mybuf.compressedbuffer, mybytes[k], BUFFERSIZE, mybuf.hotblocks, myhotblocks[k]);
+				}
+
+			workload_total[tid] = timer.stop();
+			workload_fwt[tid] = tfwt;
+			workload_encode[tid] = tencode;
+		}
+	}
+
+	
+	//the same file as _to_file, but only one rank per group touches the file system.
+	//with subfiles the binary ocean of group g goes to fileName.sub<g>, and fileName keeps
+	//the size of every subfile in place of the ocean: see WaveletSubfiles_Assemble in the reader
+	void _to_file_aggregated(const MPI::Intracomm& mycomm, const string fileName, ChannelStream& stream)
+	{
+		const int mygid = mycomm.Get_rank();
+		const int nranks = mycomm.Get_size();
+		
+		if (aggregation_parent != (MPI_Comm)mycomm)
+		{
+			printf("SerializerIO_WaveletCompression: set_aggregation was called with another communicator than the one of the grid. ABORTING NOW.\n");
+			abort();
+		}
+		
+		MPI::Intracomm& groupcomm = aggregation_groupcomm;
+		MPI::Intracomm& aggrcomm = aggregation_aggrcomm;
+		
+		const bool isaggregator = groupcomm.Get_rank() == 0;
+		const int nmembers = groupcomm.Get_size();
+		const int groupsize = max(1, min(aggregation_groupsize, nranks));
+		const int mygroup = mygid / groupsize;
+		const int ngroups = (nranks + groupsize - 1) / groupsize;
+		
+		const size_t metadata_bytes_total = stream.myblockindices.size() * sizeof(BlockMetadata);
+		
+		if (metadata_bytes_total * nmembers > numeric_limits<int>::max())
+		{
+			printf("SerializerIO_WaveletCompression: the block metadata of a group exceeds 2 GB (%d ranks of %d blocks), use a smaller -vpgroupsize. ABORTING NOW.\n",
+				   nmembers, (int)stream.myblockindices.size());
+			abort();
+		}
+		
+		const int metadata_bytes = metadata_bytes_total;
+		const int lutheader_bytes = sizeof(stream.lutheader);
+		
+		assert(stream.lut_compression.size() == 0);
+		
+		//1. the streams of the group at the aggregator: the sizes are size_t, 
+		//the data goes in messages of at most AGGREGATION_MAXMSG bytes
+		vector<size_t> counts(nmembers), displs(nmembers);
+		vector<unsigned char> ocean, metadata, lutheaders;
+		size_t groupbytes = 0;
+		
+		{
+			const size_t mybytes = stream.written_bytes;
+			groupcomm.Gather(&mybytes, 1, MPI_UINT64_T, &counts.front(), 1, MPI_UINT64_T, 0);
+			
+			if (isaggregator)
+			{
+				for(int r = 0; r < nmembers; ++r)
+				{
+					displs[r] = groupbytes;
+					groupbytes += counts[r];
+				}
+				
+				ocean.resize(max((size_t)1, groupbytes));
+				metadata.resize((size_t)nmembers * metadata_bytes);
+				lutheaders.resize((size_t)nmembers * lutheader_bytes);
+				
+				memcpy(&ocean.front(), &stream.allmydata.front(), mybytes);
+				
+				vector<MPI::Request> requests;
+				
+				for(int r = 1; r < nmembers; ++r)
+					for(size_t start = 0; start < counts[r]; start += AGGREGATION_MAXMSG)
+						requests.push_back(groupcomm.Irecv(&ocean[displs[r] + start], min(counts[r] - start, (size_t)AGGREGATION_MAXMSG), MPI::CHAR, r, 0));
+				
+				if (requests.size())
+					MPI::Request::Waitall(requests.size(), &requests.front());
+			}
+			else
+				for(size_t start = 0; start < mybytes; start += AGGREGATION_MAXMSG)
+					groupcomm.Send(&stream.allmydata[start], min(mybytes - start, (size_t)AGGREGATION_MAXMSG), MPI::CHAR, 0, 0);
+			
+			groupcomm.Gather(&stream.myblockindices.front(), metadata_bytes, MPI::CHAR, isaggregator ? &metadata.front() : NULL, metadata_bytes, MPI::CHAR, 0);
+			groupcomm.Gather(&stream.lutheader, lutheader_bytes, MPI::CHAR, isaggregator ? &lutheaders.front() : NULL, lutheader_bytes, MPI::CHAR, 0);
+		}
+		
+		//2. large contiguous writes from the aggregators
+		if (isaggregator)
+		{
+			const int myaggr = aggrcomm.Get_rank();
+			
+			assert(myaggr == mygroup && aggrcomm.Get_size() == ngroups);
+			
+			const size_t miniheader_bytes = sizeof(size_t) + binaryocean_title.size();
+			
+			size_t myfileoffset = 0;
+			aggrcomm.Exscan(&groupbytes, &myfileoffset, 1, MPI_UINT64_T, MPI::SUM);
+			
+			if (myaggr == 0)
+				myfileoffset = 0;
+			
+			size_t total_written_bytes = myfileoffset + groupbytes;
+			aggrcomm.Bcast(&total_written_bytes, 1, MPI_UINT64_T, ngroups - 1);
+			
+			MPI::Info myfileinfo = MPI::Info::Create();
+			myfileinfo.Set("access_syle", "write_once");
+			
+			MPI::File myfile = MPI::File::Open(aggrcomm, fileName.c_str(),  MPI::MODE_WRONLY | MPI::MODE_CREATE, myfileinfo);
+			myfile.Set_size(0);
+			
+			//where the header would be in the assembled file
+			const size_t header_displacement = miniheader_bytes + total_written_bytes;
+			size_t current_displacement = miniheader_bytes;
+			
+			if (aggregation_subfiles)
+			{
+				std::stringstream ss;
+				ss << fileName << ".sub" << setfill('0') << setw(5) << mygroup;
+				
+				MPI::File mysubfile = MPI::File::Open(MPI::COMM_SELF, ss.str().c_str(),  MPI::MODE_WRONLY | MPI::MODE_CREATE, myfileinfo);
+				mysubfile.Set_size(0);
+				_write_at_chunked(mysubfile, 0, &ocean.front(), groupbytes);
+				mysubfile.Close();
+				
+				//the sizes of the subfiles take the place of the ocean
+				const size_t table_bytes = binarysubfiles_title.size() + sizeof(int) + sizeof(size_t) * ngroups;
+				
+				if (myaggr == 0)
+				{
+					myfile.Write_at(current_displacement, binarysubfiles_title.c_str(), binarysubfiles_title.size(), MPI_CHAR);
+					myfile.Write_at(current_displacement + binarysubfiles_title.size(), &ngroups, sizeof(int), MPI_CHAR);
+				}
+				
+				myfile.Write_at_all(current_displacement + binarysubfiles_title.size() + sizeof(int) + sizeof(size_t) * myaggr, &groupbytes, sizeof(size_t), MPI_CHAR);
+				
+				current_displacement += table_bytes;
+			}
+			else
+			{
+				_write_at_all_chunked(aggrcomm, myfile, current_displacement + myfileoffset, &ocean.front(), groupbytes);
+				
+				current_displacement += total_written_bytes;
+			}
+			
+			//the mini-header, the header
+			if (myaggr == 0)
+			{
+				myfile.Write_at(0, &header_displacement, sizeof(header_displacement), MPI_CHAR);
+				myfile.Write_at(sizeof(header_displacement), binaryocean_title.c_str(), binaryocean_title.size(), MPI_CHAR);
+				myfile.Write_at(current_displacement, stream.header.c_str(), stream.header.size(), MPI_CHAR);
+			}
+			
+			current_displacement += stream.header.size();
+			
+			//block metadata, the ranks of a group are consecutive
+			myfile.Write_at_all(current_displacement + (size_t)mygid * metadata_bytes, &metadata.front(), metadata.size(), MPI_CHAR);
+			current_displacement += (size_t)metadata_bytes * nranks;
+			
+			//lut title and lut headers
+			if (myaggr == 0)
+				myfile.Write_at(current_displacement, binarylut_title.c_str(), binarylut_title.size(), MPI_CHAR);
+			
+			current_displacement += binarylut_title.size();
+			
+			myfile.Write_at_all(current_displacement + (size_t)mygid * lutheader_bytes, &lutheaders.front(), lutheaders.size(), MPI_CHAR);
+			
+			myfile.Close();
+		}
+	}
 	
-	virtual void _to_file(const MPI::Intracomm& mycomm, const string fileName)
+	virtual void _to_file(const MPI::Intracomm& mycomm, const string fileName, ChannelStream& stream)
 	{
+		if (aggregation_groupsize > 1 || aggregation_subfiles)
+		{
+			_to_file_aggregated(mycomm, fileName, stream);
+			return;
+		}
+		
 		const int mygid = mycomm.Get_rank();
 		const int nranks = mycomm.Get_size();
 		
@@ -237,15 +617,15 @@ protected:
 			// so here we do it manually. so nice!
 			
 			size_t myfileoffset = 0;
-			mycomm.Exscan(&written_bytes, &myfileoffset, 1, MPI_UINT64_T, MPI::SUM);
+			mycomm.Exscan(&stream.written_bytes, &myfileoffset, 1, MPI_UINT64_T, MPI::SUM);
 			
 			if (mygid == 0)
 				myfileoffset = 0;
 			
-			myfile.Write_at_all(current_displacement + myfileoffset, &allmydata.front(), written_bytes, MPI_CHAR);
+			myfile.Write_at_all(current_displacement + myfileoffset, &stream.allmydata.front(), stream.written_bytes, MPI_CHAR);
 			
 			//here we update current_displacement by broadcasting the total written bytes from rankid = nranks -1
-			size_t total_written_bytes = myfileoffset + written_bytes;
+			size_t total_written_bytes = myfileoffset + stream.written_bytes;
 			mycomm.Bcast(&total_written_bytes, 1, MPI_UINT64_T, nranks - 1);
 			
 			current_displacement += total_written_bytes;
@@ -260,19 +640,19 @@ protected:
 		
 		//write the header
 		{
-			const size_t header_bytes = header.size();
+			const size_t header_bytes = stream.header.size();
 			
 			if (mygid == 0)
-				myfile.Write_at(current_displacement, header.c_str(), header_bytes, MPI_CHAR);
+				myfile.Write_at(current_displacement, stream.header.c_str(), header_bytes, MPI_CHAR);
 			
 			current_displacement += header_bytes;			
 		}
 		
 		//write block metadata
 		{
-			const int metadata_bytes = myblockindices.size() * sizeof(BlockMetadata);
+			const int metadata_bytes = stream.myblockindices.size() * sizeof(BlockMetadata);
 			
-			myfile.Write_at_all(current_displacement + mygid * metadata_bytes, &myblockindices.front(), metadata_bytes, MPI_CHAR);
+			myfile.Write_at_all(current_displacement + mygid * metadata_bytes, &stream.myblockindices.front(), metadata_bytes, MPI_CHAR);
 			
 			current_displacement += metadata_bytes * nranks;			
 		}
@@ -289,11 +669,11 @@ protected:
 		
 		//write the local buffer entries 
 		{			
-			assert(lut_compression.size() == 0);
+			assert(stream.lut_compression.size() == 0);
 			
-			const int lutheader_bytes = sizeof(lutheader);
+			const int lutheader_bytes = sizeof(stream.lutheader);
 			
-			myfile.Write_at_all(current_displacement + mygid * lutheader_bytes, &lutheader, lutheader_bytes, MPI_CHAR);
+			myfile.Write_at_all(current_displacement + mygid * lutheader_bytes, &stream.lutheader, lutheader_bytes, MPI_CHAR);
 		}
 		
 		myfile.Close(); //bon voila tu vois ou quoi
@@ -318,135 +698,381 @@ protected:
 		return tsum;
 	}
 	
+	string _prepare_header(GridType & inputGrid, const Real mythreshold)
+	{
+		this->binaryocean_title = "\n==============START-BINARY-OCEAN==============\n";
+		this->binarylut_title = "\n==============START-BINARY-LUT==============\n";
+		this->binarysubfiles_title = "\n==============START-BINARY-SUBFILES==============\n";
+
+		const int xtotalbpd = inputGrid.getBlocksPerDimension(0);
+		const int ytotalbpd = inputGrid.getBlocksPerDimension(1);
+		const int ztotalbpd = inputGrid.getBlocksPerDimension(2);
+
+		const int xbpd = inputGrid.getResidentBlocksPerDimension(0);
+		const int ybpd = inputGrid.getResidentBlocksPerDimension(1);
+		const int zbpd = inputGrid.getResidentBlocksPerDimension(2);
+
+		const double xExtent = inputGrid.getH()*xtotalbpd*_BLOCKSIZE_;
+		const double yExtent = inputGrid.getH()*ytotalbpd*_BLOCKSIZE_;
+		const double zExtent = inputGrid.getH()*ztotalbpd*_BLOCKSIZE_;
+
+		std::stringstream ss;
+
+		ss << "\n==============START-ASCI-HEADER==============\n";
+
+		{
+			int one = 1;
+			bool isone = *(char *)(&one);
+
+			ss << "Endianess: " << (isone ? "little" : "big") << "\n";
+		}
+
+		ss << "sizeofReal: " << sizeof(Real) << "\n";
+		ss << "sizeofsize_t: " << sizeof(size_t) << "\n";
+		ss << "sizeofBlockMetadata: " << sizeof(BlockMetadata) << "\n";
+		ss << "sizeofHeaderLUT: " << sizeof(HeaderLUT) << "\n";
+		ss << "sizeofCompressedBlock: " << sizeof(CompressedBlock) << "\n";
+		ss << "Blocksize: " << _BLOCKSIZE_ << "\n";
+		ss << "Blocks: " << xtotalbpd << " x "  << ytotalbpd << " x " << ztotalbpd  << "\n";
+		ss << "Extent: " << xExtent << " " << yExtent << " " << zExtent << "\n";
+		ss << "SubdomainBlocks: " << xbpd << " x "  << ybpd << " x " << zbpd  << "\n";
+		ss << "HalfFloat: " << (this->halffloat ? "yes" : "no") << "\n";
+		ss << "Wavelets: " << WaveletsOnInterval::ChosenWavelets_GetName() << "\n";
+		ss << "WaveletThreshold: " << mythreshold << "\n";
+		ss << "Encoder: " << encoder_name(encoder) << "\n";
+		ss << "==============START-BINARY-METABLOCKS==============\n";
+
+		return ss.str();
+	}
+
+	void _reset_stream(ChannelStream& stream, const int NBLOCKS)
+	{
+		stream.written_bytes = stream.pending_writes = stream.completed_writes = 0;
+
+		if (stream.allmydata.size() == 0)
+		{
+			const size_t speculated_compression_rate = 10;
+			stream.allmydata.resize(NBLOCKS * sizeof(Real) * NPTS);
+		}
+
+		stream.myblockindices.clear();
+		stream.myblockindices.resize(NBLOCKS);
+
+		stream.lut_compression.clear();
+
+		stream.workbuffer.resize(omp_get_max_threads());
+		
+		const ErrorInfo zero = { 0, 0, 0, 0 };
+		stream.errorinfo.assign(omp_get_max_threads(), zero);
+	}
+
+	void _prepare_encoder()
+	{
+		encoding_scratch.resize(omp_get_max_threads());
+
+		for(int i = 0; i < encoding_scratch.size(); ++i)
+			encoding_scratch[i].resize(encoder_scratchsize(encoder, BUFFERSIZE));
+	}
+
+	//manipulate the file data (allmydata, lut_compression, myblockindices)
+	//so that they are file-friendly
+	void _finalize_stream(ChannelStream& stream)
+	{
+		const int nchunks = stream.lut_compression.size();
+		const size_t extrabytes = stream.lut_compression.size() * sizeof(size_t);
+		const char * const lut_ptr = (char *)&stream.lut_compression.front();
+
+		stream.allmydata.insert(stream.allmydata.begin() + stream.written_bytes, lut_ptr, lut_ptr + extrabytes);
+		stream.lut_compression.clear();
+
+		HeaderLUT newvalue = { stream.written_bytes + extrabytes, nchunks };
+		stream.lutheader = newvalue;
+
+		stream.written_bytes += extrabytes;
+	}
+
+	void _report_stream(const int channel, const Real mythreshold, const ChannelStream& stream, const int NBLOCKS, const MPI::Intracomm& mycomm)
+	{
+		size_t aggregate_written_bytes = -1;
+
+		mycomm.Reduce(&stream.written_bytes, &aggregate_written_bytes, 1, MPI_UINT64_T, MPI::SUM, 0);
+
+		if (mycomm.Get_rank() == 0)
+			printf("Channel %d: %.2f kB, wavelet-threshold: %.1e, encoder: %s(%d), compr. rate: %.2f\n",
+				   channel, aggregate_written_bytes/1024.,
+				   mythreshold, encoder_name(encoder), encoder_level, NPTS * sizeof(Real) * NBLOCKS * mycomm.Get_size() / (float) aggregate_written_bytes);
+		
+		if (errorbound == ERRORBOUND_NONE) return;
+		
+		float maxerror = 0;
+		double sums[2] = { 0, 0 };
+		int missed = 0;
+		
+		for(int i = 0; i < stream.errorinfo.size(); ++i)
+		{
+			maxerror = max(maxerror, stream.errorinfo[i].maxerror);
+			sums[0] += stream.errorinfo[i].sumerror;
+			sums[1] += stream.errorinfo[i].sumthreshold;
+			missed += stream.errorinfo[i].missed;
+		}
+		
+		float aggregate_maxerror = 0;
+		double aggregate_sums[2] = { 0, 0 };
+		int aggregate_missed = 0;
+		
+		mycomm.Reduce(&maxerror, &aggregate_maxerror, 1, MPI::FLOAT, MPI::MAX, 0);
+		mycomm.Reduce(sums, aggregate_sums, 2, MPI::DOUBLE, MPI::SUM, 0);
+		mycomm.Reduce(&missed, &aggregate_missed, 1, MPI::INT, MPI::SUM, 0);
+		
+		if (mycomm.Get_rank() == 0)
+		{
+			const double nblocks = NBLOCKS * (double)mycomm.Get_size();
+			
+			printf("Channel %d: %s error bound %.1e, achieved max %.2e avg %.2e (relative to the block range), avg threshold %.2e, %d blocks over the bound\n",
+				   channel, errorbound == ERRORBOUND_L2 ? "L2" : "Linf", mythreshold,
+				   aggregate_maxerror, aggregate_sums[0] / nblocks, aggregate_sums[1] / nblocks, aggregate_missed);
+		}
+	}
+
+	void _report_timings(vector<float>& workload_file, const MPI::Intracomm& mycomm)
+	{
+		const bool isroot = mycomm.Get_rank() == 0;
+
+		const float tavgcompr = _profile_report("Compr", workload_total, mycomm, isroot);
+		const float tavgfwt =_profile_report("FWT+decim", workload_fwt, mycomm, isroot);
+		const float tavgenc =_profile_report("Encoding", workload_encode, mycomm, isroot);
+		const float tavgio =_profile_report("FileIO", workload_file, mycomm, isroot);
+		const float toverall = tavgio + tavgcompr;
+
+		if (isroot)
+		{
+			printf("Time distribution: %+5s:%.0f%% %+5s:%.0f%% %+5s:%.0f%% %+5s:%.0f%%\n",
+				   "FWT", tavgfwt / toverall * 100,
+				   "ENC", tavgenc / toverall * 100,
+				   "IO", tavgio / toverall * 100,
+				   "Other",  (tavgcompr - tavgfwt - tavgenc)/ toverall * 100);
+		}
+	}
+
 	template<int channel>
 	void _write(GridType & inputGrid, string fileName, IterativeStreamer streamer)
-	{				
+	{
 		const vector<BlockInfo> infos = inputGrid.getBlocksInfo();
 		const int NBLOCKS = infos.size();
-		
+
+		if (streams.size() == 0)
+			streams.resize(1);
+
+		ChannelStream& stream = streams[0];
+
 		//prepare the headers
+		stream.header = _prepare_header(inputGrid, threshold);
+
+		//compress my data, prepare for serialization
 		{
-			this->binaryocean_title = "\n==============START-BINARY-OCEAN==============\n";
-			this->binarylut_title = "\n==============START-BINARY-LUT==============\n";
-			
-			{
-				const int xtotalbpd = inputGrid.getBlocksPerDimension(0);
-				const int ytotalbpd = inputGrid.getBlocksPerDimension(1);
-				const int ztotalbpd = inputGrid.getBlocksPerDimension(2);
-				
-				const int xbpd = inputGrid.getResidentBlocksPerDimension(0);
-				const int ybpd = inputGrid.getResidentBlocksPerDimension(1);
-				const int zbpd = inputGrid.getResidentBlocksPerDimension(2);
-				
-				const double xExtent = inputGrid.getH()*xtotalbpd*_BLOCKSIZE_;
-				const double yExtent = inputGrid.getH()*ytotalbpd*_BLOCKSIZE_;
-				const double zExtent = inputGrid.getH()*ztotalbpd*_BLOCKSIZE_;
+			_reset_stream(stream, NBLOCKS);
+			_prepare_encoder();
 
-				std::stringstream ss;
-				
-				ss << "\n==============START-ASCI-HEADER==============\n";
-				
-				{
-					int one = 1;
-					bool isone = *(char *)(&one);
-					
-					ss << "Endianess: " << (isone ? "little" : "big") << "\n";
-				}
-				
-				ss << "sizeofReal: " << sizeof(Real) << "\n";
-				ss << "sizeofsize_t: " << sizeof(size_t) << "\n";
-				ss << "sizeofBlockMetadata: " << sizeof(BlockMetadata) << "\n";
-				ss << "sizeofHeaderLUT: " << sizeof(HeaderLUT) << "\n";
-				ss << "sizeofCompressedBlock: " << sizeof(CompressedBlock) << "\n";
-				ss << "Blocksize: " << _BLOCKSIZE_ << "\n";
-				ss << "Blocks: " << xtotalbpd << " x "  << ytotalbpd << " x " << ztotalbpd  << "\n";
-				ss << "Extent: " << xExtent << " " << yExtent << " " << zExtent << "\n"; 
-				ss << "SubdomainBlocks: " << xbpd << " x "  << ybpd << " x " << zbpd  << "\n";
-				ss << "HalfFloat: " << (this->halffloat ? "yes" : "no") << "\n";
-				ss << "Wavelets: " << WaveletsOnInterval::ChosenWavelets_GetName() << "\n";
-				ss << "WaveletThreshold: " << threshold << "\n";
-#if defined(_USE_ZLIB_)
-				ss << "Encoder: " << "zlib" << "\n";
-#else	/* _USE_LZ4_ */
-				ss << "Encoder: " << "lz4" << "\n";
-#endif
-				ss << "==============START-BINARY-METABLOCKS==============\n";
-				
-				this->header = ss.str();
-			}
+			_compress<channel>(infos, infos.size(), streamer, stream);
+
+			_finalize_stream(stream);
 		}
-		
-		//compress my data, prepare for serialization
-		{			
-			written_bytes = pending_writes = completed_writes = 0;
-			
-			if (allmydata.size() == 0)
-			{
-				const size_t speculated_compression_rate = 10;
-				allmydata.resize(NBLOCKS * sizeof(Real) * NPTS);
-			}
-			
-			myblockindices.clear();
-			myblockindices.resize(NBLOCKS);
-			
-			lut_compression.clear();
-			
-			_compress<channel>(infos, infos.size(), streamer);
-			
-			//manipulate the file data (allmydata, lut_compression, myblockindices)
-			//so that they are file-friendly
+
+		const MPI::Intracomm& mycomm = inputGrid.getCartComm();
+
+		//write into the file
+		Timer timer; timer.start();
+		_to_file(mycomm, fileName, stream);
+		vector<float> workload_file(1, timer.stop());
+
+		//just a report now
+		if (verbosity)
+		{
+			_report_stream(channel, threshold, stream, NBLOCKS, mycomm);
+			_report_timings(workload_file, mycomm);
+		}
+	}
+
+	void _write_all(GridType & inputGrid, const vector<string>& fileNames, const vector<int>& channels, const vector<Real>& thresholds)
+	{
+		const vector<BlockInfo> infos = inputGrid.getBlocksInfo();
+		const int NBLOCKS = infos.size();
+		const int NSTREAMS = channels.size();
+
+		assert(thresholds.size() == channels.size());
+		assert(fileNames.size() == channels.size());
+
+		for(int k = 0; k < NSTREAMS; ++k)
+		{
+			assert(channels[k] >= 0 && channels[k] < NCHANNELS);
+
+			for(int j = 0; j < k; ++j)
+				assert(channels[j] != channels[k]);
+		}
+
+		if (streams.size() < NSTREAMS)
+			streams.resize(NSTREAMS);
+
+		//prepare the headers, compress my data, prepare for serialization
+		{
+			for(int k = 0; k < NSTREAMS; ++k)
 			{
-				const int nchunks = lut_compression.size();
-				const size_t extrabytes = lut_compression.size() * sizeof(size_t);
-				const char * const lut_ptr = (char *)&lut_compression.front();
-				
-				allmydata.insert(allmydata.begin() + written_bytes, lut_ptr, lut_ptr + extrabytes);
-				lut_compression.clear();
-				
-				HeaderLUT newvalue = { written_bytes + extrabytes, nchunks };
-				lutheader = newvalue;
-				
-				written_bytes += extrabytes;
+				streams[k].header = _prepare_header(inputGrid, thresholds[k]);
+				_reset_stream(streams[k], NBLOCKS);
 			}
+
+			_prepare_encoder();
+
+			_compress_all(infos, NBLOCKS, channels, thresholds);
+
+			for(int k = 0; k < NSTREAMS; ++k)
+				_finalize_stream(streams[k]);
 		}
-		
+
 		const MPI::Intracomm& mycomm = inputGrid.getCartComm();
-		const size_t mygid = mycomm.Get_rank();
-		
-		//write into the file
+
+		//write into the files
 		Timer timer; timer.start();
-		_to_file(mycomm, fileName);
+		for(int k = 0; k < NSTREAMS; ++k)
+			_to_file(mycomm, fileNames[k], streams[k]);
 		vector<float> workload_file(1, timer.stop());
-		
+
 		//just a report now
 		if (verbosity)
-		{			
-			size_t aggregate_written_bytes = -1;
-			
-			mycomm.Reduce(&written_bytes, &aggregate_written_bytes, 1, MPI_UINT64_T, MPI::SUM, 0);
-			const bool isroot = mygid == 0;
-			if (mygid == 0)
-				printf("Channel %d: %.2f kB, wavelet-threshold: %.1e, compr. rate: %.2f\n",
-				   channel, aggregate_written_bytes/1024., 
-				   threshold, NPTS * sizeof(Real) * NBLOCKS * mycomm.Get_size() / (float) aggregate_written_bytes);
-			
-			const float tavgcompr = _profile_report("Compr", workload_total, mycomm, isroot); 
-			const float tavgfwt =_profile_report("FWT+decim", workload_fwt, mycomm, isroot); 
-			const float tavgenc =_profile_report("Encoding", workload_encode, mycomm, isroot);
-			const float tavgio =_profile_report("FileIO", workload_file, mycomm, isroot);
-			const float toverall = tavgio + tavgcompr;
-			
-			if (isroot)
+		{
+			for(int k = 0; k < NSTREAMS; ++k)
+				_report_stream(channels[k], thresholds[k], streams[k], NBLOCKS, mycomm);
+
+			_report_timings(workload_file, mycomm);
+		}
+	}
+
+	//compresses the snapshot once without encoding, then runs every available
+	//encoder on the very same chunks and reports ratio and throughput
+	void _benchmark_encoders(GridType & inputGrid, const vector<int>& channels, const vector<Real>& thresholds)
+	{
+		const vector<BlockInfo> infos = inputGrid.getBlocksInfo();
+		const int NBLOCKS = infos.size();
+		const int NSTREAMS = channels.size();
+
+		const MPI::Intracomm& mycomm = inputGrid.getCartComm();
+		const bool isroot = mycomm.Get_rank() == 0;
+
+		//the raw chunks, as the encoders would see them
+		{
+			const int myencoder = encoder;
+
+			encoder = ENCODER_NONE;
+
+			if (streams.size() < NSTREAMS)
+				streams.resize(NSTREAMS);
+
+			for(int k = 0; k < NSTREAMS; ++k)
+				_reset_stream(streams[k], NBLOCKS);
+
+			_prepare_encoder();
+
+			_compress_all(infos, NBLOCKS, channels, thresholds);
+
+			encoder = myencoder;
+		}
+
+		vector<unsigned char *> chunkptr;
+		vector<size_t> chunksize;
+
+		for(int k = 0; k < NSTREAMS; ++k)
+		{
+			vector<size_t> lut = streams[k].lut_compression;
+			std::sort(lut.begin(), lut.end());
+			lut.push_back(streams[k].written_bytes);
+
+			for(int i = 0; i < (int)lut.size() - 1; ++i)
+			{
+				chunkptr.push_back(&streams[k].allmydata.front() + lut[i]);
+				chunksize.push_back(lut[i + 1] - lut[i]);
+			}
+
+			streams[k].lut_compression.clear();
+		}
+
+		const int NCHUNKS = chunkptr.size();
+		size_t rawbytes = std::accumulate(chunksize.begin(), chunksize.end(), (size_t)0);
+		mycomm.Allreduce(MPI::IN_PLACE, &rawbytes, 1, MPI_UINT64_T, MPI::SUM);
+
+		if (isroot)
+			printf("ENCODER BENCHMARK: %d channels, %.2f MB of wavelet streams\n", NSTREAMS, rawbytes / 1024. / 1024);
+
+		const int candidates[][2] = {
+			{ ENCODER_NONE, 0 },
+			{ ENCODER_ZLIB, 1 }, { ENCODER_ZLIB, Z_DEFAULT_COMPRESSION }, { ENCODER_ZLIB, 9 },
+			{ ENCODER_LZ4, 0 },
+			{ ENCODER_ZSTD, 1 }, { ENCODER_ZSTD, 3 }, { ENCODER_ZSTD, 9 }, { ENCODER_ZSTD, 19 }
+		};
+
+		const int NCANDIDATES = sizeof(candidates) / sizeof(candidates[0]);
+
+		for(int c = 0; c < NCANDIDATES; ++c)
+		{
+			const int type = candidates[c][0];
+			const int level = candidates[c][1];
+
+			if (!encoder_available(type)) continue;
+
+			vector< vector<unsigned char> > encoded(NCHUNKS);
+			size_t encodedbytes = 0;
+			double tencode = 0, tdecode = 0;
+
+			Timer timer;
+
+			mycomm.Barrier();
+			timer.start();
+
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:encodedbytes)
+			for(int i = 0; i < NCHUNKS; ++i)
+			{
+				vector<unsigned char> work(chunkptr[i], chunkptr[i] + chunksize[i]);
+				work.resize(max((size_t)compressBound(chunksize[i]), chunksize[i]));
+
+				vector<unsigned char> scratch(encoder_scratchsize(type, chunksize[i]));
+
+				size_t zbytes = 0;
+				const unsigned char * const zptr = encode(type, level, &work.front(), chunksize[i], work.size(), scratch.size() ? &scratch.front() : NULL, zbytes);
+
+				encoded[i].assign(zptr, zptr + zbytes);
+				encodedbytes += zbytes;
+			}
+
+			tencode = timer.stop();
+			mycomm.Barrier();
+			timer.start();
+
+			bool success = true;
+
+#pragma omp parallel for schedule(dynamic, 1) reduction(&&:success)
+			for(int i = 0; i < NCHUNKS; ++i)
 			{
-				printf("Time distribution: %+5s:%.0f%% %+5s:%.0f%% %+5s:%.0f%% %+5s:%.0f%%\n",
-					   "FWT", tavgfwt / toverall * 100, 
-					   "ENC", tavgenc / toverall * 100, 
-					   "IO", tavgio / toverall * 100, 
-					   "Other",  (tavgcompr - tavgfwt - tavgenc)/ toverall * 100);
+				vector<unsigned char> decoded(chunksize[i]);
+
+				const size_t nbytes = decode(type, &encoded[i].front(), encoded[i].size(), &decoded.front(), decoded.size());
+
+				if (nbytes != chunksize[i] || memcmp(&decoded.front(), chunkptr[i], nbytes))
+					success = false;
 			}
+
+			tdecode = timer.stop();
+
+			mycomm.Allreduce(MPI::IN_PLACE, &encodedbytes, 1, MPI_UINT64_T, MPI::SUM);
+			mycomm.Allreduce(MPI::IN_PLACE, &tencode, 1, MPI::DOUBLE, MPI::MAX);
+			mycomm.Allreduce(MPI::IN_PLACE, &tdecode, 1, MPI::DOUBLE, MPI::MAX);
+			mycomm.Allreduce(MPI::IN_PLACE, &success, 1, MPI::BOOL, MPI::LAND);
+
+			if (isroot)
+				printf("Encoder %-4s level %3d: compr. rate: %7.2f  enc: %7.3f GB/s  dec: %7.3f GB/s  %s\n",
+					   encoder_name(type), level, rawbytes / (double) encodedbytes,
+					   rawbytes / tencode / 1e9, rawbytes / tdecode / 1e9, success ? "" : "ROUNDTRIP FAILED!");
 		}
 	}
-		
+
 	void _read(string path)
 	{
 		//THE FIRST PART IS SEQUENTIAL
@@ -459,6 +1085,7 @@ protected:
 		string binaryocean_title = "\n==============START-BINARY-OCEAN==============\n";	
 		const int miniheader_bytes = sizeof(size_t) + binaryocean_title.size();		
 		
+		int fileencoder = -1;
 		vector<BlockMetadata> metablocks;
 		
 		//random access data structures: meta2subchunk, lutchunks;
@@ -512,11 +1139,8 @@ protected:
 				assert(buf == string(WaveletsOnInterval::ChosenWavelets_GetName()));
 				
 				fscanf(file, "Encoder: %s\n", buf);
-#if defined(_USE_ZLIB_)
-				assert(buf == string("zlib"));
-#else	/* _USE_LZ4_ */
-				assert(buf == string("lz4"));
-#endif
+				fileencoder = encoder_type(buf);
+				assert(encoder_available(fileencoder));
 
 				
 				fgets(buf, sizeof(buf), file);
@@ -698,7 +1322,7 @@ protected:
 			
 			
 			vector<unsigned char> waveletbuf(4 << 20);
-			const size_t decompressedbytes = zdecompress(&compressedbuf.front(), compressedbuf.size(), &waveletbuf.front(), waveletbuf.size());
+			const size_t decompressedbytes = decode(fileencoder, &compressedbuf.front(), compressedbuf.size(), &waveletbuf.front(), waveletbuf.size());
 			//printf("decompressed bytes is %d\n", decompressedbytes);
 			int readbytes = 0;
 			for(int i = 0; i<compressedchunk.subid; ++i)
@@ -742,15 +1366,79 @@ public:
 	
 	void set_threshold(const Real threshold) { this->threshold = threshold; }
 	
+	//"linf" or "l2": from now on the thresholds are relative error tolerances, 
+	//met block by block. "none" goes back to absolute thresholds
+	void set_error_bound(const string norm)
+	{
+		if (norm == "none")
+			errorbound = ERRORBOUND_NONE;
+		else if (norm == "linf")
+			errorbound = ERRORBOUND_LINF;
+		else if (norm == "l2")
+			errorbound = ERRORBOUND_L2;
+		else
+		{
+			printf("ERROR BOUND <%s> IS NOT SUPPORTED, USE linf, l2 OR none. ABORTING NOW.\n", norm.c_str());
+			abort();
+		}
+	}
+	
 	void float16() { halffloat = true; }
 	
 	void verbose() { verbosity = true; }
 	
+	void set_encoder(const string name, const int level)
+	{
+		const int type = encoder_type(name);
+		
+		if (type < 0 || !encoder_available(type))
+		{
+			printf("ENCODER <%s> IS NOT AVAILABLE IN THIS BUILD!! ABORTING NOW.\n", name.c_str());
+			abort();
+		}
+		
+		encoder = type;
+		encoder_level = level;
+	}
+	
+	void set_encoder(const string name) { set_encoder(name, encoder_default_level(encoder_type(name))); }
+	
+	//groupsize consecutive ranks of comm (the one of the grid) share one writer, subfiles: one file per group plus the index.
+	//collective over comm. the communicators are split here, only when the settings change
+	void set_aggregation(const MPI::Intracomm& comm, const int groupsize, const bool subfiles)
+	{
+		if (aggregation_parent == (MPI_Comm)comm && aggregation_groupsize == groupsize && aggregation_subfiles == subfiles)
+			return;
+		
+		if ((MPI_Comm)aggregation_groupcomm != MPI_COMM_NULL) aggregation_groupcomm.Free();
+		if ((MPI_Comm)aggregation_aggrcomm != MPI_COMM_NULL) aggregation_aggrcomm.Free();
+		
+		aggregation_parent = comm;
+		aggregation_groupsize = groupsize;
+		aggregation_subfiles = subfiles;
+		
+		if (groupsize <= 1 && !subfiles) return;
+		
+		const int mygid = comm.Get_rank();
+		const int mygroup = mygid / max(1, min(groupsize, comm.Get_size()));
+		
+		aggregation_groupcomm = comm.Split(mygroup, mygid);
+		aggregation_aggrcomm = comm.Split(aggregation_groupcomm.Get_rank() == 0 ? 0 : MPI_UNDEFINED, mygid);
+	}
+	
+	//tries all the available encoders on this snapshot, nothing is written
+	void BenchmarkEncoders(GridType & inputGrid, const vector<int>& channels, const vector<Real>& thresholds)
+	{
+		_benchmark_encoders(inputGrid, channels, thresholds);
+	}
+	
 	SerializerIO_WaveletCompression_MPI_SimpleBlocking(): 
 	threshold(0), halffloat(false), verbosity(false), 
+	encoder(ENCODER_DEFAULT), encoder_level(encoder_default_level(ENCODER_DEFAULT)), errorbound(ERRORBOUND_NONE),
+	aggregation_groupsize(1), aggregation_subfiles(false), aggregation_parent(MPI_COMM_NULL),
+	aggregation_groupcomm(MPI::COMM_NULL), aggregation_aggrcomm(MPI::COMM_NULL),
 	workload_total(omp_get_max_threads()), workload_fwt(omp_get_max_threads()), workload_encode(omp_get_max_threads()),
-	workbuffer(omp_get_max_threads()), 
-	written_bytes(0), pending_writes(0)
+	streams(1)
 	{
 	}
 	
@@ -763,6 +1451,23 @@ public:
 		_write<channel>(inputGrid, fileName + ss.str(), streamer);
 	}
 	
+	//compresses all the given channels in a single sweep over the grid,
+	//each channel gets its own file and its own threshold
+	void Write(GridType & inputGrid, string fileName, const vector<int>& channels, const vector<Real>& thresholds, IterativeStreamer streamer = IterativeStreamer())
+	{
+		vector<string> fileNames(channels.size());
+		
+		for(int k = 0; k < channels.size(); ++k)
+		{
+			std::stringstream ss;
+			ss << "." << streamer.name() << ".channel"  << channels[k];
+			
+			fileNames[k] = fileName + ss.str();
+		}
+		
+		_write_all(inputGrid, fileNames, channels, thresholds);
+	}
+	
 	void Read(string fileName, IterativeStreamer streamer = IterativeStreamer())
 	{
 		for(int channel = 0; channel < NCHANNELS; ++channel)
@@ -778,9 +1483,12 @@ public:
 template<typename GridType, typename IterativeStreamer>
 class SerializerIO_WaveletCompression_MPI_Simple : public SerializerIO_WaveletCompression_MPI_SimpleBlocking<GridType, IterativeStreamer>
 {	
+	typedef typename SerializerIO_WaveletCompression_MPI_SimpleBlocking<GridType, IterativeStreamer>::ChannelStream ChannelStream;
+	
 	size_t nofcalls;
 	vector<MPI::Request> pending_requests;
 	MPI::File myopenfile;
+	unsigned char * pending_buffer;
 	
 	void _wait_all_quiet()
 	{
@@ -790,14 +1498,14 @@ class SerializerIO_WaveletCompression_MPI_Simple : public SerializerIO_WaveletCo
 		pending_requests.clear();
 		
 		//close the split collective io
-		myopenfile.Write_ordered_end(&this->allmydata.front());
+		myopenfile.Write_ordered_end(pending_buffer);
 		
 		//e buonanotte
 		myopenfile.Close();
 	}
 	
 	//et bon, la on ce lance le fleurs
-	void _to_file(const MPI::Intracomm& mycomm, const string fileName)	
+	void _to_file(const MPI::Intracomm& mycomm, const string fileName, ChannelStream& stream)	
 	{
 		if (nofcalls)
 			_wait_all_quiet(); 
@@ -827,7 +1535,8 @@ class SerializerIO_WaveletCompression_MPI_Simple : public SerializerIO_WaveletCo
 		{
 			myopenfile.Seek_shared(current_displacement, MPI_SEEK_SET);
 			
-			myopenfile.Write_ordered_begin(&this->allmydata.front(), this->written_bytes, MPI_CHAR);
+			pending_buffer = &stream.allmydata.front();
+			myopenfile.Write_ordered_begin(pending_buffer, stream.written_bytes, MPI_CHAR);
 			
 			current_displacement = myopenfile.Get_position_shared();			
 		}
@@ -841,19 +1550,19 @@ class SerializerIO_WaveletCompression_MPI_Simple : public SerializerIO_WaveletCo
 		
 		//write the header
 		{
-			const size_t header_bytes = this->header.size();
+			const size_t header_bytes = stream.header.size();
 			
 			if (mygid == 0)
-				pending_requests.push_back( myopenfile.Iwrite_at(current_displacement, this->header.c_str(), header_bytes, MPI_CHAR) );
+				pending_requests.push_back( myopenfile.Iwrite_at(current_displacement, stream.header.c_str(), header_bytes, MPI_CHAR) );
 			
 			current_displacement += header_bytes;			
 		}
 		
 		//write block metadata
 		{
-			const int metadata_bytes = this->myblockindices.size() * sizeof(BlockMetadata);
+			const int metadata_bytes = stream.myblockindices.size() * sizeof(BlockMetadata);
 			
-			pending_requests.push_back( myopenfile.Iwrite_at(current_displacement + mygid * metadata_bytes, &this->myblockindices.front(), metadata_bytes, MPI_CHAR) );
+			pending_requests.push_back( myopenfile.Iwrite_at(current_displacement + mygid * metadata_bytes, &stream.myblockindices.front(), metadata_bytes, MPI_CHAR) );
 			
 			current_displacement += metadata_bytes * nranks;			
 		}
@@ -870,11 +1579,11 @@ class SerializerIO_WaveletCompression_MPI_Simple : public SerializerIO_WaveletCo
 		
 		//write the local buffer entries 
 		{			
-			assert(this->lut_compression.size() == 0);
+			assert(stream.lut_compression.size() == 0);
 			
-			const int lutheader_bytes = sizeof(this->lutheader);
+			const int lutheader_bytes = sizeof(stream.lutheader);
 			
-			pending_requests.push_back( myopenfile.Iwrite_at(current_displacement + mygid * lutheader_bytes, &this->lutheader, lutheader_bytes, MPI_CHAR) );
+			pending_requests.push_back( myopenfile.Iwrite_at(current_displacement + mygid * lutheader_bytes, &stream.lutheader, lutheader_bytes, MPI_CHAR) );
 		}
 		
 		++nofcalls;
@@ -883,7 +1592,7 @@ class SerializerIO_WaveletCompression_MPI_Simple : public SerializerIO_WaveletCo
 public:
 	SerializerIO_WaveletCompression_MPI_Simple(): 
 	SerializerIO_WaveletCompression_MPI_SimpleBlocking<GridType, IterativeStreamer>(),
-	nofcalls(0)
+	nofcalls(0), pending_buffer(NULL)
 	{
 	}
 	
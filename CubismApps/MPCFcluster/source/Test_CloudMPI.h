@@ -303,6 +303,10 @@ public:
 				profiler.push_start("IO WAVELET");
 				t_ssmpi->vp(*grid, step_id, bVP);
 				profiler.pop_stop();
+				
+				profiler.push_start("IO PYRAMID");
+				t_ssmpi->pyramid(*grid, step_id);
+				profiler.pop_stop();
 			}
             
 			if (step_id % SAVEPERIOD == 0 && bWithIO)
@@ -321,6 +325,13 @@ public:
             
 			profiler.pop_stop();
 			
+			if (bWithIO)
+			{
+				profiler.push_start("IO WAVELET");
+				t_ssmpi->vp_progress();
+				profiler.pop_stop();
+			}
+			
 #ifndef _SEQUOIA_
             if (step_id%ANALYSISPERIOD==0)
 			{
@@ -342,6 +353,8 @@ public:
                 break;
 		}
         
+		t_ssmpi->vp_wait();
+        
 		std::stringstream streamer;
 		streamer<<"data-"<<step_id;;
 		t_ssmpi->dump(*grid, step_id, streamer.str());
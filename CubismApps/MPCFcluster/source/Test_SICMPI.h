@@ -84,6 +84,7 @@ public:
                 
 				t_ssmpi->dump(*grid, step_id, streamer.str());
 				t_ssmpi->vp(*grid, step_id, bVP);
+				t_ssmpi->pyramid(*grid, step_id);
 				//return ; 
 			}
             
@@ -91,6 +92,7 @@ public:
 				t_ssmpi->save(*grid, step_id, t);
             
 			const Real dt = (*stepper)(TEND-t);
+			t_ssmpi->vp_progress();
             
 			if(step_id % 10 == 0 && isroot && step_id > 0)
 				profiler.printSummary();
@@ -114,6 +116,8 @@ public:
                 break;
 		}
         
+		t_ssmpi->vp_wait();
+        
 		std::stringstream streamer;
 		streamer << "data-" << step_id;
 		t_ssmpi->dump(*grid, step_id, streamer.str());
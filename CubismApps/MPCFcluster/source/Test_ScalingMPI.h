@@ -0,0 +1,403 @@
+/*
+ *  Test_ScalingMPI.h
+ *  MPCFcluster
+ *
+ *  -sim scaling: a fixed number of LSRK3 steps on a smooth synthetic state, three ways:
+ *  halo (the synchronizations and the SOS Allreduce), compute (SOS, RHS and update on the ghosts of the last synchronization)
+ *  and full (the step of FlowStep_LSRK3MPI). The phase times are reduced over the ranks,
+ *  full against halo + compute tells how much of the communication is hidden.
+ *  Without -xpesize the ranks are laid out by MPI::Compute_dims: mpirun -np N works on any N.
+ *
+ */
+#pragma once
+
+#include <limits>
+#include <cmath>
+
+#include <MaxSpeedOfSound.h>
+#include "Test_SteadyStateMPI.h"
+
+class Test_ScalingMPI: public Simulation
+{
+	ArgumentParser parser;
+	const bool isroot;
+
+	int XPESIZE, YPESIZE, ZPESIZE;
+	int BPDX, BPDY, BPDZ;
+	int NSTEPS, WARMUP;
+	Real CFL;
+	string scaling;
+
+	G * grid;
+
+	//seconds per rank, summed over the measured steps
+	enum { SOS, ALLREDUCE, SYNCH, BP, UP, STEP, NPHASES };
+
+	struct Phases
+	{
+		double t[NPHASES];
+
+		Phases() { std::fill(t, t + NPHASES, 0.); }
+	};
+
+	static const char * _phase_name(const int phase)
+	{
+		static const char * names[NPHASES] = { "SOS", "SOS Allreduce", "t_synch_fs", "t_bp_fs", "t_up", "step" };
+
+		return names[phase];
+	}
+
+	//the pe sizes that were given are kept, MPI::Compute_dims picks the others
+	void _decomposition()
+	{
+		const int nranks = MPI::COMM_WORLD.Get_size();
+
+		int dims[3] = { parser("-xpesize").asInt(0), parser("-ypesize").asInt(0), parser("-zpesize").asInt(0) };
+
+		MPI::Compute_dims(nranks, 3, dims);
+
+		XPESIZE = dims[0];
+		YPESIZE = dims[1];
+		ZPESIZE = dims[2];
+
+		//weak: -bpd blocks per rank, strong: -gbpd blocks in total, split among the ranks
+		scaling = parser("-scaling").asString("weak");
+
+		if (scaling == "strong")
+		{
+			const int gbpd = parser("-gbpd").asInt(4 * max(XPESIZE, max(YPESIZE, ZPESIZE)));
+			const int gbpdx = parser("-gbpdx").asInt(gbpd);
+			const int gbpdy = parser("-gbpdy").asInt(gbpd);
+			const int gbpdz = parser("-gbpdz").asInt(gbpd);
+
+			if (gbpdx % XPESIZE || gbpdy % YPESIZE || gbpdz % ZPESIZE)
+			{
+				if (isroot)
+					printf("Scaling: %d x %d x %d blocks do not split over %d x %d x %d ranks. Aborting.\n", gbpdx, gbpdy, gbpdz, XPESIZE, YPESIZE, ZPESIZE);
+
+				MPI::COMM_WORLD.Abort(1);
+			}
+
+			BPDX = gbpdx / XPESIZE;
+			BPDY = gbpdy / YPESIZE;
+			BPDZ = gbpdz / ZPESIZE;
+		}
+		else
+		{
+			const int bpd = parser("-bpd").asInt(2);
+
+			BPDX = parser("-bpdx").asInt(bpd);
+			BPDY = parser("-bpdy").asInt(bpd);
+			BPDZ = parser("-bpdz").asInt(bpd);
+		}
+	}
+
+	//smooth and periodic, far from anything that would stop the steps
+	void _ic()
+	{
+		vector<BlockInfo> vInfo = grid->getBlocksInfo();
+
+		const double G1 = Simulation_Environment::GAMMA1 - 1;
+
+#pragma omp parallel for
+		for(int i = 0; i < (int)vInfo.size(); i++)
+		{
+			BlockInfo info = vInfo[i];
+			FluidBlock& b = *(FluidBlock *)info.ptrBlock;
+
+			for(int iz = 0; iz < FluidBlock::sizeZ; iz++)
+				for(int iy = 0; iy < FluidBlock::sizeY; iy++)
+					for(int ix = 0; ix < FluidBlock::sizeX; ix++)
+					{
+						Real p[3];
+						info.pos(p, ix, iy, iz);
+
+						const double s = sin(2 * M_PI * p[0]) * cos(2 * M_PI * p[1]) * sin(2 * M_PI * p[2]);
+						const double pressure = 1 + 0.1 * s;
+
+						b(ix, iy, iz).clear();
+						b(ix, iy, iz).rho = 1 + 0.1 * s;
+						b(ix, iy, iz).u = 0.1 * s * b(ix, iy, iz).rho;
+						b(ix, iy, iz).v = 0.05 * s * b(ix, iy, iz).rho;
+						b(ix, iy, iz).w = -0.05 * s * b(ix, iy, iz).rho;
+						b(ix, iy, iz).G = 1 / G1;
+						b(ix, iy, iz).P = 0;
+
+						const double ke = 0.5 * (pow(b(ix, iy, iz).u, 2) + pow(b(ix, iy, iz).v, 2) + pow(b(ix, iy, iz).w, 2)) / b(ix, iy, iz).rho;
+						b(ix, iy, iz).energy = pressure * b(ix, iy, iz).G + ke;
+					}
+
+			b.clear_tmp();
+		}
+	}
+
+	Real _local_sos(vector<BlockInfo>& vInfo)
+	{
+		const int N = vInfo.size();
+		Real sos = 0;
+
+#pragma omp parallel
+		{
+			MaxSpeedOfSound_CPP kernel;
+			Real mysos = 0;
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+				mysos = max(mysos, ((FluidBlock *)vInfo[i].ptrBlock)->sos(kernel));
+
+#pragma omp critical
+			sos = max(sos, mysos);
+		}
+
+		return sos;
+	}
+
+	//one LSRK3 step of the given mode, as LSRKstepMPI does it
+	template<typename Kflow, typename Kupdate>
+	void _step(const string mode, const Real current_time, Phases& phases)
+	{
+		const bool communicate = mode != "compute";
+		const bool compute = mode != "halo";
+
+		vector<BlockInfo> vInfo = grid->getBlocksInfo();
+
+		Timer steptimer, timer;
+		steptimer.start();
+
+		double sos = 1;
+
+		if (compute)
+		{
+			timer.start();
+			sos = _local_sos(vInfo);
+			phases.t[SOS] += timer.stop();
+		}
+
+		if (communicate)
+		{
+			double globalsos = 0;
+
+			timer.start();
+			grid->getCartComm().Allreduce(&sos, &globalsos, 1, MPI::DOUBLE, MPI::MAX);
+			phases.t[ALLREDUCE] += timer.stop();
+
+			sos = globalsos;
+		}
+
+		//dt/h
+		const Real dtinvh = CFL / sos;
+
+		const Real a[3] = { 0, -17./32, -32./27 };
+		const Real b[3] = { 1./4, 8./9, 3./4 };
+
+		for(int stage = 0; stage < 3; ++stage)
+		{
+			LSRK3data::FlowStep<Kflow, Lab> rhs(a[stage], dtinvh);
+
+			if (communicate)
+			{
+				timer.start();
+				SynchronizerMPI& synch = grid->sync(rhs);
+				phases.t[SYNCH] += timer.stop();
+
+				for (int ipass = 0; ipass < 2; ipass++)
+				{
+					timer.start();
+					vector<BlockInfo> avail = ipass == 0 ? synch.avail_inner() : synch.avail_halo();
+					phases.t[SYNCH] += timer.stop();
+
+					if (compute)
+					{
+						timer.start();
+						_process< LabMPI >(avail, rhs, *grid, current_time, false);
+						phases.t[BP] += timer.stop();
+					}
+				}
+			}
+			else
+			{
+				//the ghosts of the last synchronization
+				timer.start();
+				_process< LabMPI >(vInfo, rhs, *grid, current_time, false);
+				phases.t[BP] += timer.stop();
+			}
+
+			if (compute)
+			{
+				LSRK3data::Update<Kupdate> update(b[stage], &vInfo.front());
+
+				timer.start();
+				update.omp(vInfo.size());
+				phases.t[UP] += timer.stop();
+			}
+		}
+
+		phases.t[STEP] += steptimer.stop();
+	}
+
+	template<typename Kflow, typename Kupdate>
+	Phases _measure(const string mode)
+	{
+		//the compute mode needs the ghosts of one synchronization
+		if (mode == "compute")
+		{
+			Phases dummy;
+			_step<Kflow, Kupdate>("halo", 0, dummy);
+		}
+
+		Phases phases;
+
+		for(int s = 0; s < WARMUP + NSTEPS; ++s)
+		{
+			if (s == WARMUP)
+			{
+				grid->getCartComm().Barrier();
+				phases = Phases();
+			}
+
+			_step<Kflow, Kupdate>(mode, 0, phases);
+		}
+
+		for(int p = 0; p < NPHASES; ++p)
+			phases.t[p] /= NSTEPS;
+
+		return phases;
+	}
+
+	//min, average and max over the ranks of the per-step times
+	void _report(const string mode, const Phases& phases, FILE * f)
+	{
+		MPI::Intracomm comm = MPI::COMM_WORLD;
+		const int nranks = comm.Get_size();
+
+		Phases minp, avgp, maxp;
+
+		comm.Reduce(phases.t, minp.t, NPHASES, MPI::DOUBLE, MPI::MIN, 0);
+		comm.Reduce(phases.t, avgp.t, NPHASES, MPI::DOUBLE, MPI::SUM, 0);
+		comm.Reduce(phases.t, maxp.t, NPHASES, MPI::DOUBLE, MPI::MAX, 0);
+
+		if (!isroot) return;
+
+		for(int p = 0; p < NPHASES; ++p)
+		{
+			avgp.t[p] /= nranks;
+
+			if (maxp.t[p] == 0) continue;
+
+			printf("%-8s %-14s %12.4e %12.4e %12.4e %8.1f%%\n", mode.c_str(), _phase_name(p),
+				   minp.t[p], avgp.t[p], maxp.t[p], 100 * (maxp.t[p] - minp.t[p]) / max(maxp.t[p], std::numeric_limits<double>::epsilon()));
+
+			if (f != NULL)
+				fprintf(f, "%s %d %d %d %d %d %d %d %s %s %e %e %e\n", scaling.c_str(), nranks, XPESIZE, YPESIZE, ZPESIZE,
+						BPDX, BPDY, BPDZ, mode.c_str(), _phase_name(p), minp.t[p], avgp.t[p], maxp.t[p]);
+		}
+	}
+
+	template<typename Kflow, typename Kupdate>
+	void _run()
+	{
+		string modes = parser("-mode").asString("all");
+
+		if (modes == "all") modes = "halo compute full";
+
+		const string filename = parser("-scalingfile").asString("");
+		FILE * f = isroot && filename != "" ? fopen(filename.c_str(), "a") : NULL;
+
+		if (isroot)
+			printf("%-8s %-14s %12s %12s %12s %9s\n", "mode", "phase", "min[s]", "avg[s]", "max[s]", "imbalance");
+
+		map<string, double> steptime;
+
+		std::stringstream ss(modes);
+		string mode;
+
+		while (ss >> mode)
+		{
+			if (mode != "halo" && mode != "compute" && mode != "full")
+			{
+				if (isroot) printf("Scaling: mode <%s> not recognized (halo, compute, full). Aborting.\n", mode.c_str());
+				MPI::COMM_WORLD.Abort(1);
+			}
+
+			const Phases phases = _measure<Kflow, Kupdate>(mode);
+
+			_report(mode, phases, f);
+
+			double maxstep = 0;
+			MPI::COMM_WORLD.Reduce(&phases.t[STEP], &maxstep, 1, MPI::DOUBLE, MPI::MAX, 0);
+			steptime[mode] = maxstep;
+		}
+
+		if (f != NULL) fclose(f);
+
+		//what the overlap of the two passes hides of the synchronization
+		if (isroot && steptime.count("halo") && steptime.count("compute") && steptime.count("full"))
+		{
+			const double sum = steptime["halo"] + steptime["compute"];
+			const double hidden = (sum - steptime["full"]) / max(steptime["halo"], std::numeric_limits<double>::epsilon());
+
+			printf("Scaling: full step %.4e s, halo + compute %.4e s, communication hidden %.1f%%\n",
+				   steptime["full"], sum, 100 * min(1., max(0., hidden)));
+		}
+	}
+
+public:
+
+	Test_ScalingMPI(const bool isroot, const int argc, const char ** argv):
+	parser(argc, argv), isroot(isroot), grid(NULL) { }
+
+	void setup()
+	{
+		_decomposition();
+
+		NSTEPS = parser("-nsteps").asInt(10);
+		WARMUP = parser("-warmup").asInt(1);
+		CFL = parser("-cfl").asDouble(0.3);
+
+		Simulation_Environment::GAMMA1 = parser("-g1").asDouble(1.4);
+		Simulation_Environment::GAMMA2 = parser("-g2").asDouble(1.4);
+		Simulation_Environment::PC1 = 0;
+		Simulation_Environment::PC2 = 0;
+
+		grid = new G(XPESIZE, YPESIZE, ZPESIZE, BPDX, BPDY, BPDZ);
+		assert(grid != NULL);
+
+		_ic();
+
+		if (isroot)
+		{
+			const int nranks = MPI::COMM_WORLD.Get_size();
+
+			printf("////////////////////////////////////////////////////////////\n");
+			printf("///////////             SCALING MPI              ///////////\n");
+			printf("////////////////////////////////////////////////////////////\n");
+			printf("Scaling %s: %d ranks (%d x %d x %d), %d x %d x %d blocks per rank, %d blocks in total, bs %d, %d threads per rank, %d steps (+%d warmup)\n",
+				   scaling.c_str(), nranks, XPESIZE, YPESIZE, ZPESIZE, BPDX, BPDY, BPDZ,
+				   nranks * BPDX * BPDY * BPDZ, _BLOCKSIZE_, omp_get_max_threads(), NSTEPS, WARMUP);
+		}
+	}
+
+	void run()
+	{
+		if (parser("-kernels").asString("cpp") == "cpp")
+			_run<Convection_CPP, Update_CPP>();
+#if defined(_QPX_) || defined(_QPXEMU_)
+		else if (parser("-kernels").asString("cpp") == "qpx")
+			_run<Convection_QPX, Update_QPX>();
+#endif
+		else
+		{
+			if (isroot) printf("Scaling: combination not supported yet\n");
+			MPI::COMM_WORLD.Abort(1);
+		}
+	}
+
+	void dispose()
+	{
+		if (grid != NULL)
+		{
+			delete grid;
+			grid = NULL;
+		}
+	}
+};
@@ -321,6 +321,7 @@ public:
 				streamer<<"data-"<<step_id;;
 				t_ssmpi->dump(*grid, step_id, streamer.str());
 				t_ssmpi->vp(*grid, step_id, bVP);
+				t_ssmpi->pyramid(*grid, step_id);
 			}
             
 			if (step_id%SAVEPERIOD==0)
@@ -329,6 +330,7 @@ public:
                         HPM_Stop("Dumping");
 #endif            
 			const Real dt = (*stepper)(TEND-t);
+			t_ssmpi->vp_progress();
             
 			if(step_id%10 == 0 && isroot && step_id > 0)
 				profiler.printSummary();
@@ -352,6 +354,8 @@ public:
                 break;
 		}
         
+		t_ssmpi->vp_wait();
+        
 		std::stringstream streamer;
 		streamer<<"data-"<<step_id;;
 		t_ssmpi->dump(*grid, step_id, streamer.str());
@@ -362,5 +366,12 @@ public:
 		}
 		if (isroot) printf("Finishing RUN\n");
 	}
+	
+	void dispose()
+	{
+		t_ssmpi->dispose();
+		delete t_ssmpi;
+		t_ssmpi = NULL;
+	}
 };
 
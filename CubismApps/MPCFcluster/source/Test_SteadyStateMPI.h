@@ -12,6 +12,10 @@
 #include <HDF5Dumper_MPI.h>
 
 #include "SerializerIO_WaveletCompression_MPI_Simple.h"
+#include "SerializerIO_WaveletCompression_MPI_Async.h"
+#include "PyramidMPI.h"
+#include "DeltaCheckpointMPI.h"
+#include "ReadWaveletCompression_MPI.h"
 
 #include "FlowStep_LSRK3MPI.h"
 #include <Test_SteadyState.h>
@@ -30,6 +34,24 @@ protected:
 	
 	//SerializerIO_WaveletCompression_MPI_Simple<G, StreamerGridPointIterative> mywaveletdumper;
 	SerializerIO_WaveletCompression_MPI_SimpleBlocking<G, StreamerGridPointIterative> mywaveletdumper;
+	
+	//-vpasync 1: the dumps overlap with the steps, see vp_progress
+	SerializerIO_WaveletCompression_MPI_Async<G, StreamerGridPointIterative> myasyncdumper;
+	
+	DeltaCheckpointMPI<G> mycheckpoint;
+	
+	//-checkpoint delta: xor residuals against the previous checkpoint instead of hdf5 dumps
+	bool _delta_checkpoints()
+	{
+		if (parser("-checkpoint").asString("hdf") != "delta") return false;
+		
+		mycheckpoint.set_full_period(parser("-checkpointfull").asInt(10));
+		
+		if (parser.check("-checkpointencoder"))
+			mycheckpoint.set_encoder(parser("-checkpointencoder").asString());
+		
+		return true;
+	}
 
 public:
 	
@@ -59,6 +81,16 @@ public:
     void restart(G& grid)
     {
 		const string path = parser("-fpath").asString(".");
+		
+		if (_delta_checkpoints())
+		{
+			mycheckpoint.Read(grid, path, step_id, t);
+			
+			if (isroot) 
+				printf("DESERIALIZATION: time is %f and step id is %d\n", t, step_id);
+			
+			return;
+		}
         
         {
             const string restart_status = path+"/restart.status";
@@ -75,27 +107,61 @@ public:
         
         if (isroot) 
 			printf("DESERIALIZATION: time is %f and step id is %d\n", t, step_id);
+		
+		//-checkpoint wavelet: the channels of a wavelet dump, -restartfrom picks any dump with all of them
+		if (parser("-checkpoint").asString("hdf") == "wavelet")
+		{
+			const string prefix = parser("-restartfrom").asString(path + "/data_restart_wavelet");
+			
+			ReadWaveletCompression_MPI<G, StreamerGridPointIterative>(grid, prefix);
+			
+			return;
+		}
         
         ReadHDF5_MPI<G, StreamerDummy_HDF5>(grid, "data_restart", path.c_str());
         DumpHDF5_MPI<G, StreamerDummy_HDF5>(grid, 0, "data_restart_restarted", path.c_str());
     }
     
-    void save(G& grid, const int step_id, const Real t)
+    void save(G& grid, const int step_id, const double t)
     {
-		if (isroot) cout << "Saving...";
-        
         const string path = parser("-fpath").asString(".");
 		
+		if (_delta_checkpoints())
+		{
+			mycheckpoint.Write(grid, path, step_id, t);
+			return;
+		}
+		
+		if (isroot) cout << "Saving...";
+		
         if (isroot)
         {
             const string restart_status = path+"/restart.status";
             ofstream status(restart_status.c_str());
             
-            status << t << " " << step_id;
+            status << setprecision(numeric_limits<double>::digits10 + 2) << t << " " << step_id;
 			
             printf( "time: %20.20e\n", t);
             printf( "stepid: %d\n", step_id);
         }
+		
+		//lossless wavelet files of all the channels: threshold 0, no half floats
+		if (parser("-checkpoint").asString("hdf") == "wavelet")
+		{
+			SerializerIO_WaveletCompression_MPI_SimpleBlocking<G, StreamerGridPointIterative> serializer;
+			
+			vector<int> channels;
+			vector<Real> thresholds(StreamerGridPointIterative::channels, 0);
+			
+			for(int c = 0; c < StreamerGridPointIterative::channels; ++c)
+				channels.push_back(c);
+			
+			serializer.Write(grid, path + "/data_restart_wavelet", channels, thresholds);
+			
+			if (isroot) cout << "done" <<endl;
+			
+			return;
+		}
         
 	{
 		char buf[1024];
@@ -126,12 +192,63 @@ public:
 			streamer.fill('0');
 			streamer<<step_id;
 			
-			mywaveletdumper.verbose();
-			mywaveletdumper.set_threshold(1e-2);
-			mywaveletdumper.Write<4>(grid, streamer.str());
-			mywaveletdumper.set_threshold(1e-3);
-			mywaveletdumper.Write<5>(grid, streamer.str());
-			//mywaveletdumper.Write<6>(grid, streamer.str());
+			const bool async = parser("-vpasync").asBool(false);
+			
+			if (async)
+			{
+				myasyncdumper.wait();
+				myasyncdumper.set_threads(parser("-vpasyncthreads").asInt(max(1, omp_get_max_threads() / 4)));
+			}
+			
+			SerializerIO_WaveletCompression_MPI_SimpleBlocking<G, StreamerGridPointIterative>& dumper = async ? myasyncdumper : mywaveletdumper;
+			
+			dumper.verbose();
+			
+			//-vpgroupsize N: one writer every N ranks, -vpsubfiles 1: one file per writer
+			dumper.set_aggregation(grid.getCartComm(), parser("-vpgroupsize").asInt(1), parser("-vpsubfiles").asBool(false));
+
+			if (parser.check("-vpencoder"))
+			{
+				const string encoder = parser("-vpencoder").asString();
+
+				if (parser.check("-vplevel"))
+					dumper.set_encoder(encoder, parser("-vplevel").asInt());
+				else
+					dumper.set_encoder(encoder);
+			}
+
+			//error-bounded mode: the thresholds become relative tolerances
+			const bool errorbound = parser.check("-vperrorbound");
+			const Real tolerance = parser("-vptolerance").asDouble(1e-3);
+
+			if (errorbound)
+				dumper.set_error_bound(parser("-vperrorbound").asString());
+
+			if (async || parser("-vpsinglepass").asBool(true))
+			{
+				//one sweep over the grid for all the channels
+				vector<int> channels;
+				vector<Real> thresholds;
+
+				channels.push_back(4); thresholds.push_back(errorbound ? tolerance : 1e-2);
+				channels.push_back(5); thresholds.push_back(errorbound ? tolerance : 1e-3);
+
+				if (parser("-vpbenchmark").asBool(false))
+					dumper.BenchmarkEncoders(grid, channels, thresholds);
+
+				if (async)
+					myasyncdumper.Write(grid, streamer.str(), channels, thresholds);
+				else
+					mywaveletdumper.Write(grid, streamer.str(), channels, thresholds);
+			}
+			else
+			{
+				mywaveletdumper.set_threshold(errorbound ? tolerance : 1e-2);
+				mywaveletdumper.Write<4>(grid, streamer.str());
+				mywaveletdumper.set_threshold(errorbound ? tolerance : 1e-3);
+				mywaveletdumper.Write<5>(grid, streamer.str());
+				//mywaveletdumper.Write<6>(grid, streamer.str());
+			}
 	
 //used for debug
 #if 0			
@@ -150,6 +267,39 @@ public:
 		}
     }
     
+	//to be called after every step, and vp_wait once the run is over
+	void vp_progress() { myasyncdumper.progress(); }
+	
+	void vp_wait() { myasyncdumper.wait(); }
+	
+	//coarsened previews of some channels, see Pyramid.h
+	void pyramid(G& grid, const int step_id)
+	{
+		if (!parser("-pyramid").asBool(false)) return;
+		
+		const string path = parser("-fpath").asString(".");
+		
+		std::stringstream streamer;
+		streamer<<path;
+		streamer<<"/";
+		streamer<<"datapyramid";
+		streamer.setf(ios::dec | ios::right);
+		streamer.width(5);
+		streamer.fill('0');
+		streamer<<step_id;
+		
+		const double t0 = MPI::Wtime();
+		
+		PyramidMPI<G, StreamerGridPointIterative> pyramid(parser("-pyramidlevels").asInt(3), _pyramid_channels());
+		pyramid.build(grid);
+		pyramid.write(grid, streamer.str());
+		
+		const double t1 = MPI::Wtime();
+		
+		if (isroot)
+			printf("Pyramid: %.2f kB in %.3f s\n", pyramid.bytes() / 1024., t1 - t0);
+	}
+	
 	void setup()
 	{
 		_setup_constants();
@@ -203,6 +353,9 @@ public:
 	
 	void dispose()
 	{
+		//a trace longer than the run
+		TraceProfilerMPI::flush();
+		
 		if (grid!=NULL)
 		{
 			delete grid;
@@ -0,0 +1,109 @@
+/*
+ *  TraceProfilerMPI.h
+ *  MPCFcluster
+ *
+ *  The TraceProfiler of every rank in one Chrome trace file: each rank is a process.
+ *
+ */
+
+#pragma once
+
+#include <mpi.h>
+#include <algorithm>
+
+#include <TraceProfiler.h>
+
+namespace TraceProfilerMPI
+{
+	//the trace being recorded: where flush writes it
+	struct Pending
+	{
+		MPI::Intracomm comm;
+		string filename;
+	};
+
+	inline Pending& pending()
+	{
+		static Pending p;
+		return p;
+	}
+
+	//after the barrier the timestamps of the ranks start together
+	inline void enable(const MPI::Intracomm& comm, const string filename)
+	{
+		TraceProfiler::instance().clear();
+
+		pending().comm = comm;
+		pending().filename = filename;
+
+		comm.Barrier();
+
+		TraceProfiler::instance().enable();
+	}
+
+	//collective: every rank writes its events at the offset given by the ranks before it
+	inline void write(const MPI::Intracomm& comm, const string filename)
+	{
+		TraceProfiler& profiler = TraceProfiler::instance();
+
+		const int myrank = comm.Get_rank();
+		const int nranks = comm.Get_size();
+
+		const string head = "{\"traceEvents\":[\n";
+		const string tail = "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+		//every rank has at least its process name, the last one drops its last comma
+		const string events = profiler.json(myrank);
+		const size_t mybytes = events.size() - (myrank == nranks - 1 ? 2 : 0);
+
+		size_t myoffset = 0;
+		comm.Exscan(&mybytes, &myoffset, 1, MPI_UINT64_T, MPI::SUM);
+
+		if (myrank == 0)
+			myoffset = 0;
+
+		MPI::File f = MPI::File::Open(comm, filename.c_str(), MPI::MODE_WRONLY | MPI::MODE_CREATE, MPI::INFO_NULL);
+		f.Set_size(0);
+
+		//MPI counts are int: pieces of at most 1 GB, the same number of calls on all the ranks
+		enum { MAXPIECE = 1 << 30 };
+
+		const size_t mypieces = (mybytes + MAXPIECE - 1) / MAXPIECE;
+		size_t npieces = 0;
+		comm.Allreduce(&mypieces, &npieces, 1, MPI_UINT64_T, MPI::MAX);
+
+		for(size_t p = 0; p < npieces; ++p)
+		{
+			const size_t start = min(mybytes, p * MAXPIECE);
+
+			f.Write_at_all(head.size() + myoffset + start, events.c_str() + start, (int)min(mybytes - start, (size_t)MAXPIECE), MPI::CHAR);
+		}
+
+		if (myrank == 0)
+			f.Write_at(0, head.c_str(), head.size(), MPI::CHAR);
+
+		if (myrank == nranks - 1)
+		{
+			f.Write_at(head.size() + myoffset + mybytes, tail.c_str(), tail.size(), MPI::CHAR);
+
+			printf("Trace: %d ranks, %.2f MB in %s\n", nranks, (myoffset + mybytes) / 1024. / 1024, filename.c_str());
+		}
+
+		f.Close();
+
+		profiler.clear();
+	}
+
+	//writes the trace being recorded, if any: at the end of the traced steps or 
+	//from dispose() if the run ended before. collective over the communicator of enable
+	inline void flush()
+	{
+		TraceProfiler& profiler = TraceProfiler::instance();
+
+		if (!profiler.is_enabled()) return;
+
+		profiler.disable();
+
+		write(pending().comm, pending().filename);
+	}
+}
@@ -8,6 +8,11 @@
  */
 
 #include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <unistd.h>
 #include <mpi.h>
 #ifdef _QPXEMU_
 #include <xmmintrin.h>
@@ -22,13 +27,53 @@
 #include "Test_ShockBubbleMPI.h"
 #include "Test_SICMPI.h"
 #include "Test_CloudMPI.h"
+#include "Test_ScalingMPI.h"
+
+#ifdef _USE_PERF_EVENT_
+#include "HPM_PerfEvent.h"
+#endif
 
 using namespace std;
 
 Simulation * sim = NULL;
 
+//-bs N: the block size is a compile-time constant, "make bsvariants" builds mpcf-cluster-bsN
+//next to mpcf-cluster for every N of bslist and here the process becomes the one of N
+void dispatch_blocksize(const int argc, const char ** argv)
+{
+	ArgumentParser parser(argc, argv);
+
+	if (!parser.check("-bs") || parser("-bs").asInt() == _BLOCKSIZE_) return;
+
+	char self[PATH_MAX];
+	const ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+
+	string base = n > 0 ? string(self, n) : string(argv[0]);
+
+	//mpcf-cluster-bs16 -bs 8 goes to mpcf-cluster-bs8
+	const size_t suffix = base.rfind("-bs");
+	if (suffix != string::npos && base.find_first_not_of("0123456789", suffix + 3) == string::npos)
+		base = base.substr(0, suffix);
+
+	const string target = base + "-bs" + parser("-bs").asString();
+
+	if (access(target.c_str(), X_OK) != 0)
+	{
+		printf("-bs %d: this build has blocks of %d and there is no %s (see make bsvariants). Aborting.\n",
+			   parser("-bs").asInt(), _BLOCKSIZE_, target.c_str());
+		exit(1);
+	}
+
+	execv(target.c_str(), const_cast<char * const *>(argv));
+
+	perror(target.c_str());
+	exit(1);
+}
+
 int main (int argc, const char ** argv) 
 {
+	dispatch_blocksize(argc, argv);
+	
 	MPI::Init();
 //	MPI::Init_thread(MPI_THREAD_MULTIPLE);
 	
@@ -53,8 +98,11 @@ int main (int argc, const char ** argv)
 	if (!isroot)
 		parser.mute();
 		
-	if (isroot)
+	if (isroot && parser.check("-dispatcher"))
 	  cout << "Dispatcher: " << parser("-dispatcher").asString() << endl;
+	
+	if (isroot && parser.check("-bs"))
+		cout << "Block size: " << _BLOCKSIZE_ << endl;
 
 	//Environment::setup(max(1, parser("-nthreads").asInt()));
 
@@ -66,6 +114,8 @@ int main (int argc, const char ** argv)
 		sim = new Test_SICMPI(isroot, argc, argv);
 	else if( parser("-sim").asString() == "cloud" )
 		sim = new Test_CloudMPI(isroot, argc, argv);
+	else if( parser("-sim").asString() == "scaling" )
+		sim = new Test_ScalingMPI(isroot, argc, argv);
 	else
 		if (isroot)
 		{
@@ -96,6 +146,15 @@ int main (int argc, const char ** argv)
 	
 	if (isroot)
 		printf("we spent: %2.2f \n", wallclock);
+
+#ifdef _USE_PERF_EVENT_
+	//counters of the root, the peaks are the ones of a node in GFLOP/s and GB/s
+	if (isroot)
+	{
+		parser.unset_strict_mode();
+		HPM_Report(parser("-hpmpeakperf").asDouble(0), parser("-hpmpeakbw").asDouble(0));
+	}
+#endif
 	
 	MPI::COMM_WORLD.Barrier();
 	MPI::Finalize();
@@ -22,7 +22,7 @@ using namespace std;
 Convection_CPP::Convection_CPP(const Real a, const Real dtinvh): a(a), dtinvh(dtinvh) { }
 
 void Convection_CPP::compute(const Real * const srcfirst, const int srcfloats, const int rowsrcs, const int slicesrcs,
-							 Real * const dstfirst, const int dstfloats, const int rowdsts, const int slicedsts)
+							 RealAcc * const dstfirst, const int dstfloats, const int rowdsts, const int slicedsts)
 {
 	for(int islice=0; islice<5; islice++)
 	{
@@ -357,22 +357,22 @@ void Convection_CPP::_xextraterm(const TempSOA& um, const TempSOA& up, const Tem
 {
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			divu.ref(ix, iy) = (ap(ix+1, iy)*um(ix+1, iy)-am(ix+1, iy)*up(ix+1, iy))/(ap(ix+1, iy)-am(ix+1, iy))-(ap(ix, iy)*um(ix, iy)-am(ix, iy)*up(ix, iy))/(ap(ix, iy)-am(ix, iy));
+			divu.ref(ix, iy) = (RealAcc)(ap(ix+1, iy)*um(ix+1, iy)-am(ix+1, iy)*up(ix+1, iy))/(ap(ix+1, iy)-am(ix+1, iy))-(ap(ix, iy)*um(ix, iy)-am(ix, iy)*up(ix, iy))/(ap(ix, iy)-am(ix, iy));
 	
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			sumG.ref(ix, iy) = Gp(ix, iy) + Gm(ix+1, iy);
+			sumG.ref(ix, iy) = (RealAcc)Gp(ix, iy) + Gm(ix+1, iy);
 	
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			sumP.ref(ix, iy) = Pp(ix, iy) + Pm(ix+1, iy);
+			sumP.ref(ix, iy) = (RealAcc)Pp(ix, iy) + Pm(ix+1, iy);
 }
 
 void Convection_CPP::_xextraterm_v2(const TempSOA& um, const TempSOA& up, const InputSOA& G, const InputSOA& P, const TempSOA& am, const TempSOA& ap)
 {
     for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			divu.ref(ix, iy) = (ap(ix+1, iy)*um(ix+1, iy)-am(ix+1, iy)*up(ix+1, iy))/(ap(ix+1, iy)-am(ix+1, iy))-(ap(ix, iy)*um(ix, iy)-am(ix, iy)*up(ix, iy))/(ap(ix, iy)-am(ix, iy));
+			divu.ref(ix, iy) = (RealAcc)(ap(ix+1, iy)*um(ix+1, iy)-am(ix+1, iy)*up(ix+1, iy))/(ap(ix+1, iy)-am(ix+1, iy))-(ap(ix, iy)*um(ix, iy)-am(ix, iy)*up(ix, iy))/(ap(ix, iy)-am(ix, iy));
 	
     for(int iy=0; iy<OutputSOA::NY; iy++)
 	{
@@ -393,22 +393,22 @@ void Convection_CPP::_yextraterm(const TempSOA& um, const TempSOA& up, const Tem
 {
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			divu.ref(ix, iy) += (ap(iy+1, ix)*um(iy+1, ix)-am(iy+1, ix)*up(iy+1, ix))/(ap(iy+1, ix)-am(iy+1, ix))-(ap(iy, ix)*um(iy, ix)-am(iy, ix)*up(iy, ix))/(ap(iy, ix)-am(iy, ix));
+			divu.ref(ix, iy) += (RealAcc)(ap(iy+1, ix)*um(iy+1, ix)-am(iy+1, ix)*up(iy+1, ix))/(ap(iy+1, ix)-am(iy+1, ix))-(ap(iy, ix)*um(iy, ix)-am(iy, ix)*up(iy, ix))/(ap(iy, ix)-am(iy, ix));
 	
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			sumG.ref(ix, iy) += Gp(iy, ix) + Gm(iy+1, ix);
+			sumG.ref(ix, iy) += (RealAcc)Gp(iy, ix) + Gm(iy+1, ix);
 	
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			sumP.ref(ix, iy) += Pp(iy, ix) + Pm(iy+1, ix);
+			sumP.ref(ix, iy) += (RealAcc)Pp(iy, ix) + Pm(iy+1, ix);
 }
 
 void Convection_CPP::_yextraterm_v2(const TempSOA& um, const TempSOA& up, const InputSOA& G, const InputSOA& P, const TempSOA& am, const TempSOA& ap)
 {
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			divu.ref(ix, iy) += (ap(iy+1, ix)*um(iy+1, ix)-am(iy+1, ix)*up(iy+1, ix))/(ap(iy+1, ix)-am(iy+1, ix))-(ap(iy, ix)*um(iy, ix)-am(iy, ix)*up(iy, ix))/(ap(iy, ix)-am(iy, ix));
+			divu.ref(ix, iy) += (RealAcc)(ap(iy+1, ix)*um(iy+1, ix)-am(iy+1, ix)*up(iy+1, ix))/(ap(iy+1, ix)-am(iy+1, ix))-(ap(iy, ix)*um(iy, ix)-am(iy, ix)*up(iy, ix))/(ap(iy, ix)-am(iy, ix));
     
     static const int L = InputSOA::PITCH;
     const Real * const inG = G.ptr(0,0);
@@ -433,15 +433,15 @@ void Convection_CPP::_zextraterm(const TempSOA& um0, const TempSOA& up0, const T
 {
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			divu.ref(ix, iy) += (ap1(ix, iy)*um1(ix, iy)-am1(ix, iy)*up1(ix, iy))/(ap1(ix, iy)-am1(ix, iy))-(ap0(ix, iy)*um0(ix, iy)-am0(ix, iy)*up0(ix, iy))/(ap0(ix, iy)-am0(ix, iy));
+			divu.ref(ix, iy) += (RealAcc)(ap1(ix, iy)*um1(ix, iy)-am1(ix, iy)*up1(ix, iy))/(ap1(ix, iy)-am1(ix, iy))-(ap0(ix, iy)*um0(ix, iy)-am0(ix, iy)*up0(ix, iy))/(ap0(ix, iy)-am0(ix, iy));
 	
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			sumG.ref(ix, iy) += Gp(ix, iy) + Gm(ix, iy);
+			sumG.ref(ix, iy) += (RealAcc)Gp(ix, iy) + Gm(ix, iy);
 	
 	for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			sumP.ref(ix, iy) += Pp(ix, iy) + Pm(ix, iy);
+			sumP.ref(ix, iy) += (RealAcc)Pp(ix, iy) + Pm(ix, iy);
 }
 
 void Convection_CPP::_zextraterm_v2(const TempSOA& um0, const TempSOA& up0, const TempSOA& um1, const TempSOA& up1,
@@ -450,7 +450,7 @@ void Convection_CPP::_zextraterm_v2(const TempSOA& um0, const TempSOA& up0, cons
 {
     for(int iy=0; iy<OutputSOA::NY; iy++)
 		for(int ix=0; ix<OutputSOA::NX; ix++)
-			divu.ref(ix, iy) += (ap1(ix, iy)*um1(ix, iy)-am1(ix, iy)*up1(ix, iy))/(ap1(ix, iy)-am1(ix, iy))-(ap0(ix, iy)*um0(ix, iy)-am0(ix, iy)*up0(ix, iy))/(ap0(ix, iy)-am0(ix, iy));
+			divu.ref(ix, iy) += (RealAcc)(ap1(ix, iy)*um1(ix, iy)-am1(ix, iy)*up1(ix, iy))/(ap1(ix, iy)-am1(ix, iy))-(ap0(ix, iy)*um0(ix, iy)-am0(ix, iy)*up0(ix, iy))/(ap0(ix, iy)-am0(ix, iy));
 	
     static const int L = InputSOA::PITCH;
     
@@ -631,21 +631,21 @@ void Convection_CPP::_hlle_e(const TempSOA& rm, const TempSOA& rp,
 void Convection_CPP::_xdivergence(const TempSOA& flux, OutputSOA& rhs)
 {
     const Real * const f = flux.ptr(0,0);
-    Real * const r = &rhs.ref(0,0);
+    RealAcc * const r = &rhs.ref(0,0);
     
     for(int iy=0; iy<OutputSOA::NY; iy++)
         for(int ix=0; ix<OutputSOA::NX; ix++)
-            r[ix + OutputSOA::PITCH*iy] = f[ix + 1 + TempSOA::PITCH*iy] - f[ix + TempSOA::PITCH*iy];
+            r[ix + OutputSOA::PITCH*iy] = (RealAcc)f[ix + 1 + TempSOA::PITCH*iy] - f[ix + TempSOA::PITCH*iy];
 }
 
 void Convection_CPP::_ydivergence(const TempSOA& flux, OutputSOA& rhs)
 {
     const Real * const f = flux.ptr(0,0);
-    Real * const r = &rhs.ref(0,0);
+    RealAcc * const r = &rhs.ref(0,0);
     
     for(int iy=0; iy<OutputSOA::NY; iy++)
         for(int ix=0; ix<OutputSOA::NX; ix++)
-            r[ix + OutputSOA::PITCH*iy] += f[iy +  1 + TempSOA::PITCH*ix] - f[iy + TempSOA::PITCH*ix];
+            r[ix + OutputSOA::PITCH*iy] += (RealAcc)f[iy +  1 + TempSOA::PITCH*ix] - f[iy + TempSOA::PITCH*ix];
 }
 
 void Convection_CPP::_zdivergence(const TempSOA& fback, const TempSOA& fforward, OutputSOA& rhs)
@@ -653,22 +653,22 @@ void Convection_CPP::_zdivergence(const TempSOA& fback, const TempSOA& fforward,
     const Real * const ff = fforward.ptr(0,0);
     const Real * const fb = fback.ptr(0,0);
     
-    Real * const r = &rhs.ref(0,0);
+    RealAcc * const r = &rhs.ref(0,0);
     
     for(int iy=0; iy<OutputSOA::NY; iy++)
         for(int ix=0; ix<OutputSOA::NX; ix++)
-             r[ix + OutputSOA::PITCH*iy] += ff[ix +  TempSOA::PITCH*iy] - fb[ix + TempSOA::PITCH*iy];
+             r[ix + OutputSOA::PITCH*iy] += (RealAcc)ff[ix +  TempSOA::PITCH*iy] - fb[ix + TempSOA::PITCH*iy];
  
 }
 
-void Convection_CPP::_copyback(Real * const gptfirst, const int gptfloats, const int rowgpts)
+void Convection_CPP::_copyback(RealAcc * const gptfirst, const int gptfloats, const int rowgpts)
 {
     const Real factor2 = ((Real)1.)/6;
     
     for(int iy=0; iy<OutputSOA::NY; iy++)
         for(int ix=0; ix<OutputSOA::NX; ix++)
         {
-            AssumedType& rhs = *(AssumedType*)(gptfirst + gptfloats*(ix + iy*rowgpts));
+            AssumedTempType& rhs = *(AssumedTempType*)(gptfirst + gptfloats*(ix + iy*rowgpts));
             
             assert(!isnan(rho.rhs(ix, iy)));
             assert(!isnan(u.rhs(ix, iy)));
@@ -25,7 +25,7 @@ public:
 	
 	//main method of the class, it evaluates the convection term of the RHS
 	void compute(const Real * const srcfirst, const int srcfloats, const int rowsrcs, const int slicesrcs,
-				 Real * const dstfirst, const int dstfloats, const int rowdsts, const int slicedsts);
+				 RealAcc * const dstfirst, const int dstfloats, const int rowdsts, const int slicedsts);
 	
 	//this provides the amount of flops and memory traffic performed in compute(.)
 	static void hpc_info(float& flop_convert, int& traffic_convert,
@@ -46,6 +46,7 @@ protected:
 	
 	//Assumed input/output grid point type
 	struct AssumedType { Real r, u, v, w, s, G, P, dummy; };
+	struct AssumedTempType { RealAcc r, u, v, w, s, G, P, dummy; };
 	
 	template<int zslices=2>
 	struct WorkingSet {
@@ -165,6 +166,6 @@ protected:
 	virtual void _yrhs();
 	virtual void _zrhs();
 	
-	virtual void _copyback(Real * const gptfirst, const int gptfloats, const int rowgpts);
+	virtual void _copyback(RealAcc * const gptfirst, const int gptfloats, const int rowgpts);
 };
 
@@ -25,7 +25,7 @@ public:
 	
 	//main method of the class, it evaluates the convection term of the RHS
 	void compute(const Real * const srcfirst, const int srcfloats, const int rowsrcs, const int slicesrcs,
-				 Real * const dstfirst, const int dstfloats, const int rowdsts, const int slicedsts);
+				 RealAcc * const dstfirst, const int dstfloats, const int rowdsts, const int slicedsts);
 	
 protected:
 
@@ -98,6 +98,6 @@ protected:
 	virtual void _zrhs();
 #endif
 	
-	virtual void _copyback(Real * const gptfirst, const int gptfloats, const int rowgpts);
+	virtual void _copyback(RealAcc * const gptfirst, const int gptfloats, const int rowgpts);
 #endif
 };
@@ -0,0 +1,160 @@
+/*
+ *  Float16.h
+ *  MPCFcore
+ *
+ *  IEEE half (fp16) and bfloat16 conversions, rounded to nearest even.
+ *  fp16 goes through F16C if the compiler targets it (-mf16c), the software path
+ *  handles the subnormals, inf and nan the same way.
+ *  With tmp16=f16 or tmp16=bf16 the RK register of the blocks is stored in 16 bits,
+ *  see FluidBlock in MPCFnode/source/Types.h.
+ *
+ */
+
+#pragma once
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+union Float16Bits
+{
+	float f;
+	unsigned int u;
+};
+
+inline unsigned short float_to_f16(const float x)
+{
+#ifdef __F16C__
+	return _cvtss_sh(x, 0);
+#else
+	Float16Bits b;
+	b.f = x;
+
+	const unsigned int sign = b.u & 0x80000000u;
+	b.u ^= sign;
+
+	unsigned short retval;
+
+	if (b.u >= (127 + 16) << 23) //inf or nan
+		retval = b.u > 255 << 23 ? 0x7e00 : 0x7c00;
+	else if (b.u < 113 << 23) //subnormal or zero, rounded by the addition
+	{
+		Float16Bits magic;
+		magic.u = 126 << 23;
+
+		b.f += magic.f;
+		retval = b.u - magic.u;
+	}
+	else
+	{
+		const unsigned int odd = (b.u >> 13) & 1;
+
+		b.u += ((15 - 127) << 23) + 0xfff + odd;
+		retval = b.u >> 13;
+	}
+
+	return retval | (sign >> 16);
+#endif
+}
+
+inline float f16_to_float(const unsigned short h)
+{
+#ifdef __F16C__
+	return _cvtsh_ss(h);
+#else
+	const unsigned int shifted_exp = 0x7c00 << 13;
+
+	Float16Bits b;
+	b.u = (h & 0x7fff) << 13;
+
+	const unsigned int e = b.u & shifted_exp;
+	b.u += (127 - 15) << 23;
+
+	if (e == shifted_exp) //inf or nan
+		b.u += (128 - 16) << 23;
+	else if (e == 0) //subnormal or zero
+	{
+		Float16Bits magic;
+		magic.u = 113 << 23;
+
+		b.u += 1 << 23;
+		b.f -= magic.f;
+	}
+
+	b.u |= (h & 0x8000) << 16;
+
+	return b.f;
+#endif
+}
+
+inline unsigned short float_to_bf16(const float x)
+{
+	Float16Bits b;
+	b.f = x;
+
+	return (b.u + 0x7fff + ((b.u >> 16) & 1)) >> 16;
+}
+
+inline float bf16_to_float(const unsigned short h)
+{
+	Float16Bits b;
+	b.u = h << 16;
+
+	return b.f;
+}
+
+//n values, 8 at a time with F16C
+inline void f16_to_float(const unsigned short * const src, float * const dst, const int n)
+{
+	int i = 0;
+#ifdef __F16C__
+	for(; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+#endif
+	for(; i < n; ++i)
+		dst[i] = f16_to_float(src[i]);
+}
+
+inline void float_to_f16(const float * const src, unsigned short * const dst, const int n)
+{
+	int i = 0;
+#ifdef __F16C__
+	for(; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0));
+#endif
+	for(; i < n; ++i)
+		dst[i] = float_to_f16(src[i]);
+}
+
+inline void bf16_to_float(const unsigned short * const src, float * const dst, const int n)
+{
+	for(int i = 0; i < n; ++i)
+		dst[i] = bf16_to_float(src[i]);
+}
+
+inline void float_to_bf16(const float * const src, unsigned short * const dst, const int n)
+{
+	for(int i = 0; i < n; ++i)
+		dst[i] = float_to_bf16(src[i]);
+}
+
+//the 16-bit format of the RK register
+#if defined(_TMP_F16_) && defined(_TMP_BF16_)
+#error CHOOSE ONE OF _TMP_F16_ AND _TMP_BF16_
+#endif
+
+#if defined(_TMP_F16_) || defined(_TMP_BF16_)
+#define _HALF_TMP_
+
+#ifdef _TMP_F16_
+inline unsigned short tmp_encode(const float x) { return float_to_f16(x); }
+inline float tmp_decode(const unsigned short h) { return f16_to_float(h); }
+inline void tmp_encode(const float * const src, unsigned short * const dst, const int n) { float_to_f16(src, dst, n); }
+inline void tmp_decode(const unsigned short * const src, float * const dst, const int n) { f16_to_float(src, dst, n); }
+#else
+inline unsigned short tmp_encode(const float x) { return float_to_bf16(x); }
+inline float tmp_decode(const unsigned short h) { return bf16_to_float(h); }
+inline void tmp_encode(const float * const src, unsigned short * const dst, const int n) { float_to_bf16(src, dst, n); }
+inline void tmp_decode(const unsigned short * const src, float * const dst, const int n) { bf16_to_float(src, dst, n); }
+#endif
+#endif
@@ -0,0 +1,275 @@
+/*
+ *  HPM_PerfEvent.cpp
+ *  MPCFcore
+ *
+ *  The counters are opened by each OpenMP thread on itself, user space only
+ *  (it works with perf_event_paranoid = 2), and read by the master at the hooks.
+ *  The events missing on the machine are reported as n/a.
+ *
+ */
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <omp.h>
+
+#include <Timer.h>
+
+#include "HPM_PerfEvent.h"
+
+using namespace std;
+
+namespace
+{
+	//what a region accumulates, the FP events are summed into FLOP
+	enum { CYCLES, INSTRUCTIONS, FLOP, L1MISSES, L2MISSES, LLCMISSES, TASKCLOCK, NSLOTS };
+
+	const char * slotnames[NSLOTS] = { "cycles", "instructions", "flop", "L1D-misses", "L2-misses", "LLC-misses", "task-clock" };
+
+	enum { CACHELINE = 64 };
+
+	struct Event
+	{
+		uint32_t type;
+		uint64_t config;
+		int slot;
+		double weight;
+	};
+
+	struct Region
+	{
+		int calls;
+		double time;
+		Timer timer;
+		double start[NSLOTS], total[NSLOTS];
+
+		Region(): calls(0), time(0)
+		{
+			std::fill(start, start + NSLOTS, 0.);
+			std::fill(total, total + NSLOTS, 0.);
+		}
+	};
+
+	bool initialized = false;
+	int nthreads = 0;
+
+	vector<Event> events;
+	vector< vector<int> > fds; //[thread][event]
+	bool available[NSLOTS];
+
+	map<string, Region> regions;
+	vector<string> order; //of the first start
+
+	long _perf_event_open(perf_event_attr * attr)
+	{
+		return syscall(__NR_perf_event_open, attr, 0, -1, -1, 0);
+	}
+
+	void _add_event(const uint32_t type, const uint64_t config, const int slot, const double weight = 1)
+	{
+		const Event e = { type, config, slot, weight };
+		events.push_back(e);
+	}
+
+	//"0x02c7:1,0x20c7:8" -> raw events with their weights
+	void _add_raw_events(const char * const env, const int slot)
+	{
+		const char * s = getenv(env);
+
+		while (s != NULL && *s != '\0')
+		{
+			char * end = NULL;
+			const uint64_t config = strtoull(s, &end, 0);
+			double weight = 1;
+
+			if (*end == ':')
+				weight = strtod(end + 1, &end);
+
+			_add_event(PERF_TYPE_RAW, config, slot, weight);
+
+			s = strchr(end, ',');
+			if (s != NULL) ++s;
+		}
+	}
+
+	int _open(const Event& e)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+
+		attr.size = sizeof(attr);
+		attr.type = e.type;
+		attr.config = e.config;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		return _perf_event_open(&attr);
+	}
+
+	//scaled by the time on the PMU, the events are multiplexed if they do not fit
+	double _read(const int fd)
+	{
+		uint64_t buf[3];
+
+		if (fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf)) return 0;
+
+		return buf[2] > 0 ? buf[0] * (double)buf[1] / buf[2] : 0;
+	}
+
+	void _sample(double values[NSLOTS])
+	{
+		std::fill(values, values + NSLOTS, 0.);
+
+		for(int t = 0; t < nthreads; ++t)
+			for(int i = 0; i < events.size(); ++i)
+				values[events[i].slot] += events[i].weight * _read(fds[t][i]);
+	}
+
+	void _print_value(const bool valid, const double value, const char * const format)
+	{
+		if (valid)
+			printf(format, value);
+		else
+			printf(" %8s", "n/a");
+	}
+}
+
+extern "C" void HPM_Init(void)
+{
+	if (initialized) return;
+
+	const uint64_t l1dmiss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+	_add_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, CYCLES);
+	_add_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, INSTRUCTIONS);
+	_add_event(PERF_TYPE_HW_CACHE, l1dmiss, L1MISSES);
+	_add_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, LLCMISSES);
+	_add_event(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, TASKCLOCK);
+	_add_raw_events("HPM_FP_RAW", FLOP);
+	_add_raw_events("HPM_L2_RAW", L2MISSES);
+
+	nthreads = omp_get_max_threads();
+	fds.resize(nthreads, vector<int>(events.size(), -1));
+
+#pragma omp parallel num_threads(nthreads)
+	{
+		const int tid = omp_get_thread_num();
+
+		for(int i = 0; i < events.size(); ++i)
+			fds[tid][i] = _open(events[i]);
+	}
+
+	//a slot is valid only if all its events are counted on all threads
+	std::fill(available, available + NSLOTS, false);
+
+	for(int i = 0; i < events.size(); ++i)
+		available[events[i].slot] = true;
+
+	for(int t = 0; t < nthreads; ++t)
+		for(int i = 0; i < events.size(); ++i)
+			if (fds[t][i] < 0)
+				available[events[i].slot] = false;
+
+	initialized = true;
+}
+
+extern "C" void HPM_Start(const char * name)
+{
+	HPM_Init();
+
+	if (regions.find(name) == regions.end())
+		order.push_back(name);
+
+	Region& r = regions[name];
+
+	_sample(r.start);
+	r.timer.start();
+}
+
+extern "C" void HPM_Stop(const char * name)
+{
+	assert(regions.find(name) != regions.end());
+
+	Region& r = regions[name];
+
+	const double t = r.timer.stop();
+
+	double now[NSLOTS];
+	_sample(now);
+
+	for(int s = 0; s < NSLOTS; ++s)
+		r.total[s] += now[s] - r.start[s];
+
+	r.time += t;
+	r.calls++;
+}
+
+extern "C" void HPM_Print(void)
+{
+	HPM_Report();
+}
+
+void HPM_Report(const double peakgflops, const double peakgbs)
+{
+	if (!initialized) return;
+
+	printf("HPM perf_event: %d threads, counting", nthreads);
+	for(int s = 0; s < NSLOTS; ++s)
+		if (available[s]) printf(" %s", slotnames[s]);
+	printf("\n");
+
+	if (peakgflops > 0 && peakgbs > 0)
+		printf("HPM roofline: peak %.1f GFLOP/s, %.1f GB/s, ridge at %.2f FLOP/B\n", peakgflops, peakgbs, peakgflops / peakgbs);
+
+	printf("%-20s %6s %9s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "region", "calls", "time[s]", "cpu[s]",
+		   "GHz", "IPC", "GFLOP/s", "L1/KI", "L2/KI", "LLC/KI", "DRAMGB/s", "FLOP/B", "roof[%]");
+
+	for(int i = 0; i < order.size(); ++i)
+	{
+		const Region& r = regions[order[i]];
+
+		if (r.calls == 0) continue;
+
+		const double * v = r.total;
+		const double kinstr = v[INSTRUCTIONS] * 1e-3;
+		const double dram = v[LLCMISSES] * CACHELINE;
+
+		const bool hasinstr = available[INSTRUCTIONS] && kinstr > 0;
+		const bool hasai = available[FLOP] && available[LLCMISSES] && dram > 0;
+
+		printf("%-20s %6d %9.3f", order[i].c_str(), r.calls, r.time);
+
+		_print_value(available[TASKCLOCK], v[TASKCLOCK] * 1e-9, " %8.3f");
+		_print_value(available[CYCLES] && available[TASKCLOCK] && v[TASKCLOCK] > 0, v[CYCLES] / v[TASKCLOCK], " %8.2f");
+		_print_value(available[CYCLES] && hasinstr && v[CYCLES] > 0, v[INSTRUCTIONS] / v[CYCLES], " %8.2f");
+		_print_value(available[FLOP], v[FLOP] / r.time * 1e-9, " %8.2f");
+		_print_value(available[L1MISSES] && hasinstr, v[L1MISSES] / kinstr, " %8.2f");
+		_print_value(available[L2MISSES] && hasinstr, v[L2MISSES] / kinstr, " %8.2f");
+		_print_value(available[LLCMISSES] && hasinstr, v[LLCMISSES] / kinstr, " %8.2f");
+		_print_value(available[LLCMISSES], dram / r.time * 1e-9, " %8.2f");
+		_print_value(hasai, v[FLOP] / dram, " %8.2f");
+
+		//achieved over attainable performance at the measured arithmetic intensity
+		if (hasai && peakgflops > 0 && peakgbs > 0)
+		{
+			const double ai = v[FLOP] / dram;
+			const double attainable = min(peakgflops, ai * peakgbs);
+
+			printf(" %8.1f %s", 100 * v[FLOP] / r.time * 1e-9 / attainable, ai < peakgflops / peakgbs ? "memory-bound" : "compute-bound");
+		}
+		else
+			printf(" %8s", "n/a");
+
+		printf("\n");
+	}
+}
@@ -0,0 +1,24 @@
+/*
+ *  HPM_PerfEvent.h
+ *  MPCFcore
+ *
+ *  The HPM_Start/HPM_Stop hooks on Linux, with the perf_event counters of every OpenMP thread.
+ *  Each hooked region accumulates cycles, instructions, FP operations, cache misses and DRAM traffic,
+ *  the report places the regions on the roofline of the node.
+ *
+ *  Environment (the FP and L2 events are not part of the generic perf events):
+ *  HPM_FP_RAW  = "0x01c7:1,0x02c7:1,0x04c7:2,0x08c7:4,0x10c7:4,0x20c7:8" raw events and their flops per count
+ *  HPM_L2_RAW  = "0x3f24" raw event of the L2 misses
+ *  the DRAM bytes are the LLC misses times the cache line.
+ *
+ */
+
+#pragma once
+
+extern "C" void HPM_Init(void);
+extern "C" void HPM_Start(const char *);
+extern "C" void HPM_Stop(const char *);
+extern "C" void HPM_Print(void);
+
+//peaks of the whole node in GFLOP/s and GB/s, zero skips the roofline
+void HPM_Report(const double peakgflops = 0, const double peakgbs = 0);
@@ -53,3 +53,43 @@ Real MaxSpeedOfSound_CPP::compute(const Real * const src, const int gptfloats) c
     
 	return sos;
 }
+
+#ifdef _SOA_BLOCK_
+Real MaxSpeedOfSound_CPP::compute_soa(const Real * const src) const
+{
+	const int N=_BLOCKSIZE_*_BLOCKSIZE_*_BLOCKSIZE_;
+
+	const Real * const rho = src;
+	const Real * const ru = src + N;
+	const Real * const rv = src + 2*N;
+	const Real * const rw = src + 3*N;
+	const Real * const energy = src + 4*N;
+	const Real * const G = src + 5*N;
+	const Real * const P = src + 6*N;
+
+	Real sos = 0;
+
+	for(int i=0; i<N; ++i)
+	{
+		const Real r = rho[i];
+		const Real u = ru[i];
+		const Real v = rv[i];
+		const Real w = rw[i];
+		const Real e = energy[i];
+
+		assert(r>0);
+		assert(e>0);
+
+		const Real p = (e - (u*u + v*v + w*w)*(0.5/r) - P[i])/G[i];
+
+		const Real c = sqrt(((p+P[i])/G[i]+p)/r);
+
+		assert(!isnan(p));
+		assert(c > 0 && !isnan(c));
+
+		sos = max(sos, c + max(max(abs(u), abs(v)), abs(w))/r);
+	}
+
+	return sos;
+}
+#endif
@@ -17,6 +17,11 @@ class MaxSpeedOfSound_CPP
 {
 public:
 	Real compute(const Real * const src, const int gptfloats) const;
+
+#ifdef _SOA_BLOCK_
+	//src: one array per quantity
+	Real compute_soa(const Real * const src) const;
+#endif
 	
 	static void printflops(const float PEAKPERF_CORE, const float PEAKBAND, const int NCORES, const int NT, const int NBLOCKS, float MEASUREDTIME, const bool bAwk=false)
 	{
@@ -15,6 +15,11 @@
 
 #include "common.h"
 
+//extra aligned chunks at the end of every row, against the cache conflicts of the power-of-two pitches
+#ifndef _SOAPAD_
+#define _SOAPAD_ 0
+#endif
+
 template < int _SX, int _EX, int _SY, int _EY, typename TReal=Real > 
 #ifdef __xlC__
 __align(_ALIGNBYTES_)  
@@ -28,7 +33,7 @@ struct SOA2D
 	static const int NX = _EX - _SX;
 	static const int NY = _EY - _SY;
 	
-	static const int PITCH = EX - SX;
+	static const int PITCH = EX - SX + _SOAPAD_*_CPERALIGNBYTES;
 	
 	__attribute__((aligned(_ALIGNBYTES_))) TReal data[NY][PITCH];
 	
@@ -104,4 +109,4 @@ struct RingSOA2D
 	}
 };
 
-typedef SOA2D<0, _BLOCKSIZE_, 0, _BLOCKSIZE_> OutputSOA;
+typedef SOA2D<0, _BLOCKSIZE_, 0, _BLOCKSIZE_, RealAcc> OutputSOA;
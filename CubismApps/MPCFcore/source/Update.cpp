@@ -15,7 +15,7 @@
 #include "common.h"
 #include "Update.h"
 
-void Update_CPP::compute(const Real * const src, Real * const dst, const int gptfloats) const
+void Update_CPP::compute(const RealAcc * const src, Real * const dst, const int gptfloats) const
 {
 	assert(gptfloats >= 7);
 	
@@ -31,7 +31,8 @@ void Update_CPP::compute(const Real * const src, Real * const dst, const int gpt
             //if (isnan(src[i+comp]))
               //  printf("src isnan component after update is %d, i=%d\n", comp, i);
             
-            dst[i+comp] += m_b * src[i+comp];
+            //the sum in RealAcc, rounded once to the storage
+            dst[i+comp] = (RealAcc)dst[i+comp] + m_b * src[i+comp];
             
             assert(!isnan(src[i+comp]));
             assert(!isnan(dst[i+comp]));
@@ -40,3 +41,84 @@ void Update_CPP::compute(const Real * const src, Real * const dst, const int gpt
         //assert(dst[i+4]>0);
     }
 }
+
+#ifdef _HALF_TMP_
+void Update_CPP::compute(const unsigned short * const src, const float * const scale, Real * const dst, const int gptfloats) const
+{
+	assert(gptfloats >= 7);
+
+	enum { NQUANTITIES = 7, ROW = _BLOCKSIZE_ * NQUANTITIES };
+
+	RealAcc bscale[NQUANTITIES];
+	for(int comp = 0; comp < NQUANTITIES; comp++)
+		bscale[comp] = m_b * scale[comp];
+
+	//one row of the block decoded at a time
+	float decoded[ROW];
+
+	for(int r=0; r<_BLOCKSIZE_ * _BLOCKSIZE_; r++)
+	{
+		tmp_decode(src + r * ROW, decoded, ROW);
+
+		for(int ix=0; ix<_BLOCKSIZE_; ix++)
+		{
+			const float * const s = decoded + ix * NQUANTITIES;
+			Real * const d = dst + (r * _BLOCKSIZE_ + ix) * gptfloats;
+
+			for(int comp = 0; comp < NQUANTITIES; comp++)
+			{
+				d[comp] = (RealAcc)d[comp] + bscale[comp] * s[comp];
+
+				assert(!isnan(d[comp]));
+			}
+		}
+	}
+}
+#endif
+
+#ifdef _SOA_BLOCK_
+void Update_CPP::compute_soa(const RealAcc * const src, Real * const dst, const int gptfloats) const
+{
+	assert(gptfloats >= 7);
+
+	const int N = _BLOCKSIZE_ * _BLOCKSIZE_ * _BLOCKSIZE_;
+
+	for(int comp = 0; comp < 7; comp++)
+	{
+		Real * const d = dst + comp * N;
+
+		for(int i=0; i<N; i++)
+			d[i] = (RealAcc)d[i] + m_b * src[i * gptfloats + comp];
+	}
+}
+
+#ifdef _HALF_TMP_
+void Update_CPP::compute_soa(const unsigned short * const src, const float * const scale, Real * const dst, const int gptfloats) const
+{
+	assert(gptfloats >= 7);
+
+	enum { NQUANTITIES = 7, ROW = _BLOCKSIZE_ * NQUANTITIES };
+
+	const int N = _BLOCKSIZE_ * _BLOCKSIZE_ * _BLOCKSIZE_;
+
+	RealAcc bscale[NQUANTITIES];
+	for(int comp = 0; comp < NQUANTITIES; comp++)
+		bscale[comp] = m_b * scale[comp];
+
+	float decoded[ROW];
+
+	for(int r=0; r<_BLOCKSIZE_ * _BLOCKSIZE_; r++)
+	{
+		tmp_decode(src + r * ROW, decoded, ROW);
+
+		for(int comp = 0; comp < NQUANTITIES; comp++)
+		{
+			Real * const d = dst + comp * N + r * _BLOCKSIZE_;
+
+			for(int ix=0; ix<_BLOCKSIZE_; ix++)
+				d[ix] = (RealAcc)d[ix] + bscale[comp] * decoded[ix * NQUANTITIES + comp];
+		}
+	}
+}
+#endif
+#endif
@@ -28,7 +28,20 @@ public:
 	
 	Update_CPP(Real b=1): m_b(b) {}
 	
-	void compute(const Real * const src, Real * const dst, const int gptfloats) const;
+	void compute(const RealAcc * const src, Real * const dst, const int gptfloats) const;
+
+#ifdef _HALF_TMP_
+	//src: 7 values per point in 16 bits, scale: one per quantity
+	void compute(const unsigned short * const src, const float * const scale, Real * const dst, const int gptfloats) const;
+#endif
+
+#ifdef _SOA_BLOCK_
+	//dst: one array per quantity
+	void compute_soa(const RealAcc * const src, Real * const dst, const int gptfloats) const;
+#ifdef _HALF_TMP_
+	void compute_soa(const unsigned short * const src, const float * const scale, Real * const dst, const int gptfloats) const;
+#endif
+#endif
 	
 	static void printflops(const float PEAKPERF_CORE, const float PEAKBAND, const size_t NCORES, const size_t NT, const size_t NBLOCKS, const float MEASUREDTIME, const bool bAwk=false)
 	{
@@ -26,6 +26,28 @@ typedef float Real;
 typedef double Real;
 #endif
 
+//right-hand sides and RK register: double in the mixed-precision mode (ap=mixed), Real otherwise
+#ifdef _MIXED_PRECISION_
+#if defined(_QPX_) || defined(_QPXEMU_)
+#error MIXED PRECISION IS NOT SUPPORTED BY THE QPX KERNELS
+#endif
+typedef double RealAcc;
+#else
+typedef Real RealAcc;
+#endif
+
+//RK register in 16 bits (tmp16=f16 or tmp16=bf16)
+#include "Float16.h"
+
+#if defined(_HALF_TMP_) && (defined(_QPX_) || defined(_QPXEMU_))
+#error THE 16-BIT RK REGISTER IS NOT SUPPORTED BY THE QPX KERNELS
+#endif
+
+//one array per quantity in the blocks (layout=soa), the labs stay AoS
+#if defined(_SOA_BLOCK_) && (defined(_QPX_) || defined(_QPXEMU_))
+#error THE SOA BLOCK LAYOUT IS NOT SUPPORTED BY THE QPX KERNELS
+#endif
+
 #ifndef _PREC_LEVEL_
 static const int preclevel = 0;
 #else
@@ -15,11 +15,18 @@
 #include <omp.h>
 
 #ifdef _USE_HPM_
+#ifdef _USE_PERF_EVENT_
+//the perf_event hooks need no MPI, mpcf-core stays serial
+#include "HPM_PerfEvent.h"
+#define MPI_Init(a,b)
+#define MPI_Finalize()
+#else
 #include <mpi.h>
-extern "C" void HPM_Start(char *);
-extern "C" void HPM_Stop(char *);
+extern "C" void HPM_Start(const char *);
+extern "C" void HPM_Stop(const char *);
 //extern "C" void HPM_Init(void);
 //extern "C" void HPM_Print(void);
+#endif
 #else
 #define HPM_Start(x)
 #define HPM_Stop(x)
@@ -140,7 +147,11 @@ int main (int argc, const char ** argv)
 	//C++ kernels
 	{
 		if (kernel == "Convection_CPP" || kernel == "all")
-			testing(Test_Convection(), Convection_CPP(0, 1), info);		
+		{
+			HPM_Start("Convection_CPP");
+			testing(Test_Convection(), Convection_CPP(0, 1), info);
+			HPM_Stop("Convection_CPP");
+		}
 		
 		//this one does not pass the accuracy test
 		//if (kernel == "Convection_CPP_omp" || kernel == "all")
@@ -198,6 +209,11 @@ int main (int argc, const char ** argv)
 	}
 #endif
 		
+#ifdef _USE_PERF_EVENT_
+	//-pp and -pb are per core
+	HPM_Report(info.peakperf * omp_get_max_threads(), info.peakbandwidth * omp_get_max_threads());
+#endif
+
 #ifdef _USE_HPM_
 	MPI_Finalize();
 #endif
@@ -0,0 +1,44 @@
+#!/bin/bash
+# usage: mixedcheck.sh [step] [make options]
+# builds mpcf-node with ap=float, ap=mixed and ap=double, runs the same shock-bubble on one thread
+# and compares the integrals of _dumpStatistics (integrals.dat) at the given step (default 60):
+# mixed must be at least as close to double as float is, for rho, rho*u and E.
+# the runs stay in mixedcheck.runs
+STEP=${1:-60}; shift
+MAKEARGS="$@"
+
+RUNDIR=mixedcheck.runs
+rm -rf $RUNDIR
+
+for AP in float mixed double
+do
+	#the core kernels are built with the precision too
+	make cleanall > /dev/null
+	make ap=$AP $MAKEARGS > /dev/null 2>&1 || { echo "ap=$AP: build failed"; exit 1; }
+
+	mkdir -p $RUNDIR/$AP
+	(cd $RUNDIR/$AP && OMP_NUM_THREADS=1 ../../mpcf-node -sim sb -bpdx 2 -bpdy 2 -bpdz 2 -tend 10 -cfl 0.3 -mollfactor 1 \
+		-saveperiod 100000 -dumpperiod 100000 -mach 1.2 -shockpos 0.2 -bubx 0.5 -buby 0.5 -bubz 0.5 -rad 0.2 \
+		-nsteps $((STEP + 1)) > log 2>&1) || { echo "ap=$AP: run failed, see $RUNDIR/$AP/log"; exit 1; }
+
+	# step, then rho, rho*u and E (columns 4, 5 and 8)
+	awk -v s=$STEP -v ap=$AP '$1 == s { print ap, $4, $5, $8 }' $RUNDIR/$AP/integrals.dat >> $RUNDIR/integrals
+done
+
+make cleanall > /dev/null
+
+awk 'BEGIN { printf "%-7s %-14s %-14s %-14s\n", "ap", "rho", "rho*u", "E" }
+	{ printf "%-7s %-14s %-14s %-14s\n", $1, $2, $3, $4; for(i = 2; i <= 4; ++i) v[$1, i] = $i }
+	END {
+		if (NR != 3) { print "FAIL: step not reached by every run"; exit 1 }
+		split("rho rho*u E", names)
+		for(i = 2; i <= 4; ++i)
+		{
+			ef = v["float", i] - v["double", i]; if (ef < 0) ef = -ef
+			em = v["mixed", i] - v["double", i]; if (em < 0) em = -em
+			printf "%-6s |float - double| %.3e  |mixed - double| %.3e\n", names[i - 1], ef, em
+			if (em > ef) fail = 1
+		}
+		if (fail) { print "FAIL: mixed is further from double than float"; exit 1 }
+		print "OK"
+	}' $RUNDIR/integrals
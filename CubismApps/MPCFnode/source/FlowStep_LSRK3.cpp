@@ -36,9 +36,13 @@
 #include <MaxSpeedOfSound.h>
 
 #ifdef _USE_HPM_
+#ifdef _USE_PERF_EVENT_
+#include "HPM_PerfEvent.h"
+#else
 #include <mpi.h>
-extern "C" void HPM_Start(char *);
-extern "C" void HPM_Stop(char *);
+extern "C" void HPM_Start(const char *);
+extern "C" void HPM_Stop(const char *);
+#endif
 #else
 #define HPM_Start(x)
 #define HPM_Stop(x)
@@ -79,12 +83,14 @@ void _process(const Real a, const Real dtinvh, vector<BlockInfo>& myInfo, FluidG
 	double total_time[NTH];
 
 	static Lab * labs = NULL;
+	static RHSWork * works = NULL;
 
 	if (labs == NULL)
 	{
 		printf("allocating %d labs\n", NTH); fflush(0);
 
 		labs = new Lab[NTH];
+		works = new RHSWork[NTH];
 		for(int i = 0; i < NTH; ++i)
 			labs[i].prepare(grid, stencil_start, stencil_end, tensorial);
 	}
@@ -119,10 +125,7 @@ void _process(const Real a, const Real dtinvh, vector<BlockInfo>& myInfo, FluidG
             const int labSizeRow = mylab.template getActualSize<0>();
             const int labSizeSlice = labSizeRow*mylab.template getActualSize<1>();
 			
-			Real * const destfirst = &((FluidBlock*)ary[i].ptrBlock)->tmp[0][0][0][0];
-			
-			kernel.compute(srcfirst, FluidBlock::gptfloats, labSizeRow, labSizeSlice, 
-						   destfirst, FluidBlock::gptfloats, FluidBlock::sizeX, FluidBlock::sizeX*FluidBlock::sizeY);
+			((FluidBlock*)ary[i].ptrBlock)->rhs(kernel, works[tid], a == 0, srcfirst, labSizeRow, labSizeSlice);
 		}
 		
 #pragma omp single
@@ -174,7 +177,7 @@ Real _computeSOS_OMP(FluidGrid& grid,  bool bAwk)
         for (int i=0; i<N; ++i)
         {
             FluidBlock & block = *(FluidBlock *)ary[i].ptrBlock;
-            local_sos[i] =  kernel.compute(&block.data[0][0][0].rho, FluidBlock::gptfloats);
+            local_sos[i] =  block.sos(kernel);
         }
     }
 	
@@ -251,7 +254,7 @@ Real _computeSOS_OMP(FluidGrid& grid,  bool bAwk)
         for (size_t i=0; i<N; ++i)
         {
             FluidBlock & block = *(FluidBlock *)ary[i].ptrBlock;
-            global_sos =  kernel.compute(&block.data[0][0][0].rho, FluidBlock::gptfloats);
+            global_sos =  block.sos(kernel);
         }
     }
 
@@ -38,6 +38,9 @@ namespace LSRK3data
 		
 		Real a, dtinvh;
 		
+		//the copy of each thread has its own
+		mutable RHSWork work;
+		
 		int stencil_start[3];
 		int stencil_end[3];
 		
@@ -60,10 +63,8 @@ namespace LSRK3data
 			const Real * const srcfirst = &lab(-3,-3,-3).rho;
 			const int labSizeRow = lab.template getActualSize<0>();
 			const int labSizeSlice = labSizeRow*lab.template getActualSize<1>();
-			Real * const destfirst = &o.tmp[0][0][0][0];
 			
-			kernel.compute(srcfirst, FluidBlock::gptfloats, labSizeRow, labSizeSlice, 
-						   destfirst, FluidBlock::gptfloats, FluidBlock::sizeX, FluidBlock::sizeX*FluidBlock::sizeY);
+			o.rhs(kernel, work, a == 0, srcfirst, labSizeRow, labSizeSlice);
 		}
 	};
 	    
@@ -93,7 +94,7 @@ namespace LSRK3data
                 for(int r=0; r<N; ++r)
                 {
                     FluidBlock & block = *(FluidBlock *)ary[r].ptrBlock;
-                    kernel.compute(&block.tmp[0][0][0][0], &block.data[0][0][0].rho, block.gptfloats);
+                    block.update(kernel);
                 }
 			}
 		}
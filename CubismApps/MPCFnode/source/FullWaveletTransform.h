@@ -16,6 +16,8 @@
 #include "WaveletsOnInterval.h"
 #if defined(_QPX_) || defined(_QPXEMU_)
 #include "WaveletsOnIntervalQPX.h"
+#elif defined(_AVX_) || defined(_AVX512_)
+#include "WaveletsOnIntervalAVX.h"
 #endif
 using namespace std;
 
@@ -37,12 +39,16 @@ namespace WaveletsOnInterval
 	template<int BS, int ROWSIZE, int COLSIZE, int SLICESIZE, bool lifting>
 #if defined(_QPX_) || defined(_QPXEMU_)
 	struct FullTransformEngine : WaveletSweepQPX< ROWSIZE, COLSIZE>
+#elif defined(_AVX_) || defined(_AVX512_)
+	struct FullTransformEngine : WaveletSweepAVX< ChosenWavelets, ROWSIZE, COLSIZE>
 #else
 	struct FullTransformEngine : WaveletSweep< ChosenWavelets, ROWSIZE, COLSIZE>
 #endif
 	{		
 		FullTransformEngine<BS/2, ROWSIZE, COLSIZE, SLICESIZE, lifting> child;
 		
+		enum { LEVELS = 1 + FullTransformEngine<BS/2, ROWSIZE, COLSIZE, SLICESIZE, lifting>::LEVELS }; //4^3 is the coarsest
+		
 		inline void fwt(FwtAp data[SLICESIZE][COLSIZE][ROWSIZE])
 		{
 			this->template sweep3D<BS, true>(data);
@@ -56,6 +62,15 @@ namespace WaveletsOnInterval
 			
 			this->template sweep3D<BS, false>(data);
 		}
+		
+		//skips the finest "coarsening" levels, the result is the leading (BS >> coarsening)^3 corner
+		inline void iwt(FwtAp data[SLICESIZE][COLSIZE][ROWSIZE], const int coarsening)
+		{
+			child.iwt(data, coarsening - 1);
+			
+			if (coarsening <= 0)
+				this->template sweep3D<BS, false>(data);
+		}
 
 		template<typename DataType, int REFBS>
 		int threshold(const FwtAp eps, bitset<REFBS * REFBS * REFBS>& mask_survivors, DataType * const buffer_survivors, const FwtAp data[SLICESIZE][COLSIZE][ROWSIZE])
@@ -155,12 +170,14 @@ namespace WaveletsOnInterval
 	template<int ROWSIZE, int COLSIZE, int SLICESIZE, bool lifting>
 	struct FullTransformEngine<4, ROWSIZE, COLSIZE, SLICESIZE, lifting>
 	{
-		enum { BS = 4 } ;
+		enum { BS = 4, LEVELS = 0 } ;
 		
 		void fwt(FwtAp data[SLICESIZE][COLSIZE][ROWSIZE]) { }
 		
 		void iwt(FwtAp data[SLICESIZE][COLSIZE][ROWSIZE]) { }
 		
+		void iwt(FwtAp data[SLICESIZE][COLSIZE][ROWSIZE], const int coarsening) { }
+		
 		template<typename DataType, int REFBS>
 		int threshold(const FwtAp eps, bitset<REFBS * REFBS * REFBS>& mask_survivors, DataType * const buffer_survivors, const FwtAp data[SLICESIZE][COLSIZE][ROWSIZE])
 		{	
@@ -200,6 +217,8 @@ namespace WaveletsOnInterval
 		
 		void iwt() { FullTransformEngine<BS, BS, BS, BS, lifting>::iwt(data); }
 		
+		void iwt(const int coarsening) { FullTransformEngine<BS, BS, BS, BS, lifting>::iwt(data, coarsening); }
+		
 		template<typename DataType, int REFBS>
 		int threshold(const FwtAp eps, bitset<REFBS * REFBS * REFBS>& mask_survivors, DataType * const buffer_survivors)
 		{
@@ -0,0 +1,241 @@
+/*
+ *  Pyramid.h
+ *  MPCFnode
+ *
+ *  Coarsened copies of some channels of the grid, for in-situ previews.
+ *  Level l has (_BLOCKSIZE_ >> l)^3 values per block, each one the average of
+ *  2^3 values of level l-1: everything is block-local, no ghosts are needed.
+ *
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+
+#include "Types.h"
+
+template<typename TGrid, typename TStreamer>
+class Pyramid
+{
+protected:
+
+	enum { BS = _BLOCKSIZE_, NPOINTS = BS * BS * BS };
+
+	int levels;
+	vector<int> channels;
+
+	//the blocks we own form a brick: where it starts and how many blocks it has per dimension
+	int brickstart[3], brickbpd[3], totalbpd[3];
+
+	//one array per level, with the channels one after the other, x fastest
+	vector< vector<float> > data;
+
+	int _side(const int level) const { return BS >> level; }
+
+	static int _maxlevels()
+	{
+		int l = 0;
+
+		while ((BS >> (l + 1)) >= 1) ++l;
+
+		return l;
+	}
+
+	size_t _brickvalues(const int level) const
+	{
+		const size_t n = _side(level);
+
+		return brickbpd[0] * n * brickbpd[1] * n * brickbpd[2] * n;
+	}
+
+	size_t _globalvalues(const int level) const
+	{
+		const size_t n = _side(level);
+
+		return totalbpd[0] * n * totalbpd[1] * n * totalbpd[2] * n;
+	}
+
+	string _header(const int level) const
+	{
+		std::stringstream ss;
+
+		ss << "\n==============START-ASCI-HEADER==============\n";
+
+		{
+			int one = 1;
+			bool isone = *(char *)(&one);
+
+			ss << "Endianess: " << (isone ? "little" : "big") << "\n";
+		}
+
+		ss << "Coarsening: " << (1 << level) << "\n";
+		ss << "Size: " << totalbpd[0] * _side(level) << " x " << totalbpd[1] * _side(level) << " x " << totalbpd[2] * _side(level) << "\n";
+		ss << "Precision: float\n";
+		ss << "Streamer: " << TStreamer().name() << "\n";
+		ss << "Channels:";
+
+		for(int c = 0; c < channels.size(); ++c)
+			ss << " " << channels[c];
+
+		ss << "\n==============START-BINARY-DATA==============\n";
+
+		return ss.str();
+	}
+
+	string _filename(const string prefix, const int level) const
+	{
+		std::stringstream ss;
+
+		ss << prefix << ".x" << (1 << level);
+
+		return ss.str();
+	}
+
+public:
+
+	Pyramid(const int levels, const vector<int> channels): levels(levels), channels(channels)
+	{
+		//levels and channels come from the command line (-pyramidlevels, -pyramidchannels)
+		if (levels < 1 || (BS >> levels) < 1)
+		{
+			fprintf(stderr, "Pyramid: %d levels requested, blocks of %d allow 1 to %d. ABORTING!\n", levels, BS, _maxlevels());
+			abort();
+		}
+
+		if (channels.size() == 0)
+		{
+			fprintf(stderr, "Pyramid: no channels requested. ABORTING!\n");
+			abort();
+		}
+
+		for(int c = 0; c < channels.size(); ++c)
+			if (channels[c] < 0 || channels[c] >= TStreamer::channels)
+			{
+				fprintf(stderr, "Pyramid: channel %d requested, %s has channels 0 to %d. ABORTING!\n", channels[c], TStreamer().name(), TStreamer::channels - 1);
+				abort();
+			}
+	}
+
+	//block-local averages of the requested channels, blocks are processed in parallel
+	void build(TGrid& grid)
+	{
+		vector<BlockInfo> vInfo = grid.getBlocksInfo();
+
+		for(int d = 0; d < 3; ++d)
+		{
+			int start = numeric_limits<int>::max(), end = -1;
+
+			for(int i = 0; i < vInfo.size(); ++i)
+			{
+				start = min(start, vInfo[i].index[d]);
+				end = max(end, vInfo[i].index[d] + 1);
+			}
+
+			brickstart[d] = start;
+			brickbpd[d] = end - start;
+			totalbpd[d] = grid.getBlocksPerDimension(d);
+		}
+
+		assert(brickbpd[0] * brickbpd[1] * brickbpd[2] == vInfo.size());
+
+		const int NC = channels.size();
+
+		data.resize(levels);
+
+		for(int l = 0; l < levels; ++l)
+			data[l].resize(NC * _brickvalues(l + 1));
+
+#pragma omp parallel
+		{
+			TStreamer streamer;
+			vector<float> work(NC * NPOINTS);
+
+#pragma omp for schedule(static)
+			for(int i = 0; i < vInfo.size(); ++i)
+			{
+				BlockInfo info = vInfo[i];
+				FluidBlock& b = *(FluidBlock*)info.ptrBlock;
+
+				for(int iz = 0; iz < BS; ++iz)
+					for(int iy = 0; iy < BS; ++iy)
+						for(int ix = 0; ix < BS; ++ix)
+						{
+							Real output[TStreamer::channels];
+							streamer.operate(b(ix, iy, iz), output);
+
+							for(int c = 0; c < NC; ++c)
+								work[c * NPOINTS + ix + BS * (iy + BS * iz)] = output[channels[c]];
+						}
+
+				for(int l = 1; l <= levels; ++l)
+				{
+					const int n = _side(l);
+					const int nx = brickbpd[0] * n, ny = brickbpd[1] * n;
+					const size_t brickvalues = _brickvalues(l);
+
+					const int bx = info.index[0] - brickstart[0];
+					const int by = info.index[1] - brickstart[1];
+					const int bz = info.index[2] - brickstart[2];
+
+					for(int c = 0; c < NC; ++c)
+					{
+						//in place: level l overwrites the front of level l-1
+						float * const w = &work[c * NPOINTS];
+
+						for(int iz = 0; iz < n; ++iz)
+							for(int iy = 0; iy < n; ++iy)
+								for(int ix = 0; ix < n; ++ix)
+								{
+									const float * const src = w + 2 * ix + 2 * n * (2 * iy + 2 * n * 2 * iz);
+									const int sy = 2 * n, sz = 4 * n * n;
+
+									w[ix + n * (iy + n * iz)] = 0.125f * (src[0] + src[1] + src[sy] + src[sy + 1] +
+																		  src[sz] + src[sz + 1] + src[sz + sy] + src[sz + sy + 1]);
+								}
+
+						float * const dst = &data[l - 1][c * brickvalues];
+
+						for(int iz = 0; iz < n; ++iz)
+							for(int iy = 0; iy < n; ++iy)
+								copy(w + n * (iy + n * iz), w + n * (iy + n * iz) + n,
+									 dst + bx * n + nx * ((size_t)by * n + iy + ny * ((size_t)bz * n + iz)));
+					}
+				}
+			}
+		}
+	}
+
+	//one file per level: ascii header, then the channels one after the other
+	void write(const string prefix) const
+	{
+		for(int l = 1; l <= levels; ++l)
+		{
+			const string header = _header(l);
+
+			FILE * f = fopen(_filename(prefix, l).c_str(), "wb");
+			assert(f);
+
+			fwrite(header.c_str(), sizeof(char), header.size(), f);
+			fwrite(&data[l - 1].front(), sizeof(float), data[l - 1].size(), f);
+
+			fclose(f);
+		}
+	}
+
+	size_t bytes() const
+	{
+		size_t s = 0;
+
+		for(int l = 1; l <= levels; ++l)
+			s += _header(l).size() + sizeof(float) * channels.size() * _globalvalues(l);
+
+		return s;
+	}
+};
@@ -290,6 +290,7 @@ void Test_ShockBubble::run()
 			streamer<<"data-"<<step_id;
 			_dump(streamer.str());
 			_vp(*grid);			
+			_pyramid(*grid);
 			profiler.pop_stop();
         }
         if(step_id%ANALYSISPERIOD == 0)
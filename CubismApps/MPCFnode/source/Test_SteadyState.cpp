@@ -22,6 +22,7 @@ using namespace std;
 #endif
 
 #include "Test_SteadyState.h"
+#include "Pyramid.h"
 
 Test_SteadyState::Test_SteadyState(const int argc, const char ** argv):
 parser(argc, argv), t(0), step_id(0), grid(NULL), stepper(NULL) { }
@@ -162,6 +163,52 @@ void Test_SteadyState::_vp_dump(FluidGrid& grid, string filename)
 	*/
 }
 
+//comma separated, e.g. -pyramidchannels 4,5
+vector<int> Test_SteadyState::_pyramid_channels()
+{
+	std::stringstream list(parser("-pyramidchannels").asString("4,5"));
+	
+	vector<int> channels;
+	string item;
+	
+	while (getline(list, item, ','))
+	{
+		char * end = NULL;
+		const long c = strtol(item.c_str(), &end, 10);
+		
+		if (item.empty() || *end != '\0')
+		{
+			fprintf(stderr, "-pyramidchannels: %s is not a channel index. ABORTING!\n", item.c_str());
+			abort();
+		}
+		
+		channels.push_back(c);
+	}
+	
+	return channels;
+}
+
+void Test_SteadyState::_pyramid(FluidGrid& grid)
+{
+	if (!parser("-pyramid").asBool(false)) return;
+	
+	const string path = parser("-fpath").asString(".");
+	
+	char bufname[1024];
+	sprintf(bufname, "%s/datapyramid%05d", path.c_str(), step_id);
+	
+	Timer timer;
+	timer.start();
+	
+	Pyramid<FluidGrid, StreamerGridPointIterative> pyramid(parser("-pyramidlevels").asInt(3), _pyramid_channels());
+	pyramid.build(grid);
+	pyramid.write(bufname);
+	
+	const double t = timer.stop();
+	
+	printf("Pyramid: %.2f kB in %.3f s\n", pyramid.bytes() / 1024., t);
+}
+
 void Test_SteadyState::run()
 {
 	for(int i=0; i<NSTEPS; ++i)
@@ -50,6 +50,9 @@ protected:
 	void _vp_dump(FluidGrid& grid, string filename);
 	virtual void _vp(FluidGrid& grid);
 	
+	vector<int> _pyramid_channels();
+	void _pyramid(FluidGrid& grid);
+	
 	Real _initial_dt(int nsteps);
 	void _tnext(double &tnext, double& tnext_dump, double& tend);
 	
@@ -15,6 +15,16 @@ typedef float Real;
 typedef double Real;
 #endif
 
+//the RK register (tmp) is double in the mixed-precision mode, see common.h
+#ifdef _MIXED_PRECISION_
+typedef double RealAcc;
+#else
+typedef Real RealAcc;
+#endif
+
+//tmp16=f16 or tmp16=bf16: the RK register in 16 bits
+#include <Float16.h>
+
 #include <fstream>
 #include "math.h"
 
@@ -131,6 +141,52 @@ struct FluidElement
     }
 };
 
+#ifdef _SOA_BLOCK_
+//a point of a block with one array per quantity (layout=soa)
+struct FluidElementRef
+{
+	Real &rho, &u, &v, &w, &energy, &G, &P, &dummy;
+
+	FluidElementRef(Real * const first, const int stride):
+	rho(first[0]), u(first[stride]), v(first[2*stride]), w(first[3*stride]),
+	energy(first[4*stride]), G(first[5*stride]), P(first[6*stride]), dummy(first[7*stride]) { }
+
+	void clear() { rho = u = v = w = energy = G = P = dummy = 0; }
+
+	operator FluidElement() const
+	{
+		FluidElement e;
+
+		e.rho = rho;
+		e.u = u;
+		e.v = v;
+		e.w = w;
+		e.energy = energy;
+		e.G = G;
+		e.P = P;
+		e.dummy = dummy;
+
+		return e;
+	}
+
+	//as FluidElement::operator=, the dummy stays
+	FluidElementRef& operator = (const FluidElement& gp)
+	{
+		rho = gp.rho;
+		u = gp.u;
+		v = gp.v;
+		w = gp.w;
+		energy = gp.energy;
+		G = gp.G;
+		P = gp.P;
+
+		return *this;
+	}
+
+	FluidElementRef& operator = (const FluidElementRef& gp) { return *this = (FluidElement)gp; }
+};
+#endif
+
 struct StreamerGridPointASCII
 {
 	void operate(const FluidElement& input, ofstream& output) const 
@@ -184,6 +240,12 @@ struct StreamerGridPointIterative //dummy
 	template<int channel>
 	static inline Real operate(const FluidElement& input) { abort(); return 0; } 
 	
+	//all the channels at once, as FluidBlock::minmax wants them
+	inline void operate(const FluidElement& input, Real output[channels]) const;
+	
+	//back to the conserved variables, for restarting from the channels
+	template<typename TElement>
+	inline void inverse(const Real input[channels], TElement& output) const;
 	
 	const char * name() { return "StreamerGridPointIterative" ; }
 };
@@ -198,6 +260,46 @@ template<> inline Real StreamerGridPointIterative::operate<5>(const FluidElement
 template<> inline Real StreamerGridPointIterative::operate<6>(const FluidElement& e) { return e.P; }
 template<> inline Real StreamerGridPointIterative::operate<7>(const FluidElement& e) { return e.dummy; }
 
+inline void StreamerGridPointIterative::operate(const FluidElement& input, Real output[channels]) const
+{
+	output[0] = operate<0>(input);
+	output[1] = operate<1>(input);
+	output[2] = operate<2>(input);
+	output[3] = operate<3>(input);
+	output[4] = operate<4>(input);
+	output[5] = operate<5>(input);
+	output[6] = operate<6>(input);
+}
+
+template<typename TElement>
+inline void StreamerGridPointIterative::inverse(const Real input[channels], TElement& output) const
+{
+	output.rho = input[0];
+	output.u = input[1] * input[0];
+	output.v = input[2] * input[0];
+	output.w = input[3] * input[0];
+	output.G = input[5];
+	output.P = input[6];
+	output.energy = input[4] * output.G + output.P + 0.5 * (output.u * output.u + output.v * output.v + output.w * output.w) / output.rho;
+	output.dummy = 0;
+}
+
+//the block costs of -costmap, kept in the dummy field between the steps
+struct StreamerCostIterative
+{
+	static const int channels = 1;
+
+	template<int channel>
+	static inline Real operate(const FluidElement& input) { return input.dummy; }
+
+	inline void operate(const FluidElement& input, Real output[channels]) const { output[0] = input.dummy; }
+
+	template<typename TElement>
+	inline void inverse(const Real input[channels], TElement& output) const { output.dummy = input[0]; }
+
+	const char * name() { return "StreamerCost" ; }
+};
+
 struct StreamerDensity
 {
 	static const int channels = 1;
@@ -248,6 +350,34 @@ struct StreamerG
 	}
 };
 
+//per-thread scratch of FluidBlock::rhs, allocated at the first use: 
+//with tmp16 the RK register of one block in RealAcc, unused otherwise
+class RHSWork
+{
+	RealAcc * full;
+
+	//one per thread, never shared
+	RHSWork(const RHSWork&);
+	RHSWork& operator=(const RHSWork&);
+
+public:
+
+	RHSWork(): full(NULL) { }
+
+	~RHSWork() { free(full); }
+
+	RealAcc * get()
+	{
+		if (full == NULL)
+		{
+			const int error = posix_memalign((void **)&full, std::max(8, _ALIGNBYTES_), sizeof(RealAcc) * _BLOCKSIZE_ * _BLOCKSIZE_ * _BLOCKSIZE_ * (sizeof(FluidElement) / sizeof(Real)));
+			assert(error == 0);
+		}
+
+		return full;
+	}
+};
+
 struct FluidBlock
 {
 	static const int sizeX = _BLOCKSIZE_;
@@ -259,22 +389,55 @@ struct FluidBlock
 	typedef FluidElement ElementType;
 	typedef FluidElement element_type;
 	
+#ifdef _SOA_BLOCK_
+	//one array per quantity, the points are FluidElementRef.
+	//only the block passes gain (sos, update, ghost packing, compression):
+	//labs and tmp stay AoS, the convection kernels still transpose every slice
+	typedef FluidElementRef ElementRef;
+
+	Real __attribute__((__aligned__(_ALIGNBYTES_))) soa[gptfloats][_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_];
+#else
+	typedef FluidElement& ElementRef;
+
 	FluidElement __attribute__((__aligned__(_ALIGNBYTES_))) data[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_];
+#endif
     
-	Real __attribute__((__aligned__(_ALIGNBYTES_))) tmp[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_][gptfloats];
+#ifdef _HALF_TMP_
+	//RK register in 16 bits without the dummy slot, tmpscale[c] * tmp_decode(tmp[..][c]) (see Float16.h)
+	static const int tmpfloats = 7;
+	typedef unsigned short TmpType;
+
+	TmpType __attribute__((__aligned__(_ALIGNBYTES_))) tmp[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_][tmpfloats];
+	float tmpscale[tmpfloats];
+#else
+	static const int tmpfloats = gptfloats;
+	typedef RealAcc TmpType;
+
+	TmpType __attribute__((__aligned__(_ALIGNBYTES_))) tmp[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_][gptfloats];
+#endif
     
 	void clear_data()
 	{
+#ifdef _SOA_BLOCK_
+		const int N = sizeX*sizeY*sizeZ*gptfloats;
+		Real * const e = &soa[0][0][0][0];
+		for(int i=0; i<N; ++i) e[i] = 0;
+#else
 		const int N = sizeX*sizeY*sizeZ;
 		FluidElement * const e = &data[0][0][0];
 		for(int i=0; i<N; ++i) e[i].clear();
+#endif
 	}
     
 	void clear_tmp()
 	{    
-        const int N = sizeX * sizeY * sizeZ * gptfloats;
+        const int N = sizeX * sizeY * sizeZ * tmpfloats;
 
-        Real * const e = &tmp[0][0][0][0];
+#ifdef _HALF_TMP_
+        for(int c=0; c<tmpfloats; ++c) tmpscale[c] = 0;
+#endif
+        
+        TmpType * const e = &tmp[0][0][0][0];
         for(int i=0; i<N; ++i) e[i] = 0;
 	}
     
@@ -283,8 +446,133 @@ struct FluidBlock
 		clear_data();
 		clear_tmp();
 	}
+
+	inline RealAcc get_tmp(const int ix, const int iy, const int iz, const int c) const
+	{
+#ifdef _HALF_TMP_
+		return tmpscale[c] * tmp_decode(tmp[iz][iy][ix][c]);
+#else
+		return tmp[iz][iy][ix][c];
+#endif
+	}
+
+	//the RHS kernel into tmp, which it also reads unless the stage overwrites it (a = 0)
+	template<typename Kernel>
+	void rhs(Kernel& kernel, RHSWork& work, const bool overwrite, const Real * const srcfirst, const int labSizeRow, const int labSizeSlice)
+	{
+#ifdef _HALF_TMP_
+		//the kernels see the register in RealAcc, and compute a * tmp also for a = 0
+		RealAcc * const full = work.get();
+
+		if (overwrite)
+			memset(full, 0, sizeof(RealAcc) * sizeX * sizeY * sizeZ * gptfloats);
+		else
+			_unpack_tmp(full);
+
+		kernel.compute(srcfirst, gptfloats, labSizeRow, labSizeSlice, full, gptfloats, sizeX, sizeX*sizeY);
+
+		_pack_tmp(full);
+#else
+		kernel.compute(srcfirst, gptfloats, labSizeRow, labSizeSlice, &tmp[0][0][0][0], gptfloats, sizeX, sizeX*sizeY);
+#endif
+	}
+
+	//data += b * tmp
+	template<typename Kernel>
+	void update(const Kernel& kernel)
+	{
+#if defined(_HALF_TMP_) && defined(_SOA_BLOCK_)
+		kernel.compute_soa(&tmp[0][0][0][0], tmpscale, &soa[0][0][0][0], gptfloats);
+#elif defined(_HALF_TMP_)
+		kernel.compute(&tmp[0][0][0][0], tmpscale, &data[0][0][0].rho, gptfloats);
+#elif defined(_SOA_BLOCK_)
+		kernel.compute_soa(&tmp[0][0][0][0], &soa[0][0][0][0], gptfloats);
+#else
+		kernel.compute(&tmp[0][0][0][0], &data[0][0][0].rho, gptfloats);
+#endif
+	}
+
+	//largest characteristic speed of the block
+	template<typename Kernel>
+	Real sos(const Kernel& kernel) const
+	{
+#ifdef _SOA_BLOCK_
+		return kernel.compute_soa(&soa[0][0][0][0]);
+#else
+		return kernel.compute(&data[0][0][0].rho, gptfloats);
+#endif
+	}
+
+#ifdef _HALF_TMP_
+	//one row of the block converted at a time
+	static const int tmprow = _BLOCKSIZE_ * tmpfloats;
+
+	void _unpack_tmp(RealAcc * const dst) const
+	{
+		float decoded[tmprow];
+
+		for(int r=0; r<sizeY*sizeZ; ++r)
+		{
+			tmp_decode(&tmp[0][0][0][0] + r * tmprow, decoded, tmprow);
+
+			for(int ix=0; ix<sizeX; ++ix)
+				for(int c=0; c<tmpfloats; ++c)
+					dst[(r * sizeX + ix) * gptfloats + c] = tmpscale[c] * decoded[ix * tmpfloats + c];
+		}
+	}
+
+	//one scale per quantity, the largest magnitude of the block: the 16-bit values are in [-1, 1]
+	void _pack_tmp(const RealAcc * const src)
+	{
+		const int N = sizeX * sizeY * sizeZ;
+
+		RealAcc maxabs[tmpfloats];
+		for(int c=0; c<tmpfloats; ++c) maxabs[c] = 0;
+
+		for(int i=0; i<N; ++i)
+			for(int c=0; c<tmpfloats; ++c)
+				maxabs[c] = std::max(maxabs[c], (RealAcc)fabs(src[i * gptfloats + c]));
+
+		RealAcc invscale[tmpfloats];
+		for(int c=0; c<tmpfloats; ++c)
+		{
+			tmpscale[c] = maxabs[c];
+			invscale[c] = tmpscale[c] > 0 ? 1 / (RealAcc)tmpscale[c] : 0;
+		}
+
+		float scaled[tmprow];
+
+		for(int r=0; r<sizeY*sizeZ; ++r)
+		{
+			for(int ix=0; ix<sizeX; ++ix)
+				for(int c=0; c<tmpfloats; ++c)
+					scaled[ix * tmpfloats + c] = src[(r * sizeX + ix) * gptfloats + c] * invscale[c];
+
+			tmp_encode(scaled, &tmp[0][0][0][0] + r * tmprow, tmprow);
+		}
+	}
+#endif
     
-	inline FluidElement& operator()(int ix, int iy=0, int iz=0)
+	inline ElementRef operator()(int ix, int iy=0, int iz=0)
+	{
+		assert(ix>=0 && ix<sizeX);
+		assert(iy>=0 && iy<sizeY);
+		assert(iz>=0 && iz<sizeZ);
+		
+#ifdef _SOA_BLOCK_
+		return FluidElementRef(&soa[0][iz][iy][ix], sizeX*sizeY*sizeZ);
+#else
+		return data[iz][iy][ix];
+#endif
+	}
+	
+#ifdef _SOA_BLOCK_
+	inline FluidElement operator()(int ix, int iy=0, int iz=0) const
+	{
+		return const_cast<FluidBlock&>(*this)(ix, iy, iz);
+	}
+#else
+	inline const FluidElement& operator()(int ix, int iy=0, int iz=0) const
 	{
 		assert(ix>=0 && ix<sizeX);
 		assert(iy>=0 && iy<sizeY);
@@ -292,6 +580,7 @@ struct FluidBlock
 		
 		return data[iz][iy][ix];
 	}
+#endif
 	
 	template <typename Streamer>
 	inline void Write(ofstream& output, Streamer streamer) const
@@ -299,7 +588,7 @@ struct FluidBlock
 		for(int iz=0; iz<sizeZ; iz++)
 			for(int iy=0; iy<sizeY; iy++)
 				for(int ix=0; ix<sizeX; ix++)
-					streamer.operate(data[iz][iy][ix], output);
+					streamer.operate((*this)(ix, iy, iz), output);
 	}
 	
 	template <typename Streamer>
@@ -308,7 +597,15 @@ struct FluidBlock
 		for(int iz=0; iz<sizeZ; iz++)
 			for(int iy=0; iy<sizeY; iy++)
 				for(int ix=0; ix<sizeX; ix++)
+				{
+#ifdef _SOA_BLOCK_
+					FluidElement e = (*this)(ix, iy, iz);
+					streamer.operate(input, e);
+					(*this)(ix, iy, iz) = e;
+#else
 					streamer.operate(input, data[iz][iy][ix]);
+#endif
+				}
 	}
 	
 	template <typename Streamer>
@@ -316,8 +613,8 @@ struct FluidBlock
 	{
 		enum { NCHANNELS = Streamer::channels };
 				
-		streamer.operate(data[0][0][0], minval);
-		streamer.operate(data[0][0][0], maxval);
+		streamer.operate((*this)(0, 0, 0), minval);
+		streamer.operate((*this)(0, 0, 0), maxval);
 		
 		for(int iz=0; iz<sizeZ; iz++)
 			for(int iy=0; iy<sizeY; iy++)
@@ -325,7 +622,7 @@ struct FluidBlock
 				{
 					Real tmp[NCHANNELS];
 					
-					streamer.operate(data[iz][iy][ix], tmp);
+					streamer.operate((*this)(ix, iy, iz), tmp);
 					
 					for(int ic = 0; ic < NCHANNELS; ++ic)
 						minval[ic] = std::min(minval[ic], tmp[ic]);
@@ -336,6 +633,37 @@ struct FluidBlock
 	}
 };
 
+//the raw data, in the layout of the build
+#ifdef _SOA_BLOCK_
+template <> inline void FluidBlock::Write<StreamerGridPoint>(ofstream& output, StreamerGridPoint streamer) const
+{
+	output.write((const char *)&soa[0][0][0][0], sizeof(FluidElement)*sizeX*sizeY*sizeZ);
+}
+
+template <> inline void FluidBlock::Read<StreamerGridPoint>(ifstream& input, StreamerGridPoint streamer)
+{
+	input.read((char *)&soa[0][0][0][0], sizeof(FluidElement)*sizeX*sizeY*sizeZ);
+}
+
+//the interior of a block into the lab, which stays AoS: one row of every quantity.
+//this transposition is an extra cost of layout=soa on every lab load
+template <>
+struct BlockLabRowCopy<FluidBlock, FluidElement>
+{
+	static inline void copy(FluidBlock& block, const int iy, const int iz, FluidElement * const dst)
+	{
+		Real * const first = &dst[0].rho;
+
+		for(int c=0; c<FluidBlock::gptfloats; ++c)
+		{
+			const Real * const src = &block.soa[c][iz][iy][0];
+
+			for(int ix=0; ix<FluidBlock::sizeX; ++ix)
+				first[ix*FluidBlock::gptfloats + c] = src[ix];
+		}
+	}
+};
+#else
 template <> inline void FluidBlock::Write<StreamerGridPoint>(ofstream& output, StreamerGridPoint streamer) const
 {
 	output.write((const char *)&data[0][0][0], sizeof(FluidElement)*sizeX*sizeY*sizeZ);
@@ -345,6 +673,7 @@ template <> inline void FluidBlock::Read<StreamerGridPoint>(ifstream& input, Str
 {
 	input.read((char *)&data[0][0][0], sizeof(FluidElement)*sizeX*sizeY*sizeZ);
 }
+#endif
 
 struct StreamerDummy_HDF5 
 {
@@ -356,7 +685,7 @@ struct StreamerDummy_HDF5
 	
 	void operate(const int ix, const int iy, const int iz, Real output[9]) const
 	{
-		const FluidElement& input = ref.data[iz][iy][ix];
+		const FluidElement& input = ref(ix, iy, iz);
 		
 		output[0] = input.rho;
 		//assert(input.rho >= 0);
@@ -370,7 +699,7 @@ struct StreamerDummy_HDF5
 	
 	void operate(const Real output[9], const int ix, const int iy, const int iz) const
 	{
-		FluidElement& input = ref.data[iz][iy][ix];
+		FluidBlock::ElementRef input = ref(ix, iy, iz);
 		
 		input.rho = output[0];
 		//assert(input.rho >= 0);
@@ -395,16 +724,14 @@ struct StreamerFromTemp_HDF5
 	
 	void operate(const int ix, const int iy, const int iz, Real output[3]) const
 	{
-		output[0] = ref.tmp[iz][iy][ix][0];
-		output[1] = ref.tmp[iz][iy][ix][1];
-		output[2] = ref.tmp[iz][iy][ix][2];
+		output[0] = ref.get_tmp(ix, iy, iz, 0);
+		output[1] = ref.get_tmp(ix, iy, iz, 1);
+		output[2] = ref.get_tmp(ix, iy, iz, 2);
 	}
 
   void operate(const Real output, const int ix, const int iy, const int iz) const
   {
-    FluidElement& input = ref.data[iz][iy][ix];
-
-    input.G = output;
+    ref(ix, iy, iz).G = output;
   }
 	
 	static const char * getAttributeName() { return "Vector"; } 
@@ -420,7 +747,7 @@ StreamerGamma_HDF5(FluidBlock& b): ref(b){}
 
   void operate(const int ix, const int iy, const int iz, Real output[1]) const
   {
-    const FluidElement& input = ref.data[iz][iy][ix];
+    const FluidElement& input = ref(ix, iy, iz);
 
     output[0] = input.G;
   }
@@ -428,6 +755,22 @@ StreamerGamma_HDF5(FluidBlock& b): ref(b){}
   static const char * getAttributeName() { return "Scalar"; }
 };
 
+struct StreamerCost_HDF5
+{
+	static const int NCHANNELS = 1;
+
+	FluidBlock& ref;
+
+	StreamerCost_HDF5(FluidBlock& b): ref(b){}
+
+	void operate(const int ix, const int iy, const int iz, Real output[1]) const
+	{
+		output[0] = ref(ix, iy, iz).dummy;
+	}
+
+	static const char * getAttributeName() { return "Scalar"; }
+};
+
 struct StreamerPressure_HDF5
 {
     static const int NCHANNELS = 1;
@@ -438,7 +781,7 @@ struct StreamerPressure_HDF5
     
     void operate(const int ix, const int iy, const int iz, Real output[1]) const
     {
-        const FluidElement& input = ref.data[iz][iy][ix];
+        const FluidElement& input = ref(ix, iy, iz);
         
         output[0] = (input.energy-0.5*(input.u*input.u+input.v*input.v+input.w*input.w)/input.rho - input.P)/input.G;
     }
@@ -456,7 +799,7 @@ struct StreamerPressure_HDF5
         
         void operate(const int ix, const int iy, const int iz, Real output[1]) const
         {
-            const FluidElement& input = ref.data[iz][iy][ix];
+            const FluidElement& input = ref(ix, iy, iz);
             
             output[0] = input.rho;
         }
@@ -16,6 +16,7 @@ typedef double Real;
 #include <cstdio>
 #include <bitset>
 #include <cassert>
+#include <cmath>
 
 using namespace std;
 
@@ -146,9 +147,66 @@ size_t WaveletCompressorGeneric<DATASIZE1D, DataType>::compress(const float thre
 	return BITSETSIZE + sizeof(unsigned short) * survivors;
 }
 
+template<int DATASIZE1D, typename DataType>
+size_t WaveletCompressorGeneric<DATASIZE1D, DataType>::compress_bounded(const float maxerror, const bool rms, const bool float16, WaveletsOnInterval::FwtAp * const original, float& threshold, float& error)
+{
+	enum { MAXATTEMPTS = 8 };
+	
+	memcpy(original, &full.data[0][0][0], sizeof(WaveletsOnInterval::FwtAp) * BS3);
+	
+	float eps = maxerror;
+	bool halfstream = float16;
+	
+	for(int attempt = 1; ; ++attempt)
+	{
+		const size_t nbytes = WaveletCompressorGeneric<DATASIZE1D, DataType>::compress(eps, halfstream);
+		
+		//the compressed stream stays in bufcompression, full.data gets the reconstruction
+		WaveletCompressorGeneric<DATASIZE1D, DataType>::decompress(halfstream, nbytes);
+		
+		{
+			const WaveletsOnInterval::FwtAp * const reconstructed = &full.data[0][0][0];
+			
+			double linf = 0, l2 = 0;
+			for(int i = 0; i < BS3; ++i)
+			{
+				const double d = fabs((double)reconstructed[i] - (double)original[i]);
+				
+				linf = max(linf, d);
+				l2 += d * d;
+			}
+			
+			error = rms ? sqrt(l2 / BS3) : linf;
+		}
+		
+		if (error <= maxerror || (eps == 0 && !halfstream))
+		{
+			threshold = eps;
+			return nbytes;
+		}
+		
+		//too coarse: restore the data and shrink the threshold, 
+		//give up thresholding at the end, then the half floats (see decompress_coarse)
+		memcpy(&full.data[0][0][0], original, sizeof(WaveletsOnInterval::FwtAp) * BS3);
+		
+		if (eps == 0)
+			halfstream = false;
+		else
+			eps = attempt < MAXATTEMPTS ? eps * min(0.5f, maxerror / error) : 0;
+	}
+}
+
 template<int DATASIZE1D, typename DataType>
 void WaveletCompressorGeneric<DATASIZE1D, DataType>::decompress(const bool float16, size_t bytes)//, DataType data[DATASIZE1D][DATASIZE1D][DATASIZE1D])
 {
+	decompress_coarse(float16, bytes, 0);
+}
+
+template<int DATASIZE1D, typename DataType>
+void WaveletCompressorGeneric<DATASIZE1D, DataType>::decompress_coarse(const bool float16, size_t bytes, const int coarsening)
+{
+	assert(coarsening >= 0 && coarsening <= levels());
+	
 	assert((bytes - sizeof(bitset<BS3>)) % sizeof(DataType) == 0 || float16);
 	assert((bytes - sizeof(bitset<BS3>)) % sizeof(unsigned short) == 0);
 	
@@ -157,12 +215,16 @@ void WaveletCompressorGeneric<DATASIZE1D, DataType>::decompress(const bool float
 	
 	size_t bytes_read = BITSETSIZE;
 	
-	const int nelements = (bytes - bytes_read) / (float16 ? sizeof(unsigned short) : sizeof(DataType));
+	//with float16, compress_bounded stores the blocks that miss the bound at full precision:
+	//the mask tells how many coefficients there are, hence their size
+	const bool halfstream = float16 && bytes - bytes_read != sizeof(DataType) * expected;
+	
+	const int nelements = (bytes - bytes_read) / (halfstream ? sizeof(unsigned short) : sizeof(DataType));
 	assert(expected == nelements);
 	
 	vector<DataType> datastream(nelements);
 	
-	if (!float16)
+	if (!halfstream)
 		memcpy((void *)&datastream.front(), bufcompression + bytes_read, sizeof(DataType) * nelements);	
 	else
 	{
@@ -174,7 +236,7 @@ void WaveletCompressorGeneric<DATASIZE1D, DataType>::decompress(const bool float
 	}
 	
 	full.load(datastream, mask);
-	full.iwt();
+	full.iwt(coarsening);
 }
 
 #ifdef _BLOCKSIZE_
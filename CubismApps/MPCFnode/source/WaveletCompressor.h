@@ -42,13 +42,25 @@ private:
 public: 
 	
 	WaveletsOnInterval::FwtAp (& uncompressed_data()) [DATASIZE1D][DATASIZE1D][DATASIZE1D] { return full.data; } 
+	const WaveletsOnInterval::FwtAp (& uncompressed_data() const) [DATASIZE1D][DATASIZE1D][DATASIZE1D] { return full.data; } 
 
 	virtual void * compressed_data() { return bufcompression; }
 		
 	virtual	size_t compress(const float threshold, const bool float16);
 	
+	//picks the threshold so that the reconstruction error (max or rms) stays below maxerror,
+	//reports the threshold and the error achieved. uncompressed_data() is left reconstructed.
+	//if the bound is missed without thresholding, the block is stored without half floats.
+	//original: scratch of DATASIZE1D^3 values for the input
+	size_t compress_bounded(const float maxerror, const bool rms, const bool float16, WaveletsOnInterval::FwtAp * const original, float& threshold, float& error);
+	
 	virtual void decompress(const bool float16, size_t bytes);
 	
+	//stops the inverse transform "coarsening" levels before the finest one, see copy_coarse_to
+	void decompress_coarse(const bool float16, size_t bytes, const int coarsening);
+	
+	static int levels() { return WaveletsOnInterval::FullTransform<DATASIZE1D, lifting_scheme>::LEVELS; }
+	
 	virtual void decompress(const bool float16, size_t ninputbytes, DataType data[DATASIZE1D][DATASIZE1D][DATASIZE1D])
 	{
 		decompress(float16, ninputbytes);
@@ -67,6 +79,24 @@ public:
 		}
 	}
 	
+	//the (DATASIZE1D >> coarsening)^3 field left by decompress_coarse, x fastest.
+	//each forward level leaves its output with the axes rotated (see sweep3D),
+	//here we undo the rotations of the levels that were skipped
+	void copy_coarse_to(DataType * const dst, const int coarsening)
+	{
+		const int N = DATASIZE1D >> coarsening;
+		
+		for(int iz = 0, c = 0; iz < N; ++iz)
+			for(int iy = 0; iy < N; ++iy)
+				for(int ix = 0; ix < N; ++ix, ++c)
+					switch (coarsening % 3)
+					{
+						case 0: dst[c] = full.data[iz][iy][ix]; break;
+						case 1: dst[c] = full.data[iy][ix][iz]; break;
+						case 2: dst[c] = full.data[ix][iz][iy]; break;
+					}
+	}
+	
 	void copy_from(const DataType data[DATASIZE1D][DATASIZE1D][DATASIZE1D])
 	{
 		const DataType * const src = &data[0][0][0];
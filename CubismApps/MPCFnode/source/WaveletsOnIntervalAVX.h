@@ -0,0 +1,315 @@
+/*
+ *  WaveletsOnIntervalAVX.h
+ *
+ *	x86 counterpart of WaveletsOnIntervalQPX.h: the 1D lifting runs on W rows at once.
+ *	the y and z sweeps take the lanes straight from memory (consecutive x),
+ *	the x sweep goes through a 4x4-transposed scratch pad.
+ *	the arithmetic replicates WI4 operation by operation (double accumulation,
+ *	float rounding where the scalar code rounds), so the result is bit-identical.
+ *
+ */
+
+#pragma once
+
+#include <cassert>
+#include <immintrin.h>
+
+namespace WaveletsOnInterval
+{
+#if defined(_AVX512_)
+	struct LanesAVX
+	{
+		enum { W = 8 };
+
+		typedef __m512d V;
+
+		static inline V load(const FwtAp * const src) { return _mm512_cvtps_pd(_mm256_loadu_ps(src)); }
+		static inline void store(FwtAp * const dst, const V a) { _mm256_storeu_ps(dst, _mm512_cvtpd_ps(a)); }
+		static inline V round(const V a) { return _mm512_cvtps_pd(_mm512_cvtpd_ps(a)); }
+		static inline V splat(const double a) { return _mm512_set1_pd(a); }
+		static inline V add(const V a, const V b) { return _mm512_add_pd(a, b); }
+		static inline V sub(const V a, const V b) { return _mm512_sub_pd(a, b); }
+		static inline V mul(const V a, const V b) { return _mm512_mul_pd(a, b); }
+	};
+#else
+	struct LanesAVX
+	{
+		enum { W = 4 };
+
+		typedef __m256d V;
+
+		static inline V load(const FwtAp * const src) { return _mm256_cvtps_pd(_mm_loadu_ps(src)); }
+		static inline void store(FwtAp * const dst, const V a) { _mm_storeu_ps(dst, _mm256_cvtpd_ps(a)); }
+		static inline V round(const V a) { return _mm256_cvtps_pd(_mm256_cvtpd_ps(a)); }
+		static inline V splat(const double a) { return _mm256_set1_pd(a); }
+		static inline V add(const V a, const V b) { return _mm256_add_pd(a, b); }
+		static inline V sub(const V a, const V b) { return _mm256_sub_pd(a, b); }
+		static inline V mul(const V a, const V b) { return _mm256_mul_pd(a, b); }
+	};
+#endif
+
+	template<bool lifting>
+	struct WI4AVX
+	{
+		typedef LanesAVX L;
+		typedef LanesAVX::V V;
+
+		//same association order as WI4::interp_*, the products are exact in double
+		static inline V interp_first(const V f0, const V f1, const V f2, const V f3)
+		{
+			return L::round(L::add(L::sub(L::add(L::mul(L::splat(5./16), f0), L::mul(L::splat(15./16), f1)), L::mul(L::splat(5./16), f2)), L::mul(L::splat(1./16), f3)));
+		}
+
+		static inline V interp_middle(const V f0, const V f1, const V f2, const V f3)
+		{
+			return L::round(L::sub(L::add(L::add(L::mul(L::splat(-1./16), f0), L::mul(L::splat(9./16), f1)), L::mul(L::splat(9./16), f2)), L::mul(L::splat(1./16), f3)));
+		}
+
+		static inline V interp_onetolast(const V f0, const V f1, const V f2, const V f3)
+		{
+			return L::round(L::add(L::add(L::sub(L::mul(L::splat(1./16), f0), L::mul(L::splat(5./16), f1)), L::mul(L::splat(15./16), f2)), L::mul(L::splat(5./16), f3)));
+		}
+
+		static inline V interp_last(const V f0, const V f1, const V f2, const V f3)
+		{
+			return L::round(L::add(L::sub(L::add(L::mul(L::splat(-5./16), f0), L::mul(L::splat(21./16), f1)), L::mul(L::splat(35./16), f2)), L::mul(L::splat(35./16), f3)));
+		}
+
+		//lane j of sample i lives at data[i * stride + j]
+		template<const int N, bool forward>
+		static inline void transform(FwtAp * const data, const int stride)
+		{
+			assert(N >= 8);
+			assert(N % 2 == 0);
+
+			enum { Nhalf = N / 2 };
+
+			if (forward)
+			{
+				V f[N];
+				for(int i = 0; i < N; ++i)
+					f[i] = L::load(data + i * stride);
+
+				V details[Nhalf];
+
+				details[0] = L::round(L::sub(f[1], interp_first(f[0], f[2], f[4], f[6])));
+
+				for(int i = 1; i < Nhalf - 2; ++i)
+				{
+					const int s = 2 * i;
+
+					details[i] = L::round(L::sub(f[s + 1], interp_middle(f[s - 2], f[s], f[s + 2], f[s + 4])));
+				}
+
+				details[Nhalf-2] = L::round(L::sub(f[N-3], interp_onetolast(f[N-8], f[N-6], f[N-4], f[N-2])));
+				details[Nhalf-1] = L::round(L::sub(f[N-1], interp_last(f[N-8], f[N-6], f[N-4], f[N-2])));
+
+				for(int i = 0; i < Nhalf; ++i)
+				{
+					const V scaling = lifting ? L::add(f[2 * i], L::mul(L::splat(0.5), details[i])) : f[2 * i];
+
+					L::store(data + i * stride, scaling);
+				}
+
+				for(int i = 0; i < Nhalf; ++i)
+					L::store(data + (Nhalf + i) * stride, details[i]);
+			}
+			else
+			{
+				V scalings[Nhalf], details[Nhalf];
+
+				for(int i = 0; i < Nhalf; ++i)
+				{
+					scalings[i] = L::load(data + i * stride);
+					details[i] = L::load(data + (Nhalf + i) * stride);
+				}
+
+				if (lifting)
+					for(int i = 0; i < Nhalf; ++i)
+						scalings[i] = L::round(L::sub(scalings[i], L::mul(L::splat(0.5), details[i])));
+
+				for(int i = 0; i < Nhalf; ++i)
+					L::store(data + 2 * i * stride, scalings[i]);
+
+				L::store(data + stride, L::add(interp_first(scalings[0], scalings[1], scalings[2], scalings[3]), details[0]));
+
+				for(int i = 1; i < Nhalf - 2; ++i)
+					L::store(data + (2 * i + 1) * stride, L::add(interp_middle(scalings[i-1], scalings[i], scalings[i+1], scalings[i+2]), details[i]));
+
+				L::store(data + (N-3) * stride, L::add(interp_onetolast(scalings[Nhalf-4], scalings[Nhalf-3], scalings[Nhalf-2], scalings[Nhalf-1]), details[Nhalf-2]));
+				L::store(data + (N-1) * stride, L::add(interp_last(scalings[Nhalf-4], scalings[Nhalf-3], scalings[Nhalf-2], scalings[Nhalf-1]), details[Nhalf-1]));
+			}
+		}
+	};
+
+	template<typename WaveletType, int ROWSIZE, int COLSIZE>
+	struct WaveletSweepAVX;
+
+	template<bool lifting, int ROWSIZE, int COLSIZE>
+	struct WaveletSweepAVX<WI4<lifting>, ROWSIZE, COLSIZE>
+	{
+		enum { W = LanesAVX::W };
+
+		typedef WI4AVX<lifting> LaneWavelets;
+
+		static inline void _tr4(FwtAp * const a, FwtAp * const b, FwtAp * const c, FwtAp * const d)
+		{
+			__m128 r0 = _mm_loadu_ps(a);
+			__m128 r1 = _mm_loadu_ps(b);
+			__m128 r2 = _mm_loadu_ps(c);
+			__m128 r3 = _mm_loadu_ps(d);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+			_mm_storeu_ps(a, r0);
+			_mm_storeu_ps(b, r1);
+			_mm_storeu_ps(c, r2);
+			_mm_storeu_ps(d, r3);
+		}
+
+		static inline void _tr4x2(FwtAp * const a0, FwtAp * const b0, FwtAp * const c0, FwtAp * const d0,
+								  FwtAp * const a1, FwtAp * const b1, FwtAp * const c1, FwtAp * const d1)
+		{
+			__m128 r0 = _mm_loadu_ps(a0);
+			__m128 r1 = _mm_loadu_ps(b0);
+			__m128 r2 = _mm_loadu_ps(c0);
+			__m128 r3 = _mm_loadu_ps(d0);
+			__m128 r4 = _mm_loadu_ps(a1);
+			__m128 r5 = _mm_loadu_ps(b1);
+			__m128 r6 = _mm_loadu_ps(c1);
+			__m128 r7 = _mm_loadu_ps(d1);
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_MM_TRANSPOSE4_PS(r4, r5, r6, r7);
+
+			_mm_storeu_ps(a1, r0);
+			_mm_storeu_ps(b1, r1);
+			_mm_storeu_ps(c1, r2);
+			_mm_storeu_ps(d1, r3);
+			_mm_storeu_ps(a0, r4);
+			_mm_storeu_ps(b0, r5);
+			_mm_storeu_ps(c0, r6);
+			_mm_storeu_ps(d0, r7);
+		}
+
+		template<int BS>
+		inline void xy_transpose(FwtAp data[BS][ROWSIZE])
+		{
+			for(int iy = 0; iy < BS; iy += 4)
+			{
+				_tr4(&data[iy][iy], &data[iy + 1][iy], &data[iy + 2][iy], &data[iy + 3][iy]);
+
+				for(int ix = iy + 4; ix < BS; ix += 4)
+					_tr4x2(&data[iy][ix], &data[iy + 1][ix], &data[iy + 2][ix], &data[iy + 3][ix],
+						   &data[ix][iy], &data[ix + 1][iy], &data[ix + 2][iy], &data[ix + 3][iy]);
+			}
+		}
+
+		template<int BS>
+		inline void xz_transpose(FwtAp data[BS][COLSIZE][ROWSIZE])
+		{
+			for(int iy = 0; iy < BS; ++iy)
+				for(int iz = 0; iz < BS; iz += 4)
+				{
+					_tr4(&data[iz][iy][iz], &data[iz + 1][iy][iz], &data[iz + 2][iy][iz], &data[iz + 3][iy][iz]);
+
+					for(int ix = iz + 4; ix < BS; ix += 4)
+						_tr4x2(&data[iz][iy][ix], &data[iz + 1][iy][ix], &data[iz + 2][iy][ix], &data[iz + 3][iy][ix],
+							   &data[ix][iy][iz], &data[ix + 1][iy][iz], &data[ix + 2][iy][iz], &data[ix + 3][iy][iz]);
+				}
+		}
+
+		//transform along the rows: W rows at a time, transposed into a scratch pad
+		template<int BS, bool forward>
+		inline void sweep_rows(FwtAp data[BS][ROWSIZE])
+		{
+			FwtAp __attribute__((__aligned__(32))) pad[BS][W];
+
+			for(int iy = 0; iy < BS; iy += W)
+			{
+				for(int ix = 0; ix < BS; ix += 4)
+					for(int j = 0; j < W; j += 4)
+					{
+						__m128 r0 = _mm_loadu_ps(&data[iy + j][ix]);
+						__m128 r1 = _mm_loadu_ps(&data[iy + j + 1][ix]);
+						__m128 r2 = _mm_loadu_ps(&data[iy + j + 2][ix]);
+						__m128 r3 = _mm_loadu_ps(&data[iy + j + 3][ix]);
+
+						_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+						_mm_storeu_ps(&pad[ix][j], r0);
+						_mm_storeu_ps(&pad[ix + 1][j], r1);
+						_mm_storeu_ps(&pad[ix + 2][j], r2);
+						_mm_storeu_ps(&pad[ix + 3][j], r3);
+					}
+
+				LaneWavelets::template transform<BS, forward>(&pad[0][0], W);
+
+				for(int ix = 0; ix < BS; ix += 4)
+					for(int j = 0; j < W; j += 4)
+					{
+						__m128 r0 = _mm_loadu_ps(&pad[ix][j]);
+						__m128 r1 = _mm_loadu_ps(&pad[ix + 1][j]);
+						__m128 r2 = _mm_loadu_ps(&pad[ix + 2][j]);
+						__m128 r3 = _mm_loadu_ps(&pad[ix + 3][j]);
+
+						_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+						_mm_storeu_ps(&data[iy + j][ix], r0);
+						_mm_storeu_ps(&data[iy + j + 1][ix], r1);
+						_mm_storeu_ps(&data[iy + j + 2][ix], r2);
+						_mm_storeu_ps(&data[iy + j + 3][ix], r3);
+					}
+			}
+		}
+
+		//transform along a strided direction: the lanes are consecutive entries of a row
+		template<int BS, bool forward>
+		inline void sweep_strided(FwtAp * const data, const int stride)
+		{
+			for(int ix = 0; ix < BS; ix += W)
+				LaneWavelets::template transform<BS, forward>(data + ix, stride);
+		}
+
+		//same data flow as WaveletSweep::sweep3D: x, then y, then z,
+		//with the two transpositions moved after (forward) or before (inverse) the transforms
+		template<int BS, bool bForward>
+		inline void sweep3D(FwtAp data[BS][COLSIZE][ROWSIZE])
+		{
+			assert(BS % W == 0);
+
+			if(bForward)
+			{
+				for(int iz = 0; iz < BS; ++iz)
+					sweep_rows<BS, true>(data[iz]);
+
+				for(int iz = 0; iz < BS; ++iz)
+					sweep_strided<BS, true>(&data[iz][0][0], ROWSIZE);
+
+				for(int iy = 0; iy < BS; ++iy)
+					sweep_strided<BS, true>(&data[0][iy][0], COLSIZE * ROWSIZE);
+
+				for(int iz = 0; iz < BS; ++iz)
+					xy_transpose<BS>(data[iz]);
+
+				xz_transpose<BS>(data);
+			}
+			else
+			{
+				xz_transpose<BS>(data);
+
+				for(int iz = 0; iz < BS; ++iz)
+					xy_transpose<BS>(data[iz]);
+
+				for(int iy = 0; iy < BS; ++iy)
+					sweep_strided<BS, false>(&data[0][iy][0], COLSIZE * ROWSIZE);
+
+				for(int iz = 0; iz < BS; ++iz)
+					sweep_strided<BS, false>(&data[iz][0][0], ROWSIZE);
+
+				for(int iz = 0; iz < BS; ++iz)
+					sweep_rows<BS, false>(data[iz]);
+			}
+		}
+	};
+}
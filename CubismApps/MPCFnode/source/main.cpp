@@ -20,7 +20,8 @@
 
 #include <omp.h>
 
-#ifdef _USE_HPM_
+//the perf_event hooks need no MPI
+#if defined(_USE_HPM_) && !defined(_USE_PERF_EVENT_)
 #include <mpi.h>
 #endif
 
@@ -29,6 +30,10 @@
 #include "Test_SIC.h"
 #include "Test_Cloud.h"
 
+#ifdef _USE_PERF_EVENT_
+#include "HPM_PerfEvent.h"
+#endif
+
 using namespace std;
 
 Simulation * sim = NULL;
@@ -94,7 +99,7 @@ int main (int argc, const char ** argv)
 
   cout << "Potential number of threads is " << omp_get_max_threads() << endl;
 
-#ifdef _USE_HPM_
+#if defined(_USE_HPM_) && !defined(_USE_PERF_EVENT_)
   MPI::Init();
 #endif
 
@@ -149,7 +154,11 @@ int main (int argc, const char ** argv)
 	
 	printf("we spent: %2.2f \n", wallclock);
 
-#ifdef _USE_HPM_
+#ifdef _USE_PERF_EVENT_
+	HPM_Report(parser("-hpmpeakperf").asDouble(0), parser("-hpmpeakbw").asDouble(0));
+#endif
+
+#if defined(_USE_HPM_) && !defined(_USE_PERF_EVENT_)
 	MPI::Finalize();
 #endif
 	
@@ -12,8 +12,8 @@
 
 #ifdef _PROFILE_
 #include <mpi.h>
-extern "C" void HPM_Start(char *);
-extern "C" void HPM_Stop(char *);
+extern "C" void HPM_Start(const char *);
+extern "C" void HPM_Stop(const char *);
 #endif
 
 
@@ -236,20 +236,20 @@ void benchmark(int argc, char *  argv[], const int NENTRIES_, const int NTIMES,
 			binit = true;
 		}
 		printf("Profiling now ...");
-		HPM_Start(const_cast<char *>(("WenoCPP"+ benchmark_name).c_str()));
+		HPM_Start(("WenoCPP"+ benchmark_name).c_str());
 		for(int i=0; i<NTIMES; ++i)
 			weno_reference(a, b, c, d, e, result, NENTRIES);
-		HPM_Stop(const_cast<char *>(("WenoCPP"+ benchmark_name).c_str()));
+		HPM_Stop(("WenoCPP"+ benchmark_name).c_str());
 		
-		HPM_Start(const_cast<char *>(("WenoQPX"+ benchmark_name).c_str()));
+		HPM_Start(("WenoQPX"+ benchmark_name).c_str());
 		for(int i=0; i<NTIMES; ++i)
 			wenoqpx(a, b, c, d, e, result, NENTRIES);
-		HPM_Stop(const_cast<char *>(("WenoQPX"+ benchmark_name).c_str()));
+		HPM_Stop(("WenoQPX"+ benchmark_name).c_str());
 		
-		HPM_Start(const_cast<char *>(("WenoQPXUnrolled"+ benchmark_name).c_str()));
+		HPM_Start(("WenoQPXUnrolled"+ benchmark_name).c_str());
 		for(int i=0; i<NTIMES; ++i)
 			wenoqpx_unrolled(a, b, c, d, e, result, NENTRIES);
-		HPM_Stop(const_cast<char *>(("WenoQPXUnrolled"+ benchmark_name).c_str()));
+		HPM_Stop(("WenoQPXUnrolled"+ benchmark_name).c_str());
 		
 		printf("done.\n");
 	}
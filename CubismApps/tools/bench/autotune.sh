@@ -0,0 +1,68 @@
+#!/bin/bash
+# usage: autotune.sh [tuned-file] [bench options]
+# one build per combination of the compile-time parameters of the convection kernel,
+# the fastest on this machine goes to tuned-file (default ../../Makefile.tuned), which Makefile.config includes
+#
+# candidates from the environment (the defaults sweep alignment and padding only):
+#   BS="16" ALIGN="16 32 64" SOAPAD="0 1 2" MICROFUSION="2" KERNEL=Convection_CPP
+#   MAKEARGS="qpxemu=1" with KERNEL=Convection_QPX and MICROFUSION="0 1 2" for the QPX kernels
+OUTPUT=${1:-../../Makefile.tuned}; shift
+
+BS=${BS:-16}
+ALIGN=${ALIGN:-"16 32 64"}
+SOAPAD=${SOAPAD:-"0 1 2"}
+MICROFUSION=${MICROFUSION:-2}
+KERNEL=${KERNEL:-Convection_CPP}
+
+OPTIONS="$@"
+if [ -z "$OPTIONS" ]; then OPTIONS="-bpd 4 -reps 5"; fi
+
+RESULTS=autotune.results
+rm -f $RESULTS
+
+for B in $BS; do
+for A in $ALIGN; do
+for P in $SOAPAD; do
+for M in $MICROFUSION; do
+	CONFIG="bs=$B align=$A soapad=$P microfusion=$M"
+
+	make clean > /dev/null
+	if ! make tuned=0 config=release $MAKEARGS $CONFIG > /dev/null 2>&1; then
+		echo "$CONFIG: build failed, skipped"
+		continue
+	fi
+
+	rm -f autotune.csv
+	./bench -kernel $KERNEL $OPTIONS -csv autotune.csv > /dev/null || exit 1
+
+	# microseconds per cell, summed over the thread counts and working sets of the sweep
+	SCORE=$(awk -F, -v bs=$B 'NR > 1 { s += $7 / (bs * bs * bs) } END { printf "%.6f", s }' autotune.csv)
+
+	echo "$CONFIG: $SCORE us per cell"
+	echo "$SCORE $B $A $P $M" >> $RESULTS
+done
+done
+done
+done
+
+rm -f autotune.csv
+make clean > /dev/null
+
+if [ ! -s $RESULTS ]; then echo "no configuration could be measured"; exit 1; fi
+
+read SCORE B A P M <<< "$(sort -g $RESULTS | head -n 1)"
+
+{
+	echo "# written by tools/bench/autotune.sh on $(hostname), $(date)"
+	echo "# $KERNEL${MAKEARGS:+ $MAKEARGS}, bench $OPTIONS"
+	sort -g $RESULTS | awk '{ printf "#   %s us per cell: bs=%s align=%s soapad=%s microfusion=%s\n", $1, $2, $3, $4, $5 }'
+	# the block size changes the resolution of the runs, it is pinned only if it was swept
+	if [ $(echo $BS | wc -w) -gt 1 ]; then echo "bs ?= $B"; fi
+	echo "align ?= $A"
+	echo "soapad ?= $P"
+	echo "microfusion ?= $M"
+} > $OUTPUT
+
+rm -f $RESULTS
+
+echo "fastest: bs=$B align=$A soapad=$P microfusion=$M, $SCORE us per cell, written to $OUTPUT"
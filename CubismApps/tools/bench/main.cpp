@@ -0,0 +1,724 @@
+/*
+ *  main.cpp
+ *  bench
+ *
+ *  Timings of the node kernels (Convection, Update, MaxSpeedOfSound), of BlockLab::load,
+ *  of the ghost pack/unpack, of the wavelet transforms and of the encoders.
+ *  Every kernel sweeps over all the blocks of a grid, for every thread count and grid size,
+ *  and the sweep is repeated: the report has median, mean, variance and min per block,
+ *  as text, CSV and JSON. -baseline compares the medians with a previous CSV.
+ *  The block size is a compile-time constant: sweep.sh builds and runs one binary per size.
+ *
+ */
+
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+
+#include <ArgumentParser.h>
+#include <Timer.h>
+
+#include "Types.h"
+#include <PUPkernelsMPI.h>
+#include "WaveletCompressor.h"
+#include "CompressionEncoders.h"
+
+#include "Convection_CPP.h"
+#include "Update.h"
+#include "MaxSpeedOfSound.h"
+
+#if defined(_QPX_) || defined(_QPXEMU_)
+#include "Convection_QPX.h"
+#include "Update_QPX.h"
+#include "MaxSpeedOfSound_QPX.h"
+#endif
+
+using namespace std;
+
+typedef BlockLab<FluidBlock, std::allocator> Lab;
+
+struct Measurement
+{
+	string kernel;
+	int bs, threads, blocks, reps;
+	double workingset; //MB of grid
+	double median, mean, variance, minimum; //seconds per block
+
+	Measurement(): bs(_BLOCKSIZE_), threads(0), blocks(0), reps(0), workingset(0), median(0), mean(0), variance(0), minimum(0) { }
+
+	//samples are seconds per block, one per sweep
+	void set(vector<double> samples)
+	{
+		const int n = samples.size();
+		assert(n > 0);
+
+		std::sort(samples.begin(), samples.end());
+
+		median = n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+		minimum = samples[0];
+
+		mean = 0;
+		for(int i = 0; i < n; ++i) mean += samples[i];
+		mean /= n;
+
+		variance = 0;
+		for(int i = 0; i < n; ++i) variance += pow(samples[i] - mean, 2);
+		variance /= max(1, n - 1);
+
+		reps = n;
+	}
+
+	string key() const
+	{
+		std::stringstream ss;
+		ss << kernel << " bs" << bs << " t" << threads << " b" << blocks;
+
+		return ss.str();
+	}
+};
+
+class Benchmark
+{
+	enum { BS = _BLOCKSIZE_, BS3 = BS * BS * BS, NFACES = 6, GHOSTS = 3, NCOMPONENTS = 7 };
+
+	FluidGrid * grid;
+	vector<BlockInfo> vInfo;
+	int nthreads;
+
+	vector<Lab *> labs;
+	vector<RHSWork *> works;
+
+	//scratch of the threads
+	vector<Real *> packs, unpacked, fields;
+	vector<WaveletCompressor *> compressors;
+	vector<unsigned char *> inbufs, outbufs;
+
+	size_t maxbytes;
+
+	//wavelet streams of the blocks (rho), and their encoded version for each encoder
+	vector< vector<unsigned char> > streams;
+	vector< vector< vector<unsigned char> > > encoded;
+
+	float threshold;
+	int encoder;
+
+	template<typename T>
+	T * _alloc(const size_t n)
+	{
+		void * ptr = NULL;
+		const int error = posix_memalign(&ptr, std::max(8, _ALIGNBYTES_), sizeof(T) * n);
+		assert(error == 0);
+
+		return (T *)ptr;
+	}
+
+	//smooth, positive fields: the kernels see the usual numbers, not denormals
+	void _initialize()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel for
+		for(int i = 0; i < N; ++i)
+		{
+			FluidBlock& b = *(FluidBlock *)vInfo[i].ptrBlock;
+
+			for(int iz = 0; iz < BS; ++iz)
+				for(int iy = 0; iy < BS; ++iy)
+					for(int ix = 0; ix < BS; ++ix)
+					{
+						double p[3];
+						vInfo[i].pos(p, ix, iy, iz);
+
+						const double s = sin(2 * M_PI * p[0]) * cos(2 * M_PI * p[1]) * sin(2 * M_PI * p[2]);
+
+						b(ix, iy, iz).clear();
+						b(ix, iy, iz).rho = 1 + 0.1 * s;
+						b(ix, iy, iz).u = 0.1 * s;
+						b(ix, iy, iz).v = 0.05 * s;
+						b(ix, iy, iz).w = -0.05 * s;
+						b(ix, iy, iz).energy = 2.5 + 0.2 * s;
+						b(ix, iy, iz).G = 2.5;
+						b(ix, iy, iz).P = 0;
+					}
+
+			b.clear_tmp();
+		}
+	}
+
+	void _face(const int f, int start[3], int end[3], const int offset) const
+	{
+		const int d = f / 2;
+
+		for(int c = 0; c < 3; ++c)
+		{
+			start[c] = offset;
+			end[c] = offset + BS;
+		}
+
+		start[d] = f % 2 ? BS - GHOSTS + 2 * offset : 0;
+		end[d] = f % 2 ? BS + 2 * offset : GHOSTS;
+	}
+
+	void _rho(const FluidBlock& b, Real * const field) const
+	{
+		for(int iz = 0; iz < BS; ++iz)
+			for(int iy = 0; iy < BS; ++iy)
+				for(int ix = 0; ix < BS; ++ix)
+					field[ix + BS * (iy + BS * iz)] = b(ix, iy, iz).rho;
+	}
+
+public:
+
+	Benchmark(const int bpd, const int nthreads, const float threshold):
+	grid(new FluidGrid(bpd, bpd, bpd)), vInfo(grid->getBlocksInfo()), nthreads(nthreads), threshold(threshold), encoder(ENCODER_NONE)
+	{
+		_initialize();
+
+		const int stencil_start[3] = {-3, -3, -3};
+		const int stencil_end[3] = {4, 4, 4};
+
+		maxbytes = 2 * BS3 * (sizeof(Real) + 1) + 1024;
+
+		for(int type = 0; type < ENCODER_TYPES; ++type)
+			maxbytes = max(maxbytes, encoder_scratchsize(type, maxbytes));
+
+		for(int t = 0; t < nthreads; ++t)
+		{
+			labs.push_back(new Lab);
+			labs.back()->prepare(*grid, stencil_start, stencil_end, false);
+			labs.back()->load(vInfo[0]);
+			works.push_back(new RHSWork);
+
+			packs.push_back(_alloc<Real>(NFACES * GHOSTS * BS * BS * NCOMPONENTS));
+			unpacked.push_back(_alloc<Real>((BS + 2 * GHOSTS) * (BS + 2 * GHOSTS) * (BS + 2 * GHOSTS) * FluidBlock::gptfloats));
+			fields.push_back(_alloc<Real>(BS3));
+			compressors.push_back(new WaveletCompressor);
+			inbufs.push_back(_alloc<unsigned char>(maxbytes));
+			outbufs.push_back(_alloc<unsigned char>(maxbytes));
+		}
+
+		//the data of the decoders
+		const int N = vInfo.size();
+		streams.resize(N);
+		encoded.resize(ENCODER_TYPES, vector< vector<unsigned char> >(N));
+
+		for(int i = 0; i < N; ++i)
+		{
+			_rho(*(FluidBlock *)vInfo[i].ptrBlock, fields[0]);
+			compressors[0]->copy_from(*(Real (*)[BS][BS][BS])fields[0]);
+
+			const size_t nbytes = compressors[0]->compress(threshold, false);
+			const unsigned char * const stream = (unsigned char *)compressors[0]->compressed_data();
+			streams[i].assign(stream, stream + nbytes);
+
+			for(int type = 0; type < ENCODER_TYPES; ++type)
+				if (encoder_available(type))
+				{
+					memcpy(inbufs[0], stream, nbytes);
+
+					size_t nencoded = 0;
+					const unsigned char * const e = ::encode(type, encoder_default_level(type), inbufs[0], nbytes, maxbytes, outbufs[0], nencoded);
+					encoded[type][i].assign(e, e + nencoded);
+				}
+		}
+	}
+
+	~Benchmark()
+	{
+		for(int t = 0; t < nthreads; ++t)
+		{
+			delete labs[t];
+			delete works[t];
+			free(packs[t]);
+			free(unpacked[t]);
+			free(fields[t]);
+			delete compressors[t];
+			free(inbufs[t]);
+			free(outbufs[t]);
+		}
+
+		delete grid;
+	}
+
+	int nblocks() const { return vInfo.size(); }
+
+	double workingset() const { return vInfo.size() * sizeof(FluidBlock) / 1024. / 1024.; }
+
+	void set_encoder(const int type) { encoder = type; }
+
+	//the labs were loaded once, here we time the kernel only
+	template<typename TConvection>
+	void convection()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			TConvection kernel(0, 1);
+			Lab& lab = *labs[omp_get_thread_num()];
+			RHSWork& work = *works[omp_get_thread_num()];
+
+			const Real * const srcfirst = &lab(-3, -3, -3).rho;
+			const int labSizeRow = lab.template getActualSize<0>();
+			const int labSizeSlice = labSizeRow * lab.template getActualSize<1>();
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				((FluidBlock *)vInfo[i].ptrBlock)->rhs(kernel, work, true, srcfirst, labSizeRow, labSizeSlice);
+			}
+		}
+	}
+
+	//b = 0 leaves the data as they are, at the same cost
+	template<typename TUpdate>
+	void update()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			TUpdate kernel(0);
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				((FluidBlock *)vInfo[i].ptrBlock)->update(kernel);
+			}
+		}
+	}
+
+	template<typename TSOS>
+	void maxsos()
+	{
+		const int N = vInfo.size();
+		Real sos = 0;
+
+#pragma omp parallel
+		{
+			TSOS kernel;
+			Real mysos = 0;
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+				mysos = max(mysos, ((FluidBlock *)vInfo[i].ptrBlock)->sos(kernel));
+
+#pragma omp critical
+			sos = max(sos, mysos);
+		}
+
+		assert(sos > 0);
+	}
+
+	void load()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			Lab& lab = *labs[omp_get_thread_num()];
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+				lab.load(vInfo[i]);
+		}
+	}
+
+	//the six faces of each block, as the synchronizer sends them
+	void pack()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			Real * const dst = packs[omp_get_thread_num()];
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				const Real * const src = (const Real *)vInfo[i].ptrBlock;
+
+				for(int f = 0, s = 0; f < NFACES; ++f)
+				{
+					int start[3], end[3];
+					_face(f, start, end, 0);
+
+					pack_stripes(src, dst + s, FluidBlock::gptfloats, 0, NCOMPONENTS,
+								 start[0], start[1], start[2], end[0], end[1], end[2]);
+
+					s += (end[0] - start[0]) * (end[1] - start[1]) * (end[2] - start[2]) * NCOMPONENTS;
+				}
+			}
+		}
+	}
+
+	//the six faces into the ghosts of a lab-sized region
+	void unpack()
+	{
+		const int N = vInfo.size();
+		const int L = BS + 2 * GHOSTS;
+		int components[NCOMPONENTS];
+
+		for(int c = 0; c < NCOMPONENTS; ++c)
+			components[c] = c;
+
+#pragma omp parallel
+		{
+			const Real * const src = packs[omp_get_thread_num()];
+			Real * const dst = unpacked[omp_get_thread_num()];
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+				for(int f = 0, s = 0; f < NFACES; ++f)
+				{
+					int start[3], end[3];
+					_face(f, start, end, GHOSTS);
+
+					const int n = (end[0] - start[0]) * (end[1] - start[1]) * (end[2] - start[2]) * NCOMPONENTS;
+
+					::unpack(src + s, dst, FluidBlock::gptfloats, components, NCOMPONENTS, n,
+							 start[0], start[1], start[2], end[0], end[1], end[2], L, L, L);
+
+					s += n;
+				}
+		}
+	}
+
+	//forward transform, thresholding and bitset of one channel
+	void fwt()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			const int tid = omp_get_thread_num();
+			Real * const field = fields[tid];
+			WaveletCompressor& compressor = *compressors[tid];
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				_rho(*(FluidBlock *)vInfo[i].ptrBlock, field);
+				compressor.copy_from(*(Real (*)[BS][BS][BS])field);
+				compressor.compress(threshold, false);
+			}
+		}
+	}
+
+	void iwt()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			WaveletCompressor& compressor = *compressors[omp_get_thread_num()];
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				memcpy(compressor.compressed_data(), &streams[i].front(), streams[i].size());
+				compressor.decompress(false, streams[i].size());
+			}
+		}
+	}
+
+	void encode()
+	{
+		const int N = vInfo.size();
+		const int level = encoder_default_level(encoder);
+
+#pragma omp parallel
+		{
+			const int tid = omp_get_thread_num();
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				memcpy(inbufs[tid], &streams[i].front(), streams[i].size());
+
+				size_t nencoded = 0;
+				::encode(encoder, level, inbufs[tid], streams[i].size(), maxbytes, outbufs[tid], nencoded);
+			}
+		}
+	}
+
+	void decode()
+	{
+		const int N = vInfo.size();
+
+#pragma omp parallel
+		{
+			const int tid = omp_get_thread_num();
+
+#pragma omp for schedule(runtime)
+			for(int i = 0; i < N; ++i)
+			{
+				const size_t n = ::decode(encoder, &encoded[encoder][i].front(), encoded[encoder][i].size(), outbufs[tid], maxbytes);
+				assert(n == streams[i].size());
+			}
+		}
+	}
+
+	//compressed bytes over raw bytes of the channel
+	double encoded_ratio() const
+	{
+		double e = 0;
+
+		for(int i = 0; i < vInfo.size(); ++i)
+			e += encoded[encoder][i].size();
+
+		return vInfo.size() * BS3 * sizeof(Real) / max(1., e);
+	}
+};
+
+typedef void (Benchmark::*Sweep)();
+
+Measurement measure(Benchmark& bench, const string kernel, Sweep sweep, const int nthreads, const int reps)
+{
+	omp_set_num_threads(nthreads);
+
+	//warm up
+	(bench.*sweep)();
+
+	vector<double> samples;
+
+	for(int r = 0; r < reps; ++r)
+	{
+		Timer timer;
+
+		timer.start();
+		(bench.*sweep)();
+		samples.push_back(timer.stop() / bench.nblocks());
+	}
+
+	Measurement m;
+	m.kernel = kernel;
+	m.threads = nthreads;
+	m.blocks = bench.nblocks();
+	m.workingset = bench.workingset();
+	m.set(samples);
+
+	printf("%-24s bs %3d threads %3d blocks %6d (%7.1f MB): median %10.3f us/block, mean %10.3f, std %8.3f, min %10.3f\n",
+		   m.kernel.c_str(), m.bs, m.threads, m.blocks, m.workingset,
+		   m.median * 1e6, m.mean * 1e6, sqrt(m.variance) * 1e6, m.minimum * 1e6);
+
+	return m;
+}
+
+vector<int> parse_list(const string list)
+{
+	vector<int> values;
+	std::stringstream ss(list);
+	string item;
+
+	while (std::getline(ss, item, ','))
+		if (item.size() > 0)
+			values.push_back(atoi(item.c_str()));
+
+	return values;
+}
+
+const char * csv_header = "kernel,bs,threads,blocks,ws_mb,reps,median_us,mean_us,var_us2,min_us";
+
+void write_csv(const string filename, const vector<Measurement>& ms)
+{
+	FILE * f = fopen(filename.c_str(), "w");
+	assert(f);
+
+	fprintf(f, "%s\n", csv_header);
+
+	for(int i = 0; i < ms.size(); ++i)
+		fprintf(f, "%s,%d,%d,%d,%.3f,%d,%.6f,%.6f,%.6e,%.6f\n", ms[i].kernel.c_str(), ms[i].bs, ms[i].threads, ms[i].blocks,
+				ms[i].workingset, ms[i].reps, ms[i].median * 1e6, ms[i].mean * 1e6, ms[i].variance * 1e12, ms[i].minimum * 1e6);
+
+	fclose(f);
+}
+
+void write_json(const string filename, const vector<Measurement>& ms)
+{
+	FILE * f = fopen(filename.c_str(), "w");
+	assert(f);
+
+	fprintf(f, "{\n\"bs\": %d,\n\"real\": \"%s\",\n\"unit\": \"us/block\",\n\"results\": [\n", _BLOCKSIZE_, sizeof(Real) == 4 ? "float" : "double");
+
+	for(int i = 0; i < ms.size(); ++i)
+		fprintf(f, "{\"kernel\": \"%s\", \"bs\": %d, \"threads\": %d, \"blocks\": %d, \"ws_mb\": %.3f, \"reps\": %d, "
+				"\"median\": %.6f, \"mean\": %.6f, \"variance\": %.6e, \"min\": %.6f}%s\n",
+				ms[i].kernel.c_str(), ms[i].bs, ms[i].threads, ms[i].blocks, ms[i].workingset, ms[i].reps,
+				ms[i].median * 1e6, ms[i].mean * 1e6, ms[i].variance * 1e12, ms[i].minimum * 1e6, i + 1 < ms.size() ? "," : "");
+
+	fprintf(f, "]\n}\n");
+
+	fclose(f);
+}
+
+//the measurements of a CSV written by write_csv (or by sweep.sh)
+map<string, Measurement> read_csv(const string filename)
+{
+	map<string, Measurement> ms;
+
+	std::ifstream f(filename.c_str());
+
+	if (!f.good())
+	{
+		printf("Could not open the baseline %s. Aborting.\n", filename.c_str());
+		abort();
+	}
+
+	string line;
+
+	while (std::getline(f, line))
+	{
+		if (line.size() == 0 || line == csv_header) continue;
+
+		std::stringstream ss(line);
+		vector<string> items;
+		string item;
+
+		while (std::getline(ss, item, ','))
+			items.push_back(item);
+
+		if (items.size() != 10) continue;
+
+		Measurement m;
+		m.kernel = items[0];
+		m.bs = atoi(items[1].c_str());
+		m.threads = atoi(items[2].c_str());
+		m.blocks = atoi(items[3].c_str());
+		m.workingset = atof(items[4].c_str());
+		m.reps = atoi(items[5].c_str());
+		m.median = atof(items[6].c_str()) * 1e-6;
+		m.mean = atof(items[7].c_str()) * 1e-6;
+		m.variance = atof(items[8].c_str()) * 1e-12;
+		m.minimum = atof(items[9].c_str()) * 1e-6;
+
+		ms[m.key()] = m;
+	}
+
+	return ms;
+}
+
+//returns the number of regressions: medians slower than the baseline by more than tolerance
+int compare(const vector<Measurement>& ms, const map<string, Measurement>& baseline, const double tolerance)
+{
+	int nregressions = 0, nmatched = 0;
+
+	printf("\nComparison with the baseline (tolerance %.1f%%):\n", tolerance * 100);
+	printf("%-24s %3s %7s %6s %12s %12s %7s\n", "kernel", "bs", "threads", "blocks", "median[us]", "baseline[us]", "ratio");
+
+	for(int i = 0; i < ms.size(); ++i)
+	{
+		map<string, Measurement>::const_iterator it = baseline.find(ms[i].key());
+
+		if (it == baseline.end()) continue;
+
+		const double ratio = ms[i].median / it->second.median;
+		const bool slower = ratio > 1 + tolerance;
+		const bool faster = ratio < 1 - tolerance;
+
+		printf("%-24s %3d %7d %6d %12.3f %12.3f %7.3f %s\n", ms[i].kernel.c_str(), ms[i].bs, ms[i].threads, ms[i].blocks,
+			   ms[i].median * 1e6, it->second.median * 1e6, ratio, slower ? "REGRESSION" : (faster ? "faster" : ""));
+
+		nregressions += slower;
+		++nmatched;
+	}
+
+	printf("%d measurements compared, %d not in the baseline, %d regressions\n", nmatched, (int)ms.size() - nmatched, nregressions);
+
+	return nregressions;
+}
+
+int main(int argc, const char ** argv)
+{
+	ArgumentParser parser(argc, argv);
+
+	//default: 1, 2, 4, ... up to the cores
+	vector<int> threads = parse_list(parser("-threads").asString(""));
+
+	if (threads.size() == 0)
+	{
+		for(int t = 1; t < omp_get_max_threads(); t *= 2)
+			threads.push_back(t);
+
+		threads.push_back(omp_get_max_threads());
+	}
+
+	//the working sets: grids of bpd^3 blocks
+	const vector<int> bpds = parse_list(parser("-bpd").asString("2,4,8"));
+	const int reps = parser("-reps").asInt(10);
+	const float threshold = parser("-threshold").asDouble(1e-3);
+	const string filter = parser("-kernel").asString("all");
+	const string csvfile = parser("-csv").asString("");
+	const string jsonfile = parser("-json").asString("");
+	const string baselinefile = parser("-baseline").asString("");
+	const double tolerance = parser("-tolerance").asDouble(0.1);
+
+	struct { const char * name; Sweep sweep; } kernels[] = {
+		{ "Convection_CPP", &Benchmark::convection<Convection_CPP> },
+		{ "Update_CPP", &Benchmark::update<Update_CPP> },
+		{ "MaxSOS_CPP", &Benchmark::maxsos<MaxSpeedOfSound_CPP> },
+#if defined(_QPX_) || defined(_QPXEMU_)
+		{ "Convection_QPX", &Benchmark::convection<Convection_QPX> },
+		{ "Update_QPX", &Benchmark::update<Update_QPX> },
+		{ "MaxSOS_QPX", &Benchmark::maxsos<MaxSpeedOfSound_QPX> },
+#endif
+		{ "BlockLab::load", &Benchmark::load },
+		{ "pack", &Benchmark::pack },
+		{ "unpack", &Benchmark::unpack },
+		{ "FWT", &Benchmark::fwt },
+		{ "IWT", &Benchmark::iwt }
+	};
+
+	const int nkernels = sizeof(kernels) / sizeof(kernels[0]);
+	const int maxthreads = *std::max_element(threads.begin(), threads.end());
+
+	vector<Measurement> ms;
+
+	for(int b = 0; b < bpds.size(); ++b)
+	{
+		Benchmark bench(bpds[b], maxthreads, threshold);
+
+		for(int t = 0; t < threads.size(); ++t)
+		{
+			for(int k = 0; k < nkernels; ++k)
+				if (filter == "all" || filter == kernels[k].name)
+					ms.push_back(measure(bench, kernels[k].name, kernels[k].sweep, threads[t], reps));
+
+			for(int type = 0; type < ENCODER_TYPES; ++type)
+			{
+				if (type == ENCODER_NONE || !encoder_available(type)) continue;
+
+				const string name = encoder_name(type);
+
+				const bool doencode = filter == "all" || filter == "encode_" + name;
+				const bool dodecode = filter == "all" || filter == "decode_" + name;
+
+				if (!doencode && !dodecode) continue;
+
+				bench.set_encoder(type);
+
+				if (t == 0)
+					printf("%s: compression rate of the wavelet streams %.2f\n", name.c_str(), bench.encoded_ratio());
+
+				if (doencode) ms.push_back(measure(bench, "encode_" + name, &Benchmark::encode, threads[t], reps));
+				if (dodecode) ms.push_back(measure(bench, "decode_" + name, &Benchmark::decode, threads[t], reps));
+			}
+		}
+	}
+
+	if (csvfile != "") write_csv(csvfile, ms);
+	if (jsonfile != "") write_json(jsonfile, ms);
+
+	if (baselinefile != "")
+		return compare(ms, read_csv(baselinefile), tolerance) > 0 ? 1 : 0;
+
+	return 0;
+}
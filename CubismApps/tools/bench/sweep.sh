@@ -0,0 +1,18 @@
+#!/bin/bash
+# usage: sweep.sh "8 16 32" results.csv [bench options]
+# one build per block size, all the measurements in one CSV (a baseline for -baseline)
+BLOCKSIZES=$1; OUTPUT=$2; shift 2
+
+rm -f $OUTPUT
+
+for BS in $BLOCKSIZES
+do
+	make clean > /dev/null
+	make bs=$BS config=release > /dev/null || exit 1
+
+	./bench "$@" -csv $OUTPUT.bs$BS || exit 1
+
+	if [ ! -f $OUTPUT ]; then head -n 1 $OUTPUT.bs$BS > $OUTPUT; fi
+	tail -n +2 $OUTPUT.bs$BS >> $OUTPUT
+	rm $OUTPUT.bs$BS
+done
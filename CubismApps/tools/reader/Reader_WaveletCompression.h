@@ -7,14 +7,23 @@
  *
  */
 
+#pragma once
+
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
 #include <cassert>
 #include <string>
 #include <vector>
+#include <list>
+#include <map>
 #include <iostream>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <mpi.h>
 
 using namespace std;
@@ -31,6 +40,7 @@ typedef double Real;
 #include "../../MPCFcluster/source/CompressionEncoders.h"
 #include "../../MPCFnode/source/FullWaveletTransform.h"
 
+#ifndef MYASSERT
 //MACRO TAKEN FROM http://stackoverflow.com/questions/3767869/adding-message-to-assert
 #   define MYASSERT(condition, message) \
 do { \
@@ -40,6 +50,7 @@ std::cerr << "Assertion `" #condition "` failed in " << __FILE__ \
 std::exit(EXIT_FAILURE); \
 } \
 } while (false)
+#endif
 
 class Reader_WaveletCompression
 {
@@ -51,9 +62,43 @@ protected:
 	int NBLOCKS;
 	int totalbpd[3], bpd[3];
 	bool halffloat;
+	float threshold;
+	int encoder;
 	
 	vector<CompressedBlock> idx2chunk;
 	
+	//the file stays mapped from the first block request on
+	int filedescriptor;
+	size_t filesize;
+	unsigned char * filedata;
+	
+public:
+	
+	//a decoded chunk and where its blocks start.
+	//data only grows: a chunk reused for many decodes allocates once
+	struct DecodedChunk
+	{
+		size_t start; //address of the compressed chunk, -1 if none
+		vector<unsigned char> data; //the first nbytes are valid
+		size_t nbytes;
+		vector<int> offsets; //one per subid
+		
+		DecodedChunk(): start((size_t)-1), nbytes(0) { }
+	};
+	
+protected:
+	
+	//LRU cache of decoded chunks, keyed by the chunk start address, most recent in front
+	typedef list< pair<size_t, DecodedChunk> > ChunkList;
+	ChunkList lru;
+	map<size_t, ChunkList::iterator> cachedchunks;
+	size_t cache_bytes, cache_maxbytes;
+	
+	DecodedChunk decoding; //output of the decoder for _fetch_chunk, the cache keeps exact-size copies
+	
+	//the writer flushes its per-thread buffers before they reach 4 MB (DESIREDMEM)
+	enum { CHUNKMAXBYTES = 4 << 20 };
+	
 	int _id(int ix, int iy, int iz) const
 	{
 		assert(ix >= 0 && ix < totalbpd[0]);
@@ -63,9 +108,131 @@ protected:
 		return ix + totalbpd[0] * ( iy + totalbpd[1] * iz );
 	}
 	
+	void _map_file()
+	{
+		if (filedata != NULL) return;
+		
+		filedescriptor = open(path.c_str(), O_RDONLY);
+		MYASSERT(filedescriptor >= 0, "\nAAATTENZIONE:\nOooops could not open the file. Path: " << path);
+		
+		struct stat filestatus;
+		fstat(filedescriptor, &filestatus);
+		filesize = filestatus.st_size;
+		
+		MYASSERT(filesize >= global_header_displacement, "\nATTENZIONE:\nThe file is truncated. Path: " << path);
+		
+		void * const ptr = mmap(NULL, filesize, PROT_READ, MAP_SHARED, filedescriptor, 0);
+		MYASSERT(ptr != MAP_FAILED, "\nATTENZIONE:\nCould not map the file. Path: " << path);
+		
+		filedata = (unsigned char *)ptr;
+	}
+	
+	void _unmap_file()
+	{
+		if (filedata == NULL) return;
+		
+		munmap(filedata, filesize);
+		close(filedescriptor);
+		
+		filedata = NULL;
+		filedescriptor = -1;
+	}
+	
+	//decodes the chunk and indexes the blocks in it: each block is an int with the 
+	//size of the wavelet stream, followed by the stream itself
+	void _decode_chunk(const CompressedBlock compressedchunk, DecodedChunk& chunk) const
+	{
+		assert(filedata != NULL);
+		assert(compressedchunk.start >= miniheader_bytes);
+		assert(compressedchunk.start < global_header_displacement);
+		assert(compressedchunk.start + compressedchunk.extent <= global_header_displacement);
+		
+		chunk.start = compressedchunk.start;
+		
+		if (chunk.data.size() < CHUNKMAXBYTES)
+			chunk.data.resize(CHUNKMAXBYTES);
+		
+		const size_t decompressedbytes = decode(encoder, filedata + compressedchunk.start, compressedchunk.extent, &chunk.data.front(), chunk.data.size());
+		chunk.nbytes = decompressedbytes;
+		
+		chunk.offsets.clear();
+		
+		for(size_t readbytes = 0; readbytes < decompressedbytes; )
+		{
+			chunk.offsets.push_back(readbytes);
+			
+			const int nbytes = *(int *)&chunk.data[readbytes];
+			readbytes += sizeof(int) + nbytes;
+			
+			assert(readbytes <= decompressedbytes);
+		}
+	}
+	
+	//writes (_BLOCKSIZE_ >> coarsening)^3 values, x fastest
+	void _decompress_block(const DecodedChunk& chunk, const int subid, Real * const dst, const int coarsening) const
+	{
+		assert(subid >= 0 && subid < chunk.offsets.size());
+		
+		const int start = chunk.offsets[subid];
+		const int nbytes = *(int *)&chunk.data[start];
+		
+		WaveletCompressor compressor;
+		
+		memcpy(compressor.compressed_data(), &chunk.data[start + sizeof(int)], nbytes);
+		
+		compressor.decompress_coarse(halffloat, nbytes, coarsening);
+		compressor.copy_coarse_to(dst, coarsening);
+	}
+	
+	const DecodedChunk& _fetch_chunk(const CompressedBlock compressedchunk)
+	{
+		map<size_t, ChunkList::iterator>::iterator it = cachedchunks.find(compressedchunk.start);
+		
+		if (it != cachedchunks.end())
+		{
+			lru.splice(lru.begin(), lru, it->second);
+			
+			return lru.front().second;
+		}
+		
+		_map_file();
+		
+		_decode_chunk(compressedchunk, decoding);
+		
+		lru.push_front(make_pair(compressedchunk.start, DecodedChunk()));
+		
+		DecodedChunk& cached = lru.front().second;
+		cached.start = decoding.start;
+		cached.data.assign(decoding.data.begin(), decoding.data.begin() + decoding.nbytes);
+		cached.nbytes = decoding.nbytes;
+		cached.offsets.swap(decoding.offsets);
+		
+		cachedchunks[compressedchunk.start] = lru.begin();
+		cache_bytes += cached.nbytes;
+		
+		//evict, but never the chunk we just decoded
+		while (cache_bytes > cache_maxbytes && lru.size() > 1)
+		{
+			cache_bytes -= lru.back().second.nbytes;
+			cachedchunks.erase(lru.back().first);
+			lru.pop_back();
+		}
+		
+		return lru.front().second;
+	}
+	
 public:
 	
-	Reader_WaveletCompression(const string path): NBLOCKS(-1), global_header_displacement(-1), path(path) {	}
+	Reader_WaveletCompression(const string path): NBLOCKS(-1), global_header_displacement(-1), threshold(-1), encoder(-1), path(path),
+	filedescriptor(-1), filesize(0), filedata(NULL), cache_bytes(0), cache_maxbytes(256 << 20) {	}
+	
+	virtual ~Reader_WaveletCompression() { _unmap_file(); }
+	
+	//upper bound for the decoded chunks kept around by load_block
+	void set_cache_size(const size_t megabytes)
+	{
+		cache_maxbytes = megabytes << 20;
+	}
 	
 	virtual void load_file()
 	{		
@@ -170,21 +337,15 @@ public:
 						 "\nATTENZIONE:\nWavelets in the file is " << buf << 
 						 " and i have " << WaveletsOnInterval::ChosenWavelets_GetName() << "\n");
 				
-				float mythreshold = -1;
-				fscanf(file, "WaveletThreshold: %f\n", &mythreshold);
-				printf("WaveletThreshold: <%f>\n", mythreshold);
+				fscanf(file, "WaveletThreshold: %f\n", &threshold);
+				printf("WaveletThreshold: <%f>\n", threshold);
 				
 				fscanf(file, "Encoder: %s\n", buf);
 				printf("Encoder: <%s>\n", buf);
-#if defined(_USE_ZLIB_)
-				MYASSERT(buf == string("zlib"),
+				encoder = encoder_type(buf);
+				MYASSERT(encoder >= 0 && encoder_available(encoder),
 						 "\nATTENZIONE:\nEncoder in the file is " << buf << 
-						 " and i have zlib.\n");
-#else	/* _USE_LZ4_ */
-				MYASSERT(buf == string("lz4"),
-						 "\nATTENZIONE:\nEncoder in the file is " << buf << 
-						 " and i have lz4.\n");
-#endif
+						 " and this build cannot decode it.\n");
 				
 				fgets(buf, sizeof(buf), file);
 				
@@ -334,60 +495,138 @@ public:
 			const double footprint_mb =  size_idx2chunk / 1024. / 1024.;
 			printf("the header data is taking %.2f MB\n", footprint_mb);
 		}
+		
+		_map_file();
 	}
 	
+	//lossless only with threshold 0 and full precision
+	bool is_halffloat() const { return halffloat; }
+	float wavelet_threshold() const { return threshold; }
+	
 	int xblocks() { return totalbpd[0]; } 
 	int yblocks() { return totalbpd[1]; } 
 	int zblocks() { return totalbpd[2]; } 
 	
+	//blocks per dimension of the subdomains (one per simulation rank), their chunks are not shared
+	int subdomain_blocks(const int dim) const { return bpd[dim]; }
+	
+	//the finest levels that can be skipped: 0 is full resolution,
+	//with coarsening c every block shrinks to (_BLOCKSIZE_ >> c)^3 values
+	int max_coarsening() const { return WaveletCompressor::levels(); }
+	
+	//not thread-safe: it goes through the chunk cache
 	void load_block(int ix, int iy, int iz, Real MYBLOCK[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_])
 	{
-		//printf("trying to load <%s>\n", path.c_str());
-		FILE * f = fopen(path.c_str(), "rb");
+		load_block(ix, iy, iz, &MYBLOCK[0][0][0], 0);
+	}
+	
+	void load_block(int ix, int iy, int iz, Real * const dst, const int coarsening)
+	{
+		MYASSERT(coarsening >= 0 && coarsening <= max_coarsening(), "coarsening must be within 0 and " << max_coarsening());
 		
-		assert(f);
+		const CompressedBlock compressedchunk = idx2chunk[_id(ix, iy, iz)];
 		
-		CompressedBlock compressedchunk = idx2chunk[_id(ix, iy, iz)];
+		_decompress_block(_fetch_chunk(compressedchunk), compressedchunk.subid, dst, coarsening);
+	}
+	
+	//thread-safe: bypasses the cache, the chunk is decoded into scratch unless it is already there
+	void load_block(int ix, int iy, int iz, Real MYBLOCK[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_], DecodedChunk& scratch) const
+	{
+		const CompressedBlock compressedchunk = idx2chunk[_id(ix, iy, iz)];
+		
+		if (scratch.start != compressedchunk.start)
+			_decode_chunk(compressedchunk, scratch);
 		
-		size_t start = compressedchunk.start;
+		_decompress_block(scratch, compressedchunk.subid, &MYBLOCK[0][0][0], 0);
+	}
+	
+	//groups the blocks [start, end) by chunk. blocks are identified by ix + xblocks * (iy + yblocks * iz)
+	void region_chunks(const int start[3], const int end[3], vector< vector<int> >& chunk2blocks)
+	{
+		for(int d = 0; d < 3; ++d)
+			assert(start[d] >= 0 && start[d] < end[d] && end[d] <= totalbpd[d]);
 		
-		assert(start >= miniheader_bytes);
-		assert(start < global_header_displacement);
-		assert(start + compressedchunk.extent <= global_header_displacement);
+		_map_file();
 		
-		vector<unsigned char> compressedbuf(compressedchunk.extent);
-		fseek(f, compressedchunk.start, SEEK_SET);
-		fread(&compressedbuf.front(), compressedchunk.extent, 1, f);
+		map<size_t, vector<int> > groups;
 		
-		assert(!feof(f));
+		for(int iz = start[2]; iz < end[2]; ++iz)
+			for(int iy = start[1]; iy < end[1]; ++iy)
+				for(int ix = start[0]; ix < end[0]; ++ix)
+					groups[idx2chunk[_id(ix, iy, iz)].start].push_back(_id(ix, iy, iz));
 		
-		vector<unsigned char> waveletbuf(4 << 20);
-		const size_t decompressedbytes = zdecompress(&compressedbuf.front(), compressedbuf.size(), &waveletbuf.front(), waveletbuf.size());
+		chunk2blocks.clear();
 		
-		int readbytes = 0;
-		for(int i = 0; i<compressedchunk.subid; ++i)
-		{
-			int nbytes = * (int *) & waveletbuf[readbytes];
-			readbytes += sizeof(int);
-			readbytes += nbytes;
-			
-			assert(readbytes <= decompressedbytes);			
-		}
+		for(map<size_t, vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it)
+			chunk2blocks.push_back(it->second);
+	}
+	
+	//thread-safe: decodes the chunk that contains the block
+	void decode_chunk(const int blockid, DecodedChunk& chunk) const
+	{
+		_decode_chunk(idx2chunk[blockid], chunk);
+	}
+	
+	//thread-safe: (_BLOCKSIZE_ >> coarsening)^3 values into dst, x fastest
+	void decompress_block(const DecodedChunk& chunk, const int blockid, Real * const dst, const int coarsening = 0) const
+	{
+		_decompress_block(chunk, idx2chunk[blockid].subid, dst, coarsening);
+	}
+	
+	//loads the blocks [start, end) into dst, x fastest, at (_BLOCKSIZE_ >> coarsening) values per block side.
+	//every chunk touched by the region is decoded once, chunks are processed in parallel
+	void load_region(const int start[3], const int end[3], Real * const dst, const int coarsening = 0)
+	{
+		MYASSERT(coarsening >= 0 && coarsening <= max_coarsening(), "coarsening must be within 0 and " << max_coarsening());
 		
+		vector< vector<int> > chunk2blocks;
+		region_chunks(start, end, chunk2blocks);
+		
+		const int N = _BLOCKSIZE_ >> coarsening;
+		const size_t xsize = (end[0] - start[0]) * N;
+		const size_t ysize = (end[1] - start[1]) * N;
+		const int nchunks = chunk2blocks.size();
+		
+#pragma omp parallel
 		{
-			int nbytes = *(int *)&waveletbuf[readbytes];
-			readbytes += sizeof(int);
-			assert(readbytes <= decompressedbytes);
-			//printf("decompressing %d bytes...\n", nbytes);
-			WaveletCompressor compressor;
-			
-			memcpy(compressor.compressed_data(), &waveletbuf[readbytes], nbytes);
-			readbytes += nbytes;
+			DecodedChunk chunk;
+			Real MYBLOCK[_BLOCKSIZE_ * _BLOCKSIZE_ * _BLOCKSIZE_];
 			
-			compressor.decompress(halffloat, nbytes, MYBLOCK);
+#pragma omp for schedule(dynamic, 1)
+			for(int c = 0; c < nchunks; ++c)
+			{
+				const vector<int>& myblocks = chunk2blocks[c];
+				
+				decode_chunk(myblocks.front(), chunk);
+				
+				for(int i = 0; i < myblocks.size(); ++i)
+				{
+					const int id = myblocks[i];
+					
+					decompress_block(chunk, id, MYBLOCK, coarsening);
+					
+					const int bx = id % totalbpd[0] - start[0];
+					const int by = (id / totalbpd[0]) % totalbpd[1] - start[1];
+					const int bz = id / (totalbpd[0] * totalbpd[1]) - start[2];
+					
+					for(int iz = 0; iz < N; ++iz)
+						for(int iy = 0; iy < N; ++iy)
+						{
+							Real * const dstrow = dst + bx * N + xsize * (by * N + iy + ysize * (bz * N + iz));
+							
+							memcpy(dstrow, MYBLOCK + N * (iy + N * iz), sizeof(Real) * N);
+						}
+				}
+			}
 		}
+	}
+	
+	//the whole field, x fastest
+	void load_all(Real * const dst, const int coarsening = 0)
+	{
+		const int start[3] = { 0, 0, 0 };
 		
-		fclose(f);
+		load_region(start, totalbpd, dst, coarsening);
 	}
 };
 
@@ -418,6 +657,8 @@ public:
 			comm.Bcast(totalbpd, sizeof(totalbpd), MPI_CHAR, 0);
 			comm.Bcast(bpd, sizeof(bpd), MPI_CHAR, 0);
 			comm.Bcast(&halffloat, sizeof(halffloat), MPI_CHAR, 0);
+			comm.Bcast(&threshold, sizeof(threshold), MPI_CHAR, 0);
+			comm.Bcast(&encoder, sizeof(encoder), MPI_CHAR, 0);
 		}
 		
 		size_t nentries = idx2chunk.size();
@@ -431,5 +672,74 @@ public:
 		char * const entries = (char *)&idx2chunk.front();
 		
 		comm.Bcast(entries, nbytes, MPI_CHAR, 0);
+		
+		_map_file();
 	}
 };
+
+//the files written with subfiles (see SerializerIO_WaveletCompression_MPI_SimpleBlocking::_to_file_aggregated)
+//back into one file that the readers understand: the index keeps the sizes of the subfiles in place of the ocean
+inline void WaveletSubfiles_Assemble(const string indexpath, const string outputpath)
+{
+	const string binaryocean_title = "\n==============START-BINARY-OCEAN==============\n";
+	const string binarysubfiles_title = "\n==============START-BINARY-SUBFILES==============\n";
+	const size_t miniheader_bytes = sizeof(size_t) + binaryocean_title.size();
+	
+	FILE * index = fopen(indexpath.c_str(), "rb");
+	MYASSERT(index, "\nATTENZIONE:\ncannot open " << indexpath);
+	
+	vector<char> miniheader(miniheader_bytes);
+	MYASSERT(fread(&miniheader.front(), 1, miniheader_bytes, index) == miniheader_bytes, "\nATTENZIONE:\n" << indexpath << " is truncated (mini-header)");
+	
+	const size_t header_displacement = *(size_t *)&miniheader.front();
+	
+	vector<char> title(binarysubfiles_title.size());
+	MYASSERT(fread(&title.front(), 1, title.size(), index) == title.size(), "\nATTENZIONE:\n" << indexpath << " is truncated (subfiles title)");
+	MYASSERT(string(title.begin(), title.end()) == binarysubfiles_title, "\nATTENZIONE:\n" << indexpath << " has no subfiles");
+	
+	int ngroups = -1;
+	MYASSERT(fread(&ngroups, sizeof(int), 1, index) == 1, "\nATTENZIONE:\n" << indexpath << " is truncated (number of subfiles)");
+	MYASSERT(ngroups > 0, "\nATTENZIONE:\n" << indexpath << " lists " << ngroups << " subfiles, the index is corrupt");
+	
+	vector<size_t> subfilebytes(ngroups);
+	MYASSERT(fread(&subfilebytes.front(), sizeof(size_t), ngroups, index) == (size_t)ngroups, "\nATTENZIONE:\n" << indexpath << " is truncated (sizes of the subfiles)");
+	
+	FILE * output = fopen(outputpath.c_str(), "wb");
+	MYASSERT(output, "\nATTENZIONE:\ncannot open " << outputpath);
+	
+	fwrite(&miniheader.front(), 1, miniheader_bytes, output);
+	
+	vector<char> buf(4 << 20);
+	size_t oceanbytes = 0;
+	
+	for(int g = 0; g < ngroups; ++g)
+	{
+		char name[4096];
+		snprintf(name, sizeof(name), "%s.sub%05d", indexpath.c_str(), g);
+		
+		FILE * subfile = fopen(name, "rb");
+		MYASSERT(subfile, "\nATTENZIONE:\ncannot open " << name);
+		
+		size_t n = 0, nsub = 0;
+		while ((n = fread(&buf.front(), 1, buf.size(), subfile)) > 0)
+		{
+			fwrite(&buf.front(), 1, n, output);
+			nsub += n;
+		}
+		
+		fclose(subfile);
+		
+		MYASSERT(nsub == subfilebytes[g], "\nATTENZIONE:\n" << name << " has " << nsub << " bytes instead of " << subfilebytes[g]);
+		oceanbytes += nsub;
+	}
+	
+	MYASSERT(miniheader_bytes + oceanbytes == header_displacement, "\nATTENZIONE:\nthe subfiles of " << indexpath << " are not complete");
+	
+	//the header, the metadata and the lut
+	size_t n = 0;
+	while ((n = fread(&buf.front(), 1, buf.size(), index)) > 0)
+		fwrite(&buf.front(), 1, n, output);
+	
+	fclose(index);
+	fclose(output);
+}
@@ -6,6 +6,7 @@
  *  Copyright 2013 ETH Zurich. All rights reserved.
  *
  */
+#include <omp.h>
 #include <ArgumentParser.h>
 #include "Reader_WaveletCompression.h"
 
@@ -13,7 +14,19 @@ int main(int argc, const char **  argv)
 {
 	ArgumentParser argparser(argc, argv);
 	
-	const string pathtosimdata = argparser("-simdata").asString("data.channel0");
+	string pathtosimdata = argparser("-simdata").asString("data.channel0");
+	
+	//-assemble out: the dump was written with subfiles, put it back together first
+	if (argparser.check("-assemble"))
+	{
+		const string assembled = argparser("-assemble").asString();
+		
+		WaveletSubfiles_Assemble(pathtosimdata, assembled);
+		printf("Assembled %s into %s\n", pathtosimdata.c_str(), assembled.c_str());
+		
+		pathtosimdata = assembled;
+	}
+	
 	Reader_WaveletCompression myreader(pathtosimdata);
 	myreader.load_file();
 	printf("I found in total %dx%dx%d blocks.\n", myreader.xblocks(), myreader.yblocks(), myreader.zblocks());
@@ -26,6 +39,17 @@ int main(int argc, const char **  argv)
 		const int xblocks = myreader.xblocks();
 		const int yblocks = myreader.yblocks();
 		const int zblocks = myreader.zblocks();
+		
+		const size_t xsize = xblocks * _BLOCKSIZE_;
+		const size_t ysize = yblocks * _BLOCKSIZE_;
+		const size_t zsize = zblocks * _BLOCKSIZE_;
+		
+		vector<Real> alldata(xsize * ysize * zsize);
+		
+		const double t0 = omp_get_wtime();
+		myreader.load_all(&alldata.front());
+		const double t1 = omp_get_wtime();
+		
 		for(int ibz = 0; ibz< zblocks; ++ibz)
 			for(int iby = 0; iby< yblocks; ++iby)
 				for(int ibx = 0; ibx< xblocks; ++ibx)
@@ -36,9 +60,70 @@ int main(int argc, const char **  argv)
 							for(int ix = 0; ix< _BLOCKSIZE_; ++ix)
 							{
 								assert(!isnan(targetdata[iz][iy][ix]));
+								
+								const size_t gx = ibx * _BLOCKSIZE_ + ix;
+								const size_t gy = iby * _BLOCKSIZE_ + iy;
+								const size_t gz = ibz * _BLOCKSIZE_ + iz;
+								
+								MYASSERT(alldata[gx + xsize * (gy + ysize * gz)] == targetdata[iz][iy][ix],
+										 "load_all and load_block disagree at " << gx << " " << gy << " " << gz);
 								//printf("%d %d %d: %e\n", ix, iy, iz, targetdata[iz][iy][ix]);
 							}
 				}
+		
+		const double t2 = omp_get_wtime();
+		
+		printf("load_all: %.3f s (%.1f MB/s), block by block: %.3f s (%.1f MB/s)\n",
+			   t1 - t0, sizeof(Real) * alldata.size() / (t1 - t0) / 1024 / 1024,
+			   t2 - t1, sizeof(Real) * alldata.size() / (t2 - t1) / 1024 / 1024);
+	}
+	
+	//previews: the interpolating wavelets keep the samples at the even points, 
+	//so every coarse value must match the full resolution one
+	if (!lifting_scheme)
+	{
+		const int xblocks = myreader.xblocks();
+		const int yblocks = myreader.yblocks();
+		const int zblocks = myreader.zblocks();
+		
+		const size_t xsize = xblocks * _BLOCKSIZE_;
+		const size_t ysize = yblocks * _BLOCKSIZE_;
+		const size_t zsize = zblocks * _BLOCKSIZE_;
+		
+		vector<Real> alldata(xsize * ysize * zsize);
+		myreader.load_all(&alldata.front());
+		
+		//the upper half of the domain
+		const int start[3] = { 0, 0, zblocks / 2 };
+		const int end[3] = { xblocks, yblocks, zblocks };
+		
+		for(int c = 0; c <= myreader.max_coarsening(); ++c)
+		{
+			const int N = _BLOCKSIZE_ >> c;
+			const size_t xcoarse = (end[0] - start[0]) * N;
+			const size_t ycoarse = (end[1] - start[1]) * N;
+			const size_t zcoarse = (end[2] - start[2]) * N;
+			
+			vector<Real> coarse(xcoarse * ycoarse * zcoarse);
+			
+			const double t0 = omp_get_wtime();
+			myreader.load_region(start, end, &coarse.front(), c);
+			const double t1 = omp_get_wtime();
+			
+			for(size_t iz = 0; iz < zcoarse; ++iz)
+				for(size_t iy = 0; iy < ycoarse; ++iy)
+					for(size_t ix = 0; ix < xcoarse; ++ix)
+					{
+						const size_t gx = (start[0] * N + ix) << c;
+						const size_t gy = (start[1] * N + iy) << c;
+						const size_t gz = (start[2] * N + iz) << c;
+						
+						MYASSERT(coarse[ix + xcoarse * (iy + ycoarse * iz)] == alldata[gx + xsize * (gy + ysize * gz)], 
+								 "coarsening " << c << " disagrees at " << gx << " " << gy << " " << gz);
+					}
+			
+			printf("load_region, coarsening %d: %dx%dx%d values in %.3f s\n", c, (int)xcoarse, (int)ycoarse, (int)zcoarse, t1 - t0);
+		}
 	}
 	
 	return 0;
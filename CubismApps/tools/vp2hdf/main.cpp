@@ -58,7 +58,7 @@ int main(int argc, const char **argv)
 	hsize_t dims[4]; /* dataset dimensions */
 	hsize_t	count[4];	  /* hyperslab selection parameters */
 	hsize_t	offset[4];
-	id_t	plist_id; /* property list identifier */
+	hid_t	plist_id; /* property list identifier */
 	herr_t	status;
 
 #if 1
@@ -112,90 +112,172 @@ int main(int argc, const char **argv)
 	dset_id = H5Dcreate(file_id, "data", H5T_NATIVE_FLOAT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 	H5Sclose(filespace);
 
-	count[0] = _BLOCKSIZE_;
-	count[1] = _BLOCKSIZE_;
-	count[2] = _BLOCKSIZE_;
+	/* The work units are the subdomains of the simulation: their chunks are not shared 
+	   with other subdomains, so that every chunk is decoded exactly once. 
+	   Each rank owns a contiguous range of subdomains. */
+	const int SBX = myreader.subdomain_blocks(0);
+	const int SBY = myreader.subdomain_blocks(1);
+	const int SBZ = myreader.subdomain_blocks(2);
+
+	assert(NBX % SBX == 0 && NBY % SBY == 0 && NBZ % SBZ == 0);
+
+	const int NSX = NBX / SBX;
+	const int NSY = NBY / SBY;
+	const int NSZ = NBZ / SBZ;
+
+	const int nsubdomains = NSX * NSY * NSZ;
+	const int myfirst = (nsubdomains * (size_t)mpi_rank) / mpi_size;
+	const int mylast = (nsubdomains * (size_t)(mpi_rank + 1)) / mpi_size;
+	const int nrounds = (nsubdomains + mpi_size - 1) / mpi_size; //all the ranks go through the same number of collective writes
+
+	const int SX = SBX * _BLOCKSIZE_;
+	const int SY = SBY * _BLOCKSIZE_;
+	const int SZ = SBZ * _BLOCKSIZE_;
+
+#if defined(_TRANSPOSE_DATA_)
+	count[0] = SX;
+	count[1] = SY;
+	count[2] = SZ;
 	count[3] = 1;
-	memspace = H5Screate_simple(4, count, NULL);
+#else
+	count[0] = SZ;
+	count[1] = SY;
+	count[2] = SX;
+	count[3] = 1;
+#endif
 
 	/* Create property list for collective dataset write. */
 	plist_id = H5Pcreate(H5P_DATASET_XFER);
 #if defined(_COLLECTIVE_IO_)
 	H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_COLLECTIVE);
 #endif	
-	static Real targetdata[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_];
-	static Real storedata[_BLOCKSIZE_*_BLOCKSIZE_*_BLOCKSIZE_];
 
-	const int nblocks = NBX*NBY*NBZ;
-	const int b_end = ((nblocks + (mpi_size - 1))/ mpi_size) * mpi_size; 
+	/* Double buffering: while the master thread writes the subdomain of the previous round, 
+	   the other threads decode the next one and the master joins them when done. */
+	vector<Real> subdomaindata[2];
+	subdomaindata[0].resize(SX * (size_t)SY * SZ);
+	subdomaindata[1].resize(SX * (size_t)SY * SZ);
 
-	for (int b = mpi_rank; b < b_end; b += mpi_size)	
+	double twrite = 0;
+
+	for (int r = 0; r <= nrounds; ++r)
 	{
-#if defined(_TRANSPOSE_DATA_)
-		int x = b / (NBY * NBZ);
-		int y = (b / NBZ) % NBY;
-		int z = b % NBZ;
-#else
-		int z = b / (NBY * NBX);
-		int y = (b / NBX) % NBY;
-		int x = b % NBX;
-#endif
+		const int s_decode = myfirst + r;
+		const int s_write = myfirst + r - 1;
+
+		const bool decoding = r < nrounds && s_decode < mylast;
+		const bool writing = r > 0 && s_write < mylast;
+
+		vector< vector<int> > chunk2blocks;
+
+		int start[3] = { 0, 0, 0 };
 
-		if (b < nblocks)
+		if (decoding)
 		{
-//			printf("loading block(%d,%d,%d)\n", x, y, z); 
-			myreader.load_block(x, y, z, targetdata);
-	
+			start[0] = (s_decode % NSX) * SBX;
+			start[1] = ((s_decode / NSX) % NSY) * SBY;
+			start[2] = (s_decode / (NSX * NSY)) * SBZ;
+
+			const int end[3] = { start[0] + SBX, start[1] + SBY, start[2] + SBZ };
+
+			myreader.region_chunks(start, end, chunk2blocks);
+		}
+
+		const int nchunks = chunk2blocks.size();
+		Real * const dst = &subdomaindata[r % 2].front();
+
+#pragma omp parallel
+		{
+#pragma omp master
+			if (r > 0)
+			{
+				const double tw0 = omp_get_wtime();
+
+				memspace = H5Screate_simple(4, count, NULL);
+				filespace = H5Dget_space(dset_id);
+
+				if (writing)
+				{
 #if defined(_TRANSPOSE_DATA_)
-			for (int xb = 0; xb < _BLOCKSIZE_; xb++)
-				for (int yb = 0; yb < _BLOCKSIZE_; yb++)
-					for (int zb = 0; zb < _BLOCKSIZE_; zb++)
-						storedata[xb*_BLOCKSIZE_*_BLOCKSIZE_ + yb*_BLOCKSIZE_ + zb] = targetdata[zb][yb][xb];
-			offset[0] = x * count[0];
-			offset[1] = y * count[1];
-			offset[2] = z * count[2];
-			offset[3] = 0;
+					offset[0] = (s_write % NSX) * SX;
+					offset[1] = ((s_write / NSX) % NSY) * SY;
+					offset[2] = (s_write / (NSX * NSY)) * SZ;
+					offset[3] = 0;
 #else
-			offset[0] = z * count[0];
-			offset[1] = y * count[1];
-			offset[2] = x * count[2];
-			offset[3] = 0;
+					offset[0] = (s_write / (NSX * NSY)) * SZ;
+					offset[1] = ((s_write / NSX) % NSY) * SY;
+					offset[2] = (s_write % NSX) * SX;
+					offset[3] = 0;
 #endif
-		
+					/* Select hyperslab in the file */
+					H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+				}
+				else
+				{
+					H5Sselect_none(memspace);
+					H5Sselect_none(filespace);
+				}
+
+				status = H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, plist_id, &subdomaindata[(r - 1) % 2].front());
+
+				H5Sclose(filespace);
+				H5Sclose(memspace);
+
+				twrite += omp_get_wtime() - tw0;
+			}
+
+			Reader_WaveletCompression::DecodedChunk chunk;
+			Real targetdata[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_];
+
+#pragma omp for schedule(dynamic, 1)
+			for (int c = 0; c < nchunks; ++c)
+			{
+				const vector<int>& myblocks = chunk2blocks[c];
+
+				myreader.decode_chunk(myblocks.front(), chunk);
 
-			/* Select hyperslab in the file */
-			filespace = H5Dget_space(dset_id);
-			H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
+				for (int i = 0; i < myblocks.size(); ++i)
+				{
+					const int id = myblocks[i];
+
+					myreader.decompress_block(chunk, id, &targetdata[0][0][0]);
+
+					const int x0 = (id % NBX - start[0]) * _BLOCKSIZE_;
+					const int y0 = ((id / NBX) % NBY - start[1]) * _BLOCKSIZE_;
+					const int z0 = (id / (NBX * NBY) - start[2]) * _BLOCKSIZE_;
 
 #if defined(_TRANSPOSE_DATA_)
-			status = H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, plist_id, storedata);
+					for (int xb = 0; xb < _BLOCKSIZE_; xb++)
+						for (int yb = 0; yb < _BLOCKSIZE_; yb++)
+							for (int zb = 0; zb < _BLOCKSIZE_; zb++)
+								dst[z0 + zb + SZ * (y0 + yb + SY * (size_t)(x0 + xb))] = targetdata[zb][yb][xb];
 #else
-			status = H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, plist_id, targetdata);
+					for (int zb = 0; zb < _BLOCKSIZE_; zb++)
+						for (int yb = 0; yb < _BLOCKSIZE_; yb++)
+							memcpy(dst + x0 + SX * (y0 + yb + SY * (size_t)(z0 + zb)), &targetdata[zb][yb][0], sizeof(Real) * _BLOCKSIZE_);
 #endif
-			H5Sclose(filespace);
-		}
-		else {
-			H5Sselect_none(memspace);
-			
-			filespace = H5Dget_space(dset_id);
-			H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-			H5Sselect_none(filespace);
-			
-			status = H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, plist_id, NULL);
+				}
+			}
 		}
 	}
 	const double t1 = omp_get_wtime(); 
 
-	if (!mpi_rank)
 	{
-		fprintf(stderr, "Init time = %.3lf seconds\n", init_t1-init_t0);
-		fprintf(stderr, "Elapsed time = %.3lf seconds\n", t1-t0);
-		fflush(0);
+		double maxtwrite = 0;
+		mycomm.Reduce(&twrite, &maxtwrite, 1, MPI::DOUBLE, MPI::MAX, 0);
+
+		if (!mpi_rank)
+		{
+			const double gbytes = NX * (double)NY * NZ * sizeof(Real) / 1024. / 1024. / 1024.;
+
+			fprintf(stderr, "Init time = %.3lf seconds\n", init_t1-init_t0);
+			fprintf(stderr, "Elapsed time = %.3lf seconds, %.3lf GB/s (%.2f GB), max time in writes: %.3lf seconds\n", 
+					t1-t0, gbytes / (t1-t0), gbytes, maxtwrite);
+			fflush(0);
+		}
 	}
-	
 
 	/* Close/release resources */
-	H5Sclose(memspace);
 	H5Dclose(dset_id);
 	H5Pclose(plist_id);
 	H5Fclose(file_id);
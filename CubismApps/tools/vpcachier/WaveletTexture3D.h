@@ -11,11 +11,19 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <map>
 #include <sstream>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace std;
 
 #include <mpi.h>
+#include <omp.h>
 
 #include "../../MPCFnode/source/WaveletCompressor.h"
 
@@ -65,6 +73,7 @@ struct WaveletTexture3D
 	TextureCompressor wavcomp;
 
 	WaveletsOnInterval::FwtAp (& data())[_VOXELS_][_VOXELS_][_VOXELS_] { return wavcomp.uncompressed_data(); }
+	const WaveletsOnInterval::FwtAp (& data() const)[_VOXELS_][_VOXELS_][_VOXELS_] { return wavcomp.uncompressed_data(); }
 	
 	void compress(const float threshold, const bool halffloat, const unsigned char *& compresseddata, size_t& nbytes)
 	{
@@ -315,6 +324,242 @@ public:
 	}
 };
 
+//read-only access to a collection through a memory map: the lut is used in place,
+//decoded textures are kept in a small LRU cache and a miss hints the kernel 
+//to fetch the compressed data of the neighbouring textures in the background
+class WaveletTexture3D_CollectionMapped: public WaveletTexture3D_Collection
+{
+	int filedescriptor;
+	size_t filesize;
+	unsigned char * filedata;
+	
+	const CompressedTexData * lut;
+	
+	typedef list< pair<int, WaveletTexture3D *> > TextureList;
+	TextureList lru;
+	map<int, TextureList::iterator> cachedtextures;
+	int cache_maxtextures;
+	bool readahead;
+	
+	size_t cache_hits, cache_misses;
+	
+	//the header is a list of "Key: value" lines
+	map<string, string> _parse_header(const string text) const
+	{
+		map<string, string> entries;
+		
+		istringstream lines(text);
+		string line;
+		
+		while (getline(lines, line))
+		{
+			const size_t colon = line.find(": ");
+			
+			if (colon != string::npos)
+				entries[line.substr(0, colon)] = line.substr(colon + 2);
+		}
+		
+		return entries;
+	}
+	
+	//MADV_WILLNEED is asynchronous: it just queues the reads of the pages
+	void _prefetch(const int index) const
+	{
+		if (index < 0 || index >= ntextures || cachedtextures.find(index) != cachedtextures.end()) return;
+		
+		const size_t pagesize = sysconf(_SC_PAGESIZE);
+		const size_t start = lut[index].start / pagesize * pagesize;
+		const size_t end = lut[index].start + lut[index].nbytes;
+		
+		madvise(filedata + start, end - start, MADV_WILLNEED);
+	}
+	
+	void _prefetch_neighbours(const int index) const
+	{
+		const int ix = index % xtextures;
+		const int iy = (index / xtextures) % ytextures;
+		const int iz = index / (xtextures * ytextures);
+		
+		const int d[6][3] = { {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1} };
+		
+		for(int i = 0; i < 6; ++i)
+		{
+			const int nx = ix + d[i][0], ny = iy + d[i][1], nz = iz + d[i][2];
+			
+			if (nx >= 0 && nx < xtextures && ny >= 0 && ny < ytextures && nz >= 0 && nz < ztextures)
+				_prefetch(nx + xtextures * (ny + ytextures * nz));
+		}
+	}
+	
+	WaveletTexture3D * _decode(const int index, WaveletTexture3D * texture) const
+	{
+		const size_t nbytes = lut[index].nbytes;
+		
+		MYASSERT(lut[index].start + nbytes <= filesize, "\nATTENZIONE:\nTexture " << index << " is beyond the end of the file. Path: " << path);
+		
+		texture->geometry = lut[index].geometry;
+		
+		memcpy(texture->compression_buffer(), filedata + lut[index].start, nbytes);
+		texture->decompress(halffloat, nbytes);
+		
+		return texture;
+	}
+	
+public:
+	
+	WaveletTexture3D_CollectionMapped(const string path, const int cachedtextures = 8, const bool readahead = true): 
+	WaveletTexture3D_Collection(path, false), filedescriptor(-1), filesize(0), filedata(NULL), lut(NULL), 
+	cache_maxtextures(max(1, cachedtextures)), readahead(readahead), cache_hits(0), cache_misses(0)
+	{
+		filedescriptor = open(path.c_str(), O_RDONLY);
+		MYASSERT(filedescriptor >= 0, "\nATTENZIONE:\nOooops could not open the file. Path: " << path);
+		
+		struct stat filestatus;
+		fstat(filedescriptor, &filestatus);
+		filesize = filestatus.st_size;
+		
+		void * const ptr = mmap(NULL, filesize, PROT_READ, MAP_SHARED, filedescriptor, 0);
+		MYASSERT(ptr != MAP_FAILED, "\nATTENZIONE:\nCould not map the file. Path: " << path);
+		
+		filedata = (unsigned char *)ptr;
+		
+		//we decide what to read, not the kernel
+		madvise(filedata, filesize, MADV_RANDOM);
+		
+		//header
+		{
+			const string lutmarker = "==============START-BINARY-LUT==============\n";
+			const string text((char *)filedata, min(filesize, (size_t)(16 << 10)));
+			const size_t markerpos = text.find(lutmarker);
+			
+			MYASSERT(markerpos != string::npos, "\nATTENZIONE:\nThis is not a texture collection. Path: " << path);
+			
+			map<string, string> entries = _parse_header(text.substr(0, markerpos));
+			
+			MYASSERT(entries["Endianess"] == "little", "ooops Endianess is not little!\n");
+			
+			const int voxels = atoi(entries["Voxelsperdimension"].c_str());
+			MYASSERT(voxels == _VOXELS_, "Ooops voxels " << voxels << " instead of " << _VOXELS_ << "\n");
+			
+			sscanf(entries["Textures"].c_str(), "%d x %d x %d", &xtextures, &ytextures, &ztextures);
+			ntextures = xtextures * ytextures * ztextures;
+			
+			halffloat = entries["HalfFloat"] == "yes";
+			wavelet_threshold = atof(entries["Threshold"].c_str());
+			
+			MYASSERT(entries["Wavelets"] == WaveletsOnInterval::ChosenWavelets_GetName(),
+					 "\nATTENZIONE:\nWavelets in the file is " << entries["Wavelets"] << 
+					 " and i have " << WaveletsOnInterval::ChosenWavelets_GetName() << "\n");
+			
+			MYASSERT(entries["Encoder"] == "zlib", "\nATTENZIONE:\nEncoder in the file is " << entries["Encoder"] << " and i have zlib.\n");
+			
+			const int sizeofstruct = atoi(entries["SizeofCompressedTexData"].c_str());
+			MYASSERT(sizeof(CompressedTexData) == sizeofstruct,
+					 "\nATTENZIONE:\nSizeofCompressedTexData in the file is " << sizeofstruct << 
+					 " and i have " << sizeof(CompressedTexData) << "\n");
+			
+			lutfile_start = markerpos + lutmarker.size();
+		}
+		
+		MYASSERT(lutfile_start + ntextures * sizeof(CompressedTexData) <= filesize, "\nATTENZIONE:\nThe lut is truncated. Path: " << path);
+		
+		lut = (const CompressedTexData *)(filedata + lutfile_start);
+		
+		printf("Textures: %d x %d x %d, HalfFloat: %s, Threshold: %e\n", 
+			   xtextures, ytextures, ztextures, halffloat ? "yes" : "no", wavelet_threshold);
+	}
+	
+	~WaveletTexture3D_CollectionMapped()
+	{
+		for(TextureList::iterator it = lru.begin(); it != lru.end(); ++it)
+			delete it->second;
+		
+		munmap(filedata, filesize);
+		close(filedescriptor);
+		
+		printf("Texture cache: %zd hits, %zd misses.\n", cache_hits, cache_misses);
+	}
+	
+	const WaveletTexture3D::Geometry& geometry(const int index) const
+	{
+		assert(index >= 0 && index < ntextures);
+		
+		return lut[index].geometry;
+	}
+	
+	//the texture stays valid until cachedtextures other textures have been fetched
+	const WaveletTexture3D& fetch(const int index)
+	{
+		assert(index >= 0 && index < ntextures);
+		
+		map<int, TextureList::iterator>::iterator it = cachedtextures.find(index);
+		
+		if (it != cachedtextures.end())
+		{
+			++cache_hits;
+			lru.splice(lru.begin(), lru, it->second);
+			
+			return *lru.front().second;
+		}
+		
+		++cache_misses;
+		
+		//recycle the least recently used texture
+		WaveletTexture3D * texture = NULL;
+		
+		if (lru.size() >= cache_maxtextures)
+		{
+			texture = lru.back().second;
+			cachedtextures.erase(lru.back().first);
+			lru.pop_back();
+		}
+		else
+			texture = new WaveletTexture3D;
+		
+		lru.push_front(make_pair(index, _decode(index, texture)));
+		cachedtextures[index] = lru.begin();
+		
+		if (readahead)
+			_prefetch_neighbours(index);
+		
+		return *texture;
+	}
+	
+	const WaveletTexture3D& fetch(const int ix, const int iy, const int iz)
+	{
+		assert(ix >= 0 && ix < xtextures);
+		assert(iy >= 0 && iy < ytextures);
+		assert(iz >= 0 && iz < ztextures);
+		
+		return fetch(ix + xtextures * (iy + ytextures * iz));
+	}
+	
+	//bypasses the cache
+	void read(const int index, WaveletTexture3D& texture, bool onlygeometry = false) const
+	{
+		assert(index >= 0 && index < ntextures);
+		
+		if (onlygeometry)
+			texture.geometry = lut[index].geometry;
+		else
+			_decode(index, &texture);
+	}
+	
+	void read(const int ix, const int iy, const int iz, WaveletTexture3D& texture, bool onlygeometry = false) const
+	{
+		assert(ix >= 0 && ix < xtextures);
+		assert(iy >= 0 && iy < ytextures);
+		assert(iz >= 0 && iz < ztextures);
+		
+		read(ix + xtextures * (iy + ytextures * iz), texture, onlygeometry);
+	}
+	
+	void write(const int ix, const int iy, const int iz, WaveletTexture3D& texture)
+	{
+		MYASSERT(false, "\nATTENZIONE:\nThe mapped collection is read-only. Path: " << path);
+	}
+};
+
 class WaveletTexture3D_CollectionMPI: public WaveletTexture3D_Collection
 {	
 	size_t * file_offset;
@@ -322,13 +567,88 @@ class WaveletTexture3D_CollectionMPI: public WaveletTexture3D_Collection
 	MPI::Win rmawindow;
 	MPI::File myfile;
 	const MPI::Intracomm& mycomm;
+	
+	//file space is reserved from the shared offset in batches,
+	//the threads of a rank carve their textures out of the current batch with an atomic add
+	struct FileBatch { size_t start, size, used; };
+	
+	enum { BATCHSIZE = 4 << 20 };
+	
+	FileBatch * volatile current_batch;
+	vector<FileBatch *> batches;
+	
+	//otherwise the MPI calls are serialized
+	const bool mpi_multiple;
+	
+	FileBatch * _new_batch(const size_t minsize)
+	{
+		FileBatch * batch = new FileBatch;
+		
+		//a few textures per thread, so that the holes left behind stay small
+		batch->size = max(minsize, min((size_t)BATCHSIZE, 4 * omp_get_max_threads() * minsize));
+		batch->used = 0;
+		batch->start = 0;
+		
+		rmawindow.Lock(MPI::LOCK_EXCLUSIVE, 0, 0);
+		rmawindow.Get(&batch->start, 1, MPI_UINT64_T, 0, 0, 1, MPI_UINT64_T); 
+		rmawindow.Accumulate(&batch->size, 1, MPI_UINT64_T, 0, 0, 1, MPI_UINT64_T, MPI::SUM);
+		rmawindow.Unlock(0);
+		
+		assert(batch->start != 0);
+		
+		batches.push_back(batch);
+		
+		return batch;
+	}
+	
+	//thread-safe, lock-free unless the current batch is exhausted.
+	//the tail of an exhausted batch is left unused, the lut tells where the textures are
+	size_t _allocate(const size_t nbytes)
+	{
+		while (true)
+		{
+			FileBatch * const batch = current_batch;
+			
+			if (batch != NULL)
+			{
+				const size_t myoffset = __sync_fetch_and_add(&batch->used, nbytes);
+				
+				if (myoffset + nbytes <= batch->size)
+					return batch->start + myoffset;
+			}
+			
+#pragma omp critical(vpcachier_mpi)
+			{
+				if (current_batch == batch)
+				{
+					FileBatch * const newbatch = _new_batch(nbytes);
+					
+					__sync_synchronize();
+					
+					current_batch = newbatch;
+				}
+			}
+		}
+	}
+	
+	void _write_at(const size_t offset, const void * const ptr, const size_t nbytes)
+	{
+		if (mpi_multiple)
+			myfile.Write_at(offset, ptr, nbytes, MPI::CHAR);
+		else
+		{
+#pragma omp critical(vpcachier_mpi)
+			myfile.Write_at(offset, ptr, nbytes, MPI::CHAR);
+		}
+	}
 
 public:
 	
 	WaveletTexture3D_CollectionMPI(const MPI::Intracomm& comm, 
 								   const string path, const int xtextures, const int ytextures, const int ztextures,
 								   const float wavelet_threshold, const bool halffloat): 
-	mycomm(comm), WaveletTexture3D_Collection(path, xtextures, ytextures, ztextures, wavelet_threshold, halffloat, false), file_offset(NULL)
+	mycomm(comm), WaveletTexture3D_Collection(path, xtextures, ytextures, ztextures, wavelet_threshold, halffloat, false), file_offset(NULL),
+	current_batch(NULL), mpi_multiple(MPI::Query_thread() == MPI_THREAD_MULTIPLE)
 	{		
 		const int mygid = comm.Get_rank();
 
@@ -365,6 +685,9 @@ public:
 		
 		MPI::Free_mem(file_offset);
 		
+		for(int i = 0; i < batches.size(); ++i)
+			delete batches[i];
+		
 		myfile.Close(); 		
 	}
 		
@@ -388,24 +711,18 @@ public:
 		}
 
 		//obtain file offset
-		size_t myoffset = 0;
-		{
-			rmawindow.Lock(MPI::LOCK_EXCLUSIVE, 0, 0);
-			rmawindow.Get(&myoffset, 1, MPI_UINT64_T, 0, 0, 1, MPI_UINT64_T); 
-			rmawindow.Accumulate(&nbytes, 1, MPI_UINT64_T, 0, 0, 1, MPI_UINT64_T, MPI::SUM);
-			rmawindow.Unlock(0);
-		}
+		const size_t myoffset = _allocate(nbytes);
 		assert(myoffset != 0);
 
 		//write lut
 		CompressedTexData entry = { texture.geometry, myoffset, nbytes };
 		
 		const size_t mylutoffset = sizeof(entry) * (ix + xtextures * (iy + ytextures * iz));
-		myfile.Write_at(lutfile_start + mylutoffset, &entry, sizeof(entry), MPI::CHAR);
+		_write_at(lutfile_start + mylutoffset, &entry, sizeof(entry));
 
 		//write data
 		assert(ptr != NULL);
 		assert(nbytes != 0);
-		myfile.Write_at(myoffset, ptr, nbytes, MPI::CHAR);
+		_write_at(myoffset, ptr, nbytes);
 	}
 };
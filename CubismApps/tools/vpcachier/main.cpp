@@ -10,6 +10,7 @@
 #include <iostream>
 #include <string>
 #include <mpi.h>
+#include <omp.h>
 #include <numeric>
 
 #include <ArgumentParser.h>
@@ -17,9 +18,21 @@
 #include "Reader_WaveletCompression.h"
 #include "WaveletTexture3D.h"
 
+//evicts the pages of the file from the page cache, so that every reader starts cold
+void _drop_from_pagecache(const string path)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	
+	if (fd < 0 || fsync(fd) || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+		printf("Could not drop %s from the page cache, the reading times are warm\n", path.c_str());
+	
+	if (fd >= 0) close(fd);
+}
+
 int main(int argc, const char **  argv)
 {	
-	MPI::Init_thread(MPI_THREAD_SERIALIZED);
+	//with less than MPI_THREAD_MULTIPLE the collection serializes its MPI calls
+	MPI::Init_thread(MPI_THREAD_MULTIPLE);
 	
 	//create my cartesian communicator
 	MPI::Intracomm& mycomm = MPI::COMM_WORLD;
@@ -48,17 +61,57 @@ int main(int argc, const char **  argv)
 	{
 		if (isroot)
 		{
-			WaveletTexture3D_Collection texture_collection(pathtovpfile);
-			
 			WaveletTexture3D * texture = new WaveletTexture3D;
 			
-			for(int iz = 0; iz < texture_collection.get_ztextures(); ++iz)
-				for(int iy = 0; iy < texture_collection.get_ytextures(); ++iy)
-					for(int ix = 0; ix < texture_collection.get_xtextures(); ++ix)
-						texture_collection.read(ix, iy, iz, *texture);
+			//one timed pass per reader, each from a cold page cache
+			_drop_from_pagecache(pathtovpfile);
+			
+			double tstdio = MPI::Wtime();
+			{
+				WaveletTexture3D_Collection texture_collection(pathtovpfile);
+				
+				for(int iz = 0; iz < texture_collection.get_ztextures(); ++iz)
+					for(int iy = 0; iy < texture_collection.get_ytextures(); ++iy)
+						for(int ix = 0; ix < texture_collection.get_xtextures(); ++ix)
+							texture_collection.read(ix, iy, iz, *texture);
+			}
+			tstdio = MPI::Wtime() - tstdio;
+			
+			_drop_from_pagecache(pathtovpfile);
+			
+			double tmapped = MPI::Wtime();
+			{
+				WaveletTexture3D_CollectionMapped mapped_collection(pathtovpfile, argparser("-cache").asInt(8));
+				
+				for(int iz = 0; iz < mapped_collection.get_ztextures(); ++iz)
+					for(int iy = 0; iy < mapped_collection.get_ytextures(); ++iy)
+						for(int ix = 0; ix < mapped_collection.get_xtextures(); ++ix)
+							mapped_collection.fetch(ix, iy, iz);
+			}
+			tmapped = MPI::Wtime() - tmapped;
+			
+			//untimed: the mapped reader must give back the very same textures
+			{
+				WaveletTexture3D_Collection texture_collection(pathtovpfile);
+				WaveletTexture3D_CollectionMapped mapped_collection(pathtovpfile, argparser("-cache").asInt(8));
+				
+				for(int iz = 0; iz < texture_collection.get_ztextures(); ++iz)
+					for(int iy = 0; iy < texture_collection.get_ytextures(); ++iy)
+						for(int ix = 0; ix < texture_collection.get_xtextures(); ++ix)
+						{
+							texture_collection.read(ix, iy, iz, *texture);
+							const WaveletTexture3D& mapped = mapped_collection.fetch(ix, iy, iz);
+							
+							MYASSERT(!memcmp(&mapped.geometry, &texture->geometry, sizeof(texture->geometry)) && 
+									 !memcmp(mapped.data(), texture->data(), sizeof(texture->data())), 
+									 "mismatch between the mapped and the stdio reader at texture " << ix << " " << iy << " " << iz);
+						}
+			}
 			
 			delete texture;
 			
+			printf("Reading time: stdio %.3f s, mapped %.3f s\n", tstdio, tmapped);
+			
 			printf("Bella li, tutto in regola. Sa vedum!\n");
 		}
 	}
@@ -119,119 +172,140 @@ int main(int argc, const char **  argv)
 		
 		WaveletTexture3D_CollectionMPI texture_collection(mycomm, pathtovpfile, xtextures, ytextures, ztextures, wavelet_threshold, halffloat);
 		
-		for(int g = mystart; g < myend; ++g)
+		const double tstart = MPI::Wtime();
+		
+		//textures are independent: each thread has its own working set and the
+		//collection hands out file space to the threads without locking
+#pragma omp parallel
 		{
-			const int gx = g % xtextures;
-			const int gy = (g / xtextures) % ytextures;
-			const int gz = g / (xtextures * ytextures);
+			WaveletTexture3D * texture = new WaveletTexture3D;
+			Reader_WaveletCompression::DecodedChunk chunk;
 			
-			assert(gx >= 0 && gx < xtextures);
-			assert(gy >= 0 && gy < ytextures);
-			assert(gz >= 0 && gz < ztextures);
+			vector<Real> myvmaxval, myvminval, myvavg;
 			
-			WaveletTexture3D * texture = new WaveletTexture3D;
-			WaveletsOnInterval::FwtAp * const ptrtexdata = & texture->data()[0][0][0];
+#pragma omp for schedule(dynamic, 1)
+			for(int g = mystart; g < myend; ++g)
+			{
+				const int gx = g % xtextures;
+				const int gy = (g / xtextures) % ytextures;
+				const int gz = g / (xtextures * ytextures);
 			
-			const int xdatastart = gx * puredata1d;
-			const int ydatastart = gy * puredata1d;
-			const int zdatastart = gz * puredata1d;
+				assert(gx >= 0 && gx < xtextures);
+				assert(gy >= 0 && gy < ytextures);
+				assert(gz >= 0 && gz < ztextures);
 			
-			const int xdataend = (gx + 1) * puredata1d + 2 * ghosts1side;
-			const int ydataend = (gy + 1) * puredata1d + 2 * ghosts1side;
-			const int zdataend = (gz + 1) * puredata1d + 2 * ghosts1side;
+				WaveletsOnInterval::FwtAp * const ptrtexdata = & texture->data()[0][0][0];
 			
-			texture->geometry.setup<0>(xdatastart, xdataend, ghosts1side, gridspacing);
-			texture->geometry.setup<1>(ydatastart, ydataend, ghosts1side, gridspacing);
-			texture->geometry.setup<2>(zdatastart, zdataend, ghosts1side, gridspacing);
+				const int xdatastart = gx * puredata1d;
+				const int ydatastart = gy * puredata1d;
+				const int zdatastart = gz * puredata1d;
 			
-			assert(xdataend - xdatastart == _VOXELS_);
-			assert(ydataend - ydatastart == _VOXELS_);
-			assert(zdataend - zdatastart == _VOXELS_);
+				const int xdataend = (gx + 1) * puredata1d + 2 * ghosts1side;
+				const int ydataend = (gy + 1) * puredata1d + 2 * ghosts1side;
+				const int zdataend = (gz + 1) * puredata1d + 2 * ghosts1side;
 			
-			const int xblockstart = xdatastart / _BLOCKSIZE_;
-			const int yblockstart = ydatastart / _BLOCKSIZE_;
-			const int zblockstart = zdatastart / _BLOCKSIZE_;
+				texture->geometry.setup<0>(xdatastart, xdataend, ghosts1side, gridspacing);
+				texture->geometry.setup<1>(ydatastart, ydataend, ghosts1side, gridspacing);
+				texture->geometry.setup<2>(zdatastart, zdataend, ghosts1side, gridspacing);
 			
-			const int xblockend = (xdataend - 1) / _BLOCKSIZE_ + 1;
-			const int yblockend = (ydataend - 1) / _BLOCKSIZE_ + 1;
-			const int zblockend = (zdataend - 1) / _BLOCKSIZE_ + 1;
+				assert(xdataend - xdatastart == _VOXELS_);
+				assert(ydataend - ydatastart == _VOXELS_);
+				assert(zdataend - zdatastart == _VOXELS_);
 			
-			for(int bz = zblockstart; bz < zblockend; ++bz)
-				for(int by = yblockstart; by < yblockend; ++by)
-					for(int bx = xblockstart; bx < xblockend; ++bx)
-					{
-						Real data[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_];
+				const int xblockstart = xdatastart / _BLOCKSIZE_;
+				const int yblockstart = ydatastart / _BLOCKSIZE_;
+				const int zblockstart = zdatastart / _BLOCKSIZE_;
+			
+				const int xblockend = (xdataend - 1) / _BLOCKSIZE_ + 1;
+				const int yblockend = (ydataend - 1) / _BLOCKSIZE_ + 1;
+				const int zblockend = (zdataend - 1) / _BLOCKSIZE_ + 1;
+			
+				for(int bz = zblockstart; bz < zblockend; ++bz)
+					for(int by = yblockstart; by < yblockend; ++by)
+						for(int bx = xblockstart; bx < xblockend; ++bx)
+						{
+							Real data[_BLOCKSIZE_][_BLOCKSIZE_][_BLOCKSIZE_];
 						
-						assert(bx >= 0 && bx < xblocks);
-						assert(by >= 0 && by < yblocks);
-						assert(bz >= 0 && bz < zblocks);
+							assert(bx >= 0 && bx < xblocks);
+							assert(by >= 0 && by < yblocks);
+							assert(bz >= 0 && bz < zblocks);
 						
-						myreader.load_block(bx, by, bz, data);
+							myreader.load_block(bx, by, bz, data, chunk);
 						
-						const int xdststart = std::max(xdatastart, bx * _BLOCKSIZE_) - xdatastart;
-						const int ydststart = std::max(ydatastart, by * _BLOCKSIZE_) - ydatastart;
-						const int zdststart = std::max(zdatastart, bz * _BLOCKSIZE_) - zdatastart;
+							const int xdststart = std::max(xdatastart, bx * _BLOCKSIZE_) - xdatastart;
+							const int ydststart = std::max(ydatastart, by * _BLOCKSIZE_) - ydatastart;
+							const int zdststart = std::max(zdatastart, bz * _BLOCKSIZE_) - zdatastart;
 						
-						const int xdstend = std::min(xdataend, (bx + 1) * _BLOCKSIZE_) - xdatastart;
-						const int ydstend = std::min(ydataend, (by + 1) * _BLOCKSIZE_) - ydatastart;
-						const int zdstend = std::min(zdataend, (bz + 1) * _BLOCKSIZE_) - zdatastart;
+							const int xdstend = std::min(xdataend, (bx + 1) * _BLOCKSIZE_) - xdatastart;
+							const int ydstend = std::min(ydataend, (by + 1) * _BLOCKSIZE_) - ydatastart;
+							const int zdstend = std::min(zdataend, (bz + 1) * _BLOCKSIZE_) - zdatastart;
 						
-						const int xsrcoffset = xdatastart - bx * _BLOCKSIZE_;
-						const int ysrcoffset = ydatastart - by * _BLOCKSIZE_;
-						const int zsrcoffset = zdatastart - bz * _BLOCKSIZE_;
+							const int xsrcoffset = xdatastart - bx * _BLOCKSIZE_;
+							const int ysrcoffset = ydatastart - by * _BLOCKSIZE_;
+							const int zsrcoffset = zdatastart - bz * _BLOCKSIZE_;
 						
-						for(int dz = zdststart; dz < zdstend; ++dz)
-							for(int dy = ydststart; dy < ydstend; ++dy)
-								for(int dx = xdststart; dx < xdstend; ++dx)
-								{
-									assert(dx >= 0 && dx < _VOXELS_);
-									assert(dy >= 0 && dy < _VOXELS_);
-									assert(dz >= 0 && dz < _VOXELS_);
+							for(int dz = zdststart; dz < zdstend; ++dz)
+								for(int dy = ydststart; dy < ydstend; ++dy)
+									for(int dx = xdststart; dx < xdstend; ++dx)
+									{
+										assert(dx >= 0 && dx < _VOXELS_);
+										assert(dy >= 0 && dy < _VOXELS_);
+										assert(dz >= 0 && dz < _VOXELS_);
 									
-									assert(dx + xsrcoffset >= 0 && dx + xsrcoffset < _BLOCKSIZE_);
-									assert(dy + ysrcoffset >= 0 && dy + ysrcoffset < _BLOCKSIZE_);
-									assert(dz + zsrcoffset >= 0 && dz + zsrcoffset < _BLOCKSIZE_);
+										assert(dx + xsrcoffset >= 0 && dx + xsrcoffset < _BLOCKSIZE_);
+										assert(dy + ysrcoffset >= 0 && dy + ysrcoffset < _BLOCKSIZE_);
+										assert(dz + zsrcoffset >= 0 && dz + zsrcoffset < _BLOCKSIZE_);
 									
-									ptrtexdata[dx + _VOXELS_ * (dy + _VOXELS_ * dz)] = data[dz + zsrcoffset][dy + ysrcoffset][dx + xsrcoffset];
-								}
-					}
+										ptrtexdata[dx + _VOXELS_ * (dy + _VOXELS_ * dz)] = data[dz + zsrcoffset][dy + ysrcoffset][dx + xsrcoffset];
+									}
+						}
 			
-			//normalize the data
-			{
-				const Real a1 = 1 / (maxval - minval);
-				const Real a0 = -minval * a1;
+				//normalize the data
+				{
+					const Real a1 = 1 / (maxval - minval);
+					const Real a0 = -minval * a1;
 				
-				Real mysum = 0, mymax = -HUGE_VAL, mymin = HUGE_VAL;
+					Real mysum = 0, mymax = -HUGE_VAL, mymin = HUGE_VAL;
 				
-				for(int i = 0; i < _VOXELS_ * _VOXELS_ * _VOXELS_; ++i)
-				{
-					const float val = ptrtexdata[i]; 
-					ptrtexdata[i] = std::min(1.f, std::max(0.f, a0 + a1 * val));
-					assert(ptrtexdata[i] >= 0 && ptrtexdata[i] <= 1);
+					for(int i = 0; i < _VOXELS_ * _VOXELS_ * _VOXELS_; ++i)
+					{
+						const float val = ptrtexdata[i]; 
+						ptrtexdata[i] = std::min(1.f, std::max(0.f, a0 + a1 * val));
+						assert(ptrtexdata[i] >= 0 && ptrtexdata[i] <= 1);
 					
-					mysum += val;
-					mymin = min(mymin, (Real)val);
-					mymax = max(mymax, (Real)val);									
-				}
+						mysum += val;
+						mymin = min(mymin, (Real)val);
+						mymax = max(mymax, (Real)val);									
+					}
 				
-				vmaxval.push_back(mymax);
-				vminval.push_back(mymin);
-				vavg.push_back(mysum / (_VOXELS_ * _VOXELS_ * _VOXELS_));
-			}
+					myvmaxval.push_back(mymax);
+					myvminval.push_back(mymin);
+					myvavg.push_back(mysum / (_VOXELS_ * _VOXELS_ * _VOXELS_));
+				}
 			
-			assert(xblockstart >= 0 && xblockstart < xblocks);
-			assert(yblockstart >= 0 && yblockstart < yblocks);
-			assert(zblockstart >= 0 && zblockstart < zblocks);
+				assert(xblockstart >= 0 && xblockstart < xblocks);
+				assert(yblockstart >= 0 && yblockstart < yblocks);
+				assert(zblockstart >= 0 && zblockstart < zblocks);
 			
-			assert(xblockend > 0 && xblockend <= xblocks);
-			assert(yblockend > 0 && yblockend <= yblocks);
-			assert(zblockend > 0 && zblockend <= zblocks);
+				assert(xblockend > 0 && xblockend <= xblocks);
+				assert(yblockend > 0 && yblockend <= yblocks);
+				assert(zblockend > 0 && zblockend <= zblocks);
 			
-			texture_collection.write(gx, gy, gz, *texture);
+				texture_collection.write(gx, gy, gz, *texture);
+			}
+			
+#pragma omp critical
+			{
+				vmaxval.insert(vmaxval.end(), myvmaxval.begin(), myvmaxval.end());
+				vminval.insert(vminval.end(), myvminval.begin(), myvminval.end());
+				vavg.insert(vavg.end(), myvavg.begin(), myvavg.end());
+			}
 			
 			delete texture;
 		}
 		
+		const double tend = MPI::Wtime();
+		
 		//spit some statistics
 		{
 			//in case we did not do anything, put some fake values in the stat to prevent sigfault
@@ -256,6 +330,17 @@ int main(int argc, const char **  argv)
 				printf("Ok we are done here. The min, avg, max values found are : %.2f %.2f %.2f\n",  minval, avgval, maxval);
 		}
 		
+		//and some timings
+		{
+			double telapsed = tend - tstart;
+			
+			mycomm.Reduce(isroot ? MPI::IN_PLACE : &telapsed, &telapsed, 1, MPI_DOUBLE, MPI::MAX, 0);
+			
+			if (isroot)
+				printf("%d textures built in %.2f s (%.1f textures/s) by %d ranks x %d threads.\n", 
+					   ntextures, telapsed, ntextures / telapsed, pesize, omp_get_max_threads());
+		}
+		
 		if (isroot)
 			std::cout << "Also tchuess zaeme gal.\n";
 	}